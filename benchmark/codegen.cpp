@@ -0,0 +1,128 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <parsi/parsi-c.h>
+
+// generated out of json.peg by parsi-codegen at build time.
+extern "C" parsi_result_t parsi_bench_json(parsi_stream_t stream, void* context);
+
+namespace {
+
+auto read_grammar() -> std::string
+{
+    std::ifstream file(PARSI_BENCH_JSON_GRAMMAR);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+auto make_json_value(std::mt19937& rng, int depth) -> std::string
+{
+    std::uniform_int_distribution<int> kind(0, depth > 0 ? 6 : 3);
+    std::uniform_int_distribution<int> count(0, 6);
+    switch (kind(rng)) {
+        case 0:
+            return std::to_string(static_cast<int>(rng() % 100000) - 50000) + ".25e-3";
+        case 1:
+            return "\"name \\\"" + std::to_string(rng() % 1000) + "\\\" \\u00e9\"";
+        case 2:
+            return "true";
+        case 3:
+            return "null";
+        case 4:
+        case 5: {
+            std::string object = "{ ";
+            for (int index = count(rng); index > 0; --index) {
+                object += "\"key" + std::to_string(index) + "\" : " + make_json_value(rng, depth - 1);
+                object += index > 1 ? ",\n  " : " ";
+            }
+            return object + "}";
+        }
+        default: {
+            std::string array = "[";
+            for (int index = count(rng); index > 0; --index) {
+                array += make_json_value(rng, depth - 1);
+                array += index > 1 ? ", " : "";
+            }
+            return array + "]";
+        }
+    }
+}
+
+/** a document of about `size` bytes, as an array of random values. */
+auto make_json_document(std::size_t size) -> std::string
+{
+    std::mt19937 rng(42);
+    std::string document = "[\n";
+    while (document.size() < size) {
+        document += make_json_value(rng, 4);
+        document += ",\n";
+    }
+    return document + "null\n]\n";
+}
+
+const std::string& json_document()
+{
+    static const std::string document = make_json_document(std::size_t{1} << 20);
+    return document;
+}
+
+struct CompiledGrammar {
+    explicit CompiledGrammar(std::uint32_t flags)
+    {
+        const std::string grammar = read_grammar();
+        size_t error_offset = 0;
+        compiled = parsi_compile_grammar(grammar.c_str(), nullptr, nullptr, flags, &error_offset);
+        if (!compiled) {
+            std::fprintf(stderr, "json.peg doesn't compile (at offset %zu)\n", error_offset);
+            std::abort();
+        }
+    }
+
+    CompiledGrammar(const CompiledGrammar&) = delete;
+    CompiledGrammar& operator=(const CompiledGrammar&) = delete;
+
+    ~CompiledGrammar()
+    {
+        parsi_free_compiled_parser(compiled);
+    }
+
+    parsi_compiled_parser_t* compiled = nullptr;
+};
+
+template <typename F>
+void bench_json(benchmark::State& state, F&& parse)
+{
+    const std::string& document = json_document();
+    const parsi_stream_t stream{ .cursor = document.data(), .size = document.size() };
+    if (!parse(stream).is_valid) {
+        state.SkipWithError("the document didn't match");
+        return;
+    }
+
+    for (auto _ : state) {
+        parsi_result_t result = parse(stream);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * document.size()));
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(bench_json, generated, [](parsi_stream_t stream) {
+    return parsi_bench_json(stream, nullptr);
+});
+BENCHMARK_CAPTURE(bench_json, parsi-c, [](parsi_stream_t stream) {
+    static const CompiledGrammar grammar(parsi_compile_flag_none);
+    return parsi_parse(grammar.compiled, stream);
+});
+BENCHMARK_CAPTURE(bench_json, parsi-c-jit, [](parsi_stream_t stream) {
+    static const CompiledGrammar grammar(parsi_compile_flag_jit);
+    return parsi_parse(grammar.compiled, stream);
+});
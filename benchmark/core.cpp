@@ -14,9 +14,9 @@ namespace helpers {
 
 class ParsiCParser {
 public:
-    ParsiCParser(parsi_parser_t* parser) : _parser(parser)
+    ParsiCParser(parsi_parser_t* parser, std::uint32_t flags = parsi_compile_flag_none) : _parser(parser)
     {
-        _compiled_parser = parsi_compile(_parser);
+        _compiled_parser = parsi_compile_ex(_parser, flags);
     }
 
     ParsiCParser(const ParsiCParser& other) = delete;
@@ -55,6 +55,11 @@ public:
         return parsi_parse(_compiled_parser, parsi_stream_t{.cursor = str.data(), .size = str.size()});
     }
 
+    parsi_result_t operator()(std::string_view str, void* call_ctx) const
+    {
+        return parsi_parse_ctx(_compiled_parser, parsi_stream_t{.cursor = str.data(), .size = str.size()}, call_ctx);
+    }
+
 private:
     parsi_parser_t* _parser = nullptr;
     parsi_compiled_parser_t* _compiled_parser = nullptr;
@@ -171,7 +176,6 @@ constexpr auto ctre_color_from_string(std::string_view str) -> std::optional<Col
 
 static auto parsi_c_color_from_string(std::string_view str) -> std::optional<Color>
 {
-    static thread_local Color color;
     static helpers::ParsiCParser parser = [] {
         parsi_charset_t hex_charset = parsi_charset("0123456789abcdefABCDEF");
         parsi_parser_t hex_charset_parser = parsi_expect_charset(hex_charset);
@@ -184,8 +188,8 @@ static auto parsi_c_color_from_string(std::string_view str) -> std::optional<Col
             parsi_none()
         };
         parsi_parser_t color_parser = parsi_combine_sequence(sequence_subparsers, nullptr);
-        parsi_extract_visitor_fn_t extract_visitor_fn = [](void* context, const char* str, size_t size) -> bool {
-            auto color = reinterpret_cast<Color*>(context);
+        parsi_extract_visitor_ctx_fn_t extract_visitor_fn = [](void* /* context */, void* call_ctx, const char* str, size_t size) -> bool {
+            auto color = reinterpret_cast<Color*>(call_ctx);
             // str's length is guaranteed to be 7, with first character being '#',
             // and the rest of them are guaranteed to be in hex_charset.
             color->red = convert_hex_digit(str[1]) * 16 + convert_hex_digit(str[2]);
@@ -193,11 +197,12 @@ static auto parsi_c_color_from_string(std::string_view str) -> std::optional<Col
             color->blue = convert_hex_digit(str[5]) * 16 + convert_hex_digit(str[6]);
             return true;
         };
-        parsi_parser_t raw_parser = parsi_combine_extract(&color_parser, extract_visitor_fn, &color, nullptr, nullptr);
+        parsi_parser_t raw_parser = parsi_combine_extract_ctx(&color_parser, extract_visitor_fn, nullptr, nullptr, nullptr);
         return helpers::ParsiCParser(parsi_alloc_parser(raw_parser));
     }();
 
-    parsi_result_t res = parser(str);
+    Color color;
+    parsi_result_t res = parser(str, &color);
     if (!res.is_valid)
     {
         return std::nullopt;
@@ -234,6 +239,56 @@ BENCHMARK_CAPTURE(bench_color_hex, parsi, parsi_color_from_string);
 BENCHMARK_CAPTURE(bench_color_hex, parsi-c, parsi_c_color_from_string);
 BENCHMARK_CAPTURE(bench_color_hex, ctre, ctre_color_from_string);
 
+static void bench_color_hex_validate(benchmark::State& state, bool batched)
+{
+    static parsi_compiled_parser_t* compiled_parser = [] {
+        parsi_parser_t hex_charset_parser = parsi_expect_charset(parsi_charset("0123456789abcdefABCDEF"));
+        parsi_parser_t sequence_subparsers[] = {
+            parsi_expect_char('#'),
+            parsi_combine_repeat(&hex_charset_parser, 6, 6, nullptr),
+            parsi_expect_eos(),
+            parsi_none()
+        };
+        parsi_parser_t color_parser = parsi_combine_sequence(sequence_subparsers, nullptr);
+        return parsi_compile(&color_parser);
+    }();
+
+    std::srand(std::time(nullptr));
+
+    std::vector<std::string> colors;
+    colors.reserve(1'000);
+    for (std::size_t count = 0; count < colors.capacity(); ++count)
+    {
+        colors.push_back(std::format("#{:02x}{:02x}{:02x}", std::rand()%256, std::rand()%256, std::rand()%256));
+    }
+
+    std::vector<parsi_stream_t> inputs;
+    inputs.reserve(colors.size());
+    for (auto& color_str : colors) {
+        inputs.push_back(parsi_stream_t{.cursor = color_str.data(), .size = color_str.size()});
+    }
+    std::vector<parsi_result_t> outputs(inputs.size());
+
+    std::size_t byte_count = 0;
+    for (auto _ : state) {
+        if (batched) {
+            parsi_parse_many(compiled_parser, inputs.data(), outputs.data(), inputs.size());
+        }
+        else {
+            for (std::size_t index = 0; index < inputs.size(); ++index) {
+                outputs[index] = parsi_parse(compiled_parser, inputs[index]);
+            }
+        }
+        benchmark::DoNotOptimize(outputs.data());
+        benchmark::ClobberMemory();
+        byte_count += colors.size() * 7;
+    }
+
+    state.SetBytesProcessed(byte_count);
+}
+BENCHMARK_CAPTURE(bench_color_hex_validate, parsi-c, false);
+BENCHMARK_CAPTURE(bench_color_hex_validate, parsi-c-many, true);
+
 
 static void bench_digits(benchmark::State& state, auto&& parser)
 {
@@ -268,6 +323,14 @@ BENCHMARK_CAPTURE(bench_digits, parsi, parsi::repeat(parsi::expect(parsi::CharRa
 BENCHMARK_CAPTURE(bench_digits, parsi-c, helpers::ParsiCParser(
     parsi_alloc_parser(parsi_combine_repeat(parsi_alloc_parser(parsi_expect_charset(parsi_charset("0123456789"))), 0, -1, parsi_free_parser))
 ));
+BENCHMARK_CAPTURE(bench_digits, parsi-c-threaded, helpers::ParsiCParser(
+    parsi_alloc_parser(parsi_combine_repeat(parsi_alloc_parser(parsi_expect_charset(parsi_charset("0123456789"))), 0, -1, parsi_free_parser)),
+    parsi_compile_flag_threaded_dispatch
+));
+BENCHMARK_CAPTURE(bench_digits, parsi-c-jit, helpers::ParsiCParser(
+    parsi_alloc_parser(parsi_combine_repeat(parsi_alloc_parser(parsi_expect_charset(parsi_charset("0123456789"))), 0, -1, parsi_free_parser)),
+    parsi_compile_flag_jit
+));
 BENCHMARK_CAPTURE(bench_digits, ctre, ctre::match<R"(^[0-9]*)">);
 
 
@@ -300,7 +363,8 @@ constexpr auto parsi_parser = parsi::sequence(
     parsi::eos()
 );
 
-static helpers::ParsiCParser parsi_c_parser = []() -> helpers::ParsiCParser {
+static parsi_parser_t* create_parsi_c_items_parser()
+{
     constexpr std::size_t size_t_max = std::numeric_limits<std::size_t>::max();
     constexpr auto dont_optimize_extract_visitor_fn = [](void*, const char* token, size_t) {
         benchmark::DoNotOptimize(token);
@@ -361,8 +425,26 @@ static helpers::ParsiCParser parsi_c_parser = []() -> helpers::ParsiCParser {
         ),
         helpers::delete_parser_list
     );
-    return helpers::ParsiCParser(parsi_alloc_parser(raw_parser));
-}();
+    return &raw_parser;
+}
+
+// the grammar is built from static nodes, so the compiled parsers must not free it.
+static const auto parsi_c_parser = [](std::string_view str) {
+    static parsi_compiled_parser_t* compiled_parser = parsi_compile(create_parsi_c_items_parser());
+    return parsi_parse(compiled_parser, parsi_stream_t{.cursor = str.data(), .size = str.size()});
+};
+
+static const auto parsi_c_threaded_parser = [](std::string_view str) {
+    static parsi_compiled_parser_t* compiled_parser =
+        parsi_compile_ex(create_parsi_c_items_parser(), parsi_compile_flag_threaded_dispatch);
+    return parsi_parse(compiled_parser, parsi_stream_t{.cursor = str.data(), .size = str.size()});
+};
+
+static const auto parsi_c_jit_parser = [](std::string_view str) {
+    static parsi_compiled_parser_t* compiled_parser =
+        parsi_compile_ex(create_parsi_c_items_parser(), parsi_compile_flag_jit);
+    return parsi_parse(compiled_parser, parsi_stream_t{.cursor = str.data(), .size = str.size()});
+};
 
 constexpr auto ctre_parser = ctre::match<R"(^\[\s*(([0-9]+|[A-Za-z_]+[A-Za-z0-9_]*)\s*(,\s*([0-9]+|[A-Za-z_]+[A-Za-z0-9_]*)\s*)*)?\]$)">;
 
@@ -393,6 +475,8 @@ static void bench_many_items(benchmark::State& state, auto&& parser)
 }
 BENCHMARK_CAPTURE(bench_many_items, parsi, parsi_parser)->RangeMultiplier(10)->Range(100, 10'000'000);
 BENCHMARK_CAPTURE(bench_many_items, parsi-c, parsi_c_parser)->RangeMultiplier(10)->Range(100, 10'000'000);
+BENCHMARK_CAPTURE(bench_many_items, parsi-c-threaded, parsi_c_threaded_parser)->RangeMultiplier(10)->Range(100, 10'000'000);
+BENCHMARK_CAPTURE(bench_many_items, parsi-c-jit, parsi_c_jit_parser)->RangeMultiplier(10)->Range(100, 10'000'000);
 BENCHMARK_CAPTURE(bench_many_items, ctre, ctre_parser)->RangeMultiplier(10)->Range(100, 10'000'000);
 
 BENCHMARK_MAIN();
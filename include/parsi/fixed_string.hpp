@@ -48,6 +48,10 @@ public:
 
     constexpr FixedString(const std::array<char_type, array_size>& arr) noexcept : _arr(arr), _size(strlen(_arr.data())) {}
 
+    /** holds the first `size` bytes of `arr`, null bytes included. */
+    constexpr FixedString(const std::array<char_type, array_size>& arr, std::size_t size) noexcept
+        : _arr(arr), _size(size < array_size ? size : array_size - 1) {}
+
     [[nodiscard]] constexpr static auto make(const char_type* arr, std::size_t size)  noexcept -> std::optional<FixedString>
     {
         if (size >= array_size) {
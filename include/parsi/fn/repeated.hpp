@@ -77,18 +77,13 @@ struct RepeatedRanged {
         std::size_t count = 0;
 
         while (const Result result = parser(stream)) {
-            if (count > max) [[unlikely]] {
-                break;
-            }
-
             stream = result.stream();
+            if (++count > max) [[unlikely]] {
+                return Result{stream, false};
+            }
         }
 
-        if (count < min || max < count) [[unlikely]] {
-            return Result{stream, false};
-        }
-
-        return Result{stream, true};
+        return Result{stream, min <= count};
     }
 };
 
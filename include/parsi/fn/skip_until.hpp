@@ -0,0 +1,73 @@
+#ifndef PARSI_FN_SKIP_UNTIL_HPP
+#define PARSI_FN_SKIP_UNTIL_HPP
+
+#include "parsi/base.hpp"
+#include "parsi/charset.hpp"
+#include "parsi/fixed_string.hpp"
+#include "parsi/internal/simd.hpp"
+
+namespace parsi::fn {
+
+/**
+ * A parser that skips the stream up to the first `delimiter`,
+ * leaving the delimiter in the stream.
+ *
+ * Skips the whole stream if there's no delimiter, and never fails.
+ */
+struct SkipUntilChar {
+    char delimiter;
+
+    [[nodiscard]] constexpr auto operator()(Stream stream) const noexcept -> Result
+    {
+        const char* found = internal::find_byte(delimiter, stream.data(), stream.data() + stream.size());
+        stream.advance(static_cast<std::size_t>(found - stream.data()));
+        return Result{stream, true};
+    }
+};
+
+/**
+ * A parser that skips the stream up to the first character in the `delimiters` charset,
+ * leaving the delimiter in the stream.
+ *
+ * Skips the whole stream if there's no delimiter, and never fails.
+ */
+struct SkipUntilCharset {
+    Charset skipped;
+    internal::NibbleTables tables;
+
+    constexpr explicit SkipUntilCharset(Charset delimiters) noexcept
+        : skipped(delimiters.opposite())
+        , tables(internal::make_nibble_tables(skipped))
+    {
+    }
+
+    [[nodiscard]] constexpr auto operator()(Stream stream) const noexcept -> Result
+    {
+        const char* found = internal::scan_charset(skipped, tables, stream.data(), stream.data() + stream.size());
+        stream.advance(static_cast<std::size_t>(found - stream.data()));
+        return Result{stream, true};
+    }
+};
+
+/**
+ * A parser that skips the stream up to the first occurrence of the `delimiter` string,
+ * leaving the delimiter in the stream.
+ *
+ * Skips the whole stream if there's no delimiter, and never fails.
+ */
+template <std::size_t SizeV, typename CharT = const char>
+struct SkipUntilFixedString {
+    FixedString<SizeV, CharT> delimiter;
+
+    [[nodiscard]] constexpr auto operator()(Stream stream) const noexcept -> Result
+    {
+        const char* found = internal::find_string(delimiter.as_string_view(), stream.data(),
+                                                  stream.data() + stream.size());
+        stream.advance(static_cast<std::size_t>(found - stream.data()));
+        return Result{stream, true};
+    }
+};
+
+}  // namespace parsi::fn
+
+#endif  // PARSI_FN_SKIP_UNTIL_HPP
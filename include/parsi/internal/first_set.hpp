@@ -0,0 +1,284 @@
+#ifndef PARSI_INTERNAL_FIRST_SET_HPP
+#define PARSI_INTERNAL_FIRST_SET_HPP
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+
+#include "parsi/base.hpp"
+#include "parsi/charset.hpp"
+#include "parsi/fn/anyof.hpp"
+#include "parsi/fn/eos.hpp"
+#include "parsi/fn/expect.hpp"
+#include "parsi/fn/extract.hpp"
+#include "parsi/fn/optional.hpp"
+#include "parsi/fn/repeated.hpp"
+#include "parsi/fn/sequence.hpp"
+#include "parsi/fn/skip_until.hpp"
+
+namespace parsi::internal {
+
+/**
+ * The bytes that a parser's match can start with,
+ * and whether it can match without consuming any (at the end of the stream included).
+ *
+ * A parser can't succeed on a stream that doesn't start with one of the `bytes` unless it's `nullable`.
+ */
+struct FirstSet {
+    Charset bytes;
+    bool nullable = false;
+
+    /** the first set of a parser that nothing is known about. */
+    [[nodiscard]] static constexpr auto any() noexcept -> FirstSet
+    {
+        return FirstSet{Charset().opposite(), true};
+    }
+
+    /** the first set of a parser that must match `bytes` followed by what `next` matches. */
+    [[nodiscard]] constexpr auto followed_by(const FirstSet& next) const noexcept -> FirstSet
+    {
+        if (!nullable) {
+            return *this;
+        }
+        return FirstSet{bytes + next.bytes, next.nullable};
+    }
+
+    /** the first set of a parser that matches either what this or `other` matches. */
+    [[nodiscard]] constexpr auto joined(const FirstSet& other) const noexcept -> FirstSet
+    {
+        return FirstSet{bytes + other.bytes, nullable || other.nullable};
+    }
+};
+
+template <std::size_t SizeV>
+[[nodiscard]] constexpr auto charset_of_ranges(const std::array<CharRange, SizeV>& ranges) noexcept -> Charset
+{
+    std::array<char, 256> members = {0};
+    std::size_t count = 0;
+    for (std::size_t byte = 0; byte < 256; ++byte) {
+        if (is_in_char_ranges(ranges, static_cast<char>(byte))) {
+            members[count++] = static_cast<char>(byte);
+        }
+    }
+    return Charset(std::string_view(members.data(), count));
+}
+
+/**
+ * The FIRST-set analysis of a parser type.
+ *
+ * `is_known` tells whether the analysis knows anything about the parser,
+ * and `first_set_of` gives the first set of one, which is `FirstSet::any()` if not known.
+ * Parsers other than the combinators of `parsi::fn` can describe themselves
+ * with a constexpr `first_set()` method that returns a `FirstSet`.
+ */
+template <typename ParserT>
+struct FirstSetTraits {
+    static constexpr bool is_known = requires(const ParserT& parser) {
+        { parser.first_set() } -> std::same_as<FirstSet>;
+    };
+
+    [[nodiscard]] static constexpr auto first_set_of(const ParserT& parser) noexcept -> FirstSet
+    {
+        if constexpr (is_known) {
+            return parser.first_set();
+        } else {
+            return FirstSet::any();
+        }
+    }
+};
+
+template <typename ParserT>
+[[nodiscard]] constexpr auto first_set_of(const ParserT& parser) noexcept -> FirstSet
+{
+    return FirstSetTraits<ParserT>::first_set_of(parser);
+}
+
+template <>
+struct FirstSetTraits<fn::Eos> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::Eos&) noexcept -> FirstSet
+    {
+        return FirstSet{Charset(), true};
+    }
+};
+
+template <fn::Negation NegationV>
+struct FirstSetTraits<fn::ExpectChar<NegationV>> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::ExpectChar<NegationV>& parser) noexcept -> FirstSet
+    {
+        const Charset expected(std::string_view(&parser.expected, 1));
+        return FirstSet{NegationV.negated ? expected.opposite() : expected, false};
+    }
+};
+
+template <>
+struct FirstSetTraits<fn::ExpectCharset> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::ExpectCharset& parser) noexcept -> FirstSet
+    {
+        return FirstSet{parser.charset, false};
+    }
+};
+
+template <std::size_t SizeV>
+struct FirstSetTraits<fn::ExpectCharRangeSet<SizeV>> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::ExpectCharRangeSet<SizeV>& parser) noexcept -> FirstSet
+    {
+        return FirstSet{charset_of_ranges(parser.charset_ranges), false};
+    }
+};
+
+template <std::size_t SizeV, typename CharT>
+struct FirstSetTraits<fn::ExpectFixedString<SizeV, CharT>> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::ExpectFixedString<SizeV, CharT>& parser) noexcept
+        -> FirstSet
+    {
+        const std::string_view expected = parser.expected.as_string_view();
+        if (expected.empty()) {
+            return FirstSet{Charset(), true};
+        }
+        return FirstSet{Charset(expected.substr(0, 1)), false};
+    }
+};
+
+template <>
+struct FirstSetTraits<fn::ExpectString> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::ExpectString& parser) noexcept -> FirstSet
+    {
+        if (parser.expected.empty()) {
+            return FirstSet{Charset(), true};
+        }
+        return FirstSet{Charset(std::string_view(parser.expected).substr(0, 1)), false};
+    }
+};
+
+template <>
+struct FirstSetTraits<fn::SkipUntilChar> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::SkipUntilChar&) noexcept -> FirstSet
+    {
+        return FirstSet::any();
+    }
+};
+
+template <>
+struct FirstSetTraits<fn::SkipUntilCharset> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::SkipUntilCharset&) noexcept -> FirstSet
+    {
+        return FirstSet::any();
+    }
+};
+
+template <std::size_t SizeV, typename CharT>
+struct FirstSetTraits<fn::SkipUntilFixedString<SizeV, CharT>> {
+    static constexpr bool is_known = true;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::SkipUntilFixedString<SizeV, CharT>&) noexcept
+        -> FirstSet
+    {
+        return FirstSet::any();
+    }
+};
+
+template <is_parser F, std::invocable<std::string_view> G>
+struct FirstSetTraits<fn::Extract<F, G>> {
+    static constexpr bool is_known = FirstSetTraits<F>::is_known;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::Extract<F, G>& parser) noexcept -> FirstSet
+    {
+        const FirstSet first_set = internal::first_set_of(parser.parser);
+        // the visitor would run on an empty match, even if the alternative fails later on.
+        if (first_set.nullable) {
+            return FirstSet::any();
+        }
+        return first_set;
+    }
+};
+
+template <is_parser F>
+struct FirstSetTraits<fn::Optional<F>> {
+    static constexpr bool is_known = FirstSetTraits<F>::is_known;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::Optional<F>& parser) noexcept -> FirstSet
+    {
+        return FirstSet{internal::first_set_of(parser.parser).bytes, true};
+    }
+};
+
+template <is_parser F, std::size_t Min, std::size_t Max>
+struct FirstSetTraits<fn::Repeated<F, Min, Max>> {
+    static constexpr bool is_known = FirstSetTraits<F>::is_known;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::Repeated<F, Min, Max>& parser) noexcept -> FirstSet
+    {
+        const FirstSet first_set = internal::first_set_of(parser.parser);
+        return FirstSet{first_set.bytes, first_set.nullable || Min == 0 || Max == 0};
+    }
+};
+
+template <is_parser F>
+struct FirstSetTraits<fn::RepeatedRanged<F>> {
+    static constexpr bool is_known = FirstSetTraits<F>::is_known;
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::RepeatedRanged<F>& parser) noexcept -> FirstSet
+    {
+        const FirstSet first_set = internal::first_set_of(parser.parser);
+        return FirstSet{first_set.bytes, first_set.nullable || parser.min == 0};
+    }
+};
+
+template <is_parser ...Fs>
+struct FirstSetTraits<fn::Sequence<Fs...>> {
+    static constexpr bool is_known = (true && ... && FirstSetTraits<Fs>::is_known);
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::Sequence<Fs...>& parser) noexcept -> FirstSet
+    {
+        return std::apply(
+            [](const auto& ...parsers) {
+                FirstSet first_set{Charset(), true};
+                ((first_set = first_set.followed_by(internal::first_set_of(parsers))), ...);
+                return first_set;
+            },
+            parser.parsers);
+    }
+};
+
+template <is_parser ...Fs>
+struct FirstSetTraits<fn::AnyOf<Fs...>> {
+    static constexpr bool is_known = (true && ... && FirstSetTraits<Fs>::is_known);
+
+    [[nodiscard]] static constexpr auto first_set_of(const fn::AnyOf<Fs...>& parser) noexcept -> FirstSet
+    {
+        if constexpr (sizeof...(Fs) == 0) {
+            // an empty anyof always succeeds.
+            return FirstSet{Charset(), true};
+        } else {
+            return std::apply(
+                [](const auto& ...parsers) {
+                    FirstSet first_set{Charset(), false};
+                    ((first_set = first_set.joined(internal::first_set_of(parsers))), ...);
+                    return first_set;
+                },
+                parser.parsers);
+        }
+    }
+};
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_INTERNAL_FIRST_SET_HPP
@@ -1,9 +1,21 @@
 #ifndef PARSI_INTERNAL_OPTIMIZER_HPP
 #define PARSI_INTERNAL_OPTIMIZER_HPP
 
+#include <array>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
 #include "parsi/base.hpp"
+#include "parsi/fixed_string.hpp"
+#include "parsi/fn/anyof.hpp"
 #include "parsi/fn/expect.hpp"
 #include "parsi/fn/repeated.hpp"
+#include "parsi/fn/sequence.hpp"
+#include "parsi/fn/skip_until.hpp"
+#include "parsi/internal/first_set.hpp"
+#include "parsi/internal/simd.hpp"
 
 namespace parsi::internal {
 
@@ -20,18 +32,27 @@ struct Optimizer<fn::Repeated<fn::ExpectChar<NegationV>, 0, std::numeric_limits<
 
         constexpr auto operator()(Stream stream) const noexcept -> Result
         {
-            while (stream.size() > 0 && stream.front() == expected) {
-                stream.advance(1);
-            }
-            return Result{stream, !NegationV.negated};
+            const char* run_end = scan_byte(expected, stream.data(), stream.data() + stream.size());
+            stream.advance(static_cast<std::size_t>(run_end - stream.data()));
+            return Result{stream, true};
         };
+
+        [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+        {
+            return FirstSet{Charset(std::string_view(&expected, 1)), true};
+        }
     };
 
     using parser_type = fn::Repeated<fn::ExpectChar<NegationV>, 0, std::numeric_limits<std::size_t>::max()>;
 
-    static constexpr auto optimize(const parser_type& parser) -> RepeatedZeroToInfCharacter
+    /** a run of anything but the character is a skip up to it. */
+    static constexpr auto optimize(const parser_type& parser)
     {
-        return RepeatedZeroToInfCharacter{parser.parser.expected};
+        if constexpr (NegationV.negated) {
+            return fn::SkipUntilChar{parser.parser.expected};
+        } else {
+            return RepeatedZeroToInfCharacter{parser.parser.expected};
+        }
     }
 };
 
@@ -42,18 +63,15 @@ struct Optimizer<fn::Repeated<fn::ExpectCharRangeSet<SetSizeV>, 0, std::numeric_
 
         constexpr auto operator()(Stream stream) const noexcept -> Result
         {
-            const auto is_in_range = [this](char chr) {
-                return [this, chr]<std::size_t ...Is>(std::index_sequence<Is...>) {
-                    return (false || ... || (charset_ranges[Is].begin <= chr && chr <= charset_ranges[Is].end));
-                }(std::make_index_sequence<SetSizeV>());
-            };
-
-            while (stream.size() > 0 && is_in_range(stream.front())) {
-                stream.advance(1);
-            }
-
+            const char* run_end = scan_char_ranges(charset_ranges, stream.data(), stream.data() + stream.size());
+            stream.advance(static_cast<std::size_t>(run_end - stream.data()));
             return Result{stream, true};
         };
+
+        [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+        {
+            return FirstSet{charset_of_ranges(charset_ranges), true};
+        }
     };
 
     using parser_type = fn::Repeated<fn::ExpectCharRangeSet<SetSizeV>, 0, std::numeric_limits<std::size_t>::max()>;
@@ -68,21 +86,746 @@ template <>
 struct Optimizer<fn::Repeated<fn::ExpectCharset, 0, std::numeric_limits<std::size_t>::max()>> {
     struct RepeatedZeroToInfCharset {
         Charset charset;
+        NibbleTables tables;
 
         constexpr auto operator()(Stream stream) const noexcept -> Result
         {
-            while (stream.size() > 0 && charset.contains(stream.front())) {
-                stream.advance(1);
-            }
+            const char* run_end = scan_charset(charset, tables, stream.data(), stream.data() + stream.size());
+            stream.advance(static_cast<std::size_t>(run_end - stream.data()));
             return Result{stream, true};
         };
+
+        [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+        {
+            return FirstSet{charset, true};
+        }
     };
 
     using parser_type = fn::Repeated<fn::ExpectCharset, 0, std::numeric_limits<std::size_t>::max()>;
 
     static constexpr auto optimize(const parser_type& parser) -> RepeatedZeroToInfCharset
     {
-        return RepeatedZeroToInfCharset{parser.parser.charset};
+        return RepeatedZeroToInfCharset{parser.parser.charset, make_nibble_tables(parser.parser.charset)};
+    }
+};
+
+/**
+ * The byte test and run scan of a parser that consumes exactly one byte on success,
+ * for the kernels of repetitions of such parsers.
+ */
+template <typename ParserT>
+struct SingleByteKernel;
+
+template <fn::Negation NegationV>
+struct SingleByteKernel<fn::ExpectChar<NegationV>> {
+    char expected;
+
+    constexpr explicit SingleByteKernel(const fn::ExpectChar<NegationV>& parser) noexcept
+        : expected(parser.expected)
+    {
+    }
+
+    [[nodiscard]] constexpr auto matches(char chr) const noexcept -> bool
+    {
+        return (chr == expected) != NegationV.negated;
+    }
+
+    [[nodiscard]] constexpr auto charset() const noexcept -> Charset
+    {
+        const Charset expected_charset(std::string_view(&expected, 1));
+        return NegationV.negated ? expected_charset.opposite() : expected_charset;
+    }
+
+    [[nodiscard]] constexpr auto scan(const char* begin, const char* end) const noexcept -> const char*
+    {
+        if constexpr (NegationV.negated) {
+            return find_byte(expected, begin, end);
+        } else {
+            return scan_byte(expected, begin, end);
+        }
+    }
+};
+
+template <>
+struct SingleByteKernel<fn::ExpectCharset> {
+    Charset accepted;
+    NibbleTables tables;
+
+    constexpr explicit SingleByteKernel(const fn::ExpectCharset& parser) noexcept
+        : accepted(parser.charset)
+        , tables(make_nibble_tables(parser.charset))
+    {
+    }
+
+    [[nodiscard]] constexpr auto matches(char chr) const noexcept -> bool
+    {
+        return accepted.contains(static_cast<std::uint8_t>(chr));
+    }
+
+    [[nodiscard]] constexpr auto scan(const char* begin, const char* end) const noexcept -> const char*
+    {
+        return scan_charset(accepted, tables, begin, end);
+    }
+
+    [[nodiscard]] constexpr auto charset() const noexcept -> Charset
+    {
+        return accepted;
+    }
+};
+
+template <std::size_t SetSizeV>
+struct SingleByteKernel<fn::ExpectCharRangeSet<SetSizeV>> {
+    std::array<CharRange, SetSizeV> charset_ranges;
+
+    constexpr explicit SingleByteKernel(const fn::ExpectCharRangeSet<SetSizeV>& parser) noexcept
+        : charset_ranges(parser.charset_ranges)
+    {
+    }
+
+    [[nodiscard]] constexpr auto matches(char chr) const noexcept -> bool
+    {
+        return is_in_char_ranges(charset_ranges, chr);
+    }
+
+    [[nodiscard]] constexpr auto scan(const char* begin, const char* end) const noexcept -> const char*
+    {
+        return scan_char_ranges(charset_ranges, begin, end);
+    }
+
+    [[nodiscard]] constexpr auto charset() const noexcept -> Charset
+    {
+        return charset_of_ranges(charset_ranges);
+    }
+};
+
+template <typename ParserT>
+concept has_single_byte_kernel = requires(const ParserT& parser) { SingleByteKernel<ParserT>(parser); };
+
+/**
+ * returns the end of the greedy run of at most `max + 1` matching bytes of `stream`
+ * past its first `min` bytes, which are already known to match.
+ * a run longer than `max` means the repetition failed, one byte past it is enough to know.
+ */
+template <typename KernelT>
+[[nodiscard]] constexpr auto scan_bounded_run(const KernelT& kernel, Stream stream, std::size_t min,
+                                              std::size_t max) noexcept -> const char*
+{
+    const std::size_t limit = max < stream.size() ? max + 1 : stream.size();
+    if (min == max) {
+        // only the one byte past the exact count is left to look at.
+        return stream.data() + min + (limit > min && kernel.matches(stream.data()[min]));
+    }
+    return kernel.scan(stream.data() + min, stream.data() + limit);
+}
+
+/**
+ * the failure of consecutive single-byte parsers whose byte at `index` didn't match,
+ * past that byte as the parser that failed on it consumes it, or at `index` if the stream ended there.
+ */
+[[nodiscard]] constexpr auto single_byte_failure(Stream stream, std::size_t index) noexcept -> Result
+{
+    return Result{stream.advanced(index < stream.size() ? index + 1 : index), false};
+}
+
+template <is_parser ParserT, std::size_t Min, std::size_t Max>
+    requires has_single_byte_kernel<ParserT>
+struct Optimizer<fn::Repeated<ParserT, Min, Max>> {
+    /** the largest minimum count checked byte by byte without a loop, rather than scanned. */
+    static constexpr std::size_t k_unrolled_min = 16;
+
+    struct RepeatedBoundedBytes {
+        SingleByteKernel<ParserT> kernel;
+
+        constexpr auto operator()(Stream stream) const noexcept -> Result
+        {
+            if constexpr (Max == 0) {
+                return Result{stream, true};
+            } else {
+                const char* begin = stream.data();
+                if constexpr (Min > 0) {
+                    bool min_matches = false;
+                    if (stream.size() >= Min) [[likely]] {
+                        if constexpr (Min <= k_unrolled_min) {
+                            min_matches = [&]<std::size_t ...Is>(std::index_sequence<Is...>) {
+                                return (true && ... && kernel.matches(begin[Is]));
+                            }(std::make_index_sequence<Min>());
+                        } else {
+                            min_matches = kernel.scan(begin, begin + Min) == begin + Min;
+                        }
+                    }
+                    if (!min_matches) [[unlikely]] {
+                        // fails where the repeated parser failed, as `fn::Repeated` does.
+                        const char* mismatch = kernel.scan(begin, begin + (Min < stream.size() ? Min : stream.size()));
+                        return single_byte_failure(stream, static_cast<std::size_t>(mismatch - begin));
+                    }
+                }
+
+                const char* run_end = scan_bounded_run(kernel, stream, Min, Max);
+                const auto count = static_cast<std::size_t>(run_end - begin);
+                stream.advance(count);
+                return Result{stream, count <= Max};
+            }
+        };
+
+        [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+        {
+            return FirstSet{kernel.charset(), Min == 0 || Max == 0};
+        }
+    };
+
+    using parser_type = fn::Repeated<ParserT, Min, Max>;
+
+    static constexpr auto optimize(const parser_type& parser) -> RepeatedBoundedBytes
+    {
+        return RepeatedBoundedBytes{SingleByteKernel<ParserT>(parser.parser)};
+    }
+};
+
+template <is_parser ParserT>
+    requires has_single_byte_kernel<ParserT>
+struct Optimizer<fn::RepeatedRanged<ParserT>> {
+    struct RepeatedRangedBytes {
+        SingleByteKernel<ParserT> kernel;
+        std::size_t min;
+        std::size_t max;
+
+        constexpr auto operator()(Stream stream) const noexcept -> Result
+        {
+            if (min > max) [[unlikely]] {
+                return Result{stream, false};
+            }
+
+            const char* begin = stream.data();
+            const char* min_end = kernel.scan(begin, begin + (min < stream.size() ? min : stream.size()));
+            if (min_end != begin + min) [[unlikely]] {
+                // fails past the matches, as `fn::RepeatedRanged` does.
+                return Result{stream.advanced(static_cast<std::size_t>(min_end - begin)), false};
+            }
+
+            const char* run_end = scan_bounded_run(kernel, stream, min, max);
+            const auto count = static_cast<std::size_t>(run_end - begin);
+            stream.advance(count);
+            return Result{stream, count <= max};
+        };
+
+        [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+        {
+            return FirstSet{kernel.charset(), min == 0};
+        }
+    };
+
+    using parser_type = fn::RepeatedRanged<ParserT>;
+
+    static constexpr auto optimize(const parser_type& parser) -> RepeatedRangedBytes
+    {
+        return RepeatedRangedBytes{SingleByteKernel<ParserT>(parser.parser), parser.min, parser.max};
+    }
+};
+
+/**
+ * A parser that expects the stream to start with `SizeV` bytes,
+ * each one in the charset at its position.
+ * adjacent single-byte charset parsers of a sequence are fused into it,
+ * and it fails where their sequence would, past the first byte that didn't match.
+ */
+template <std::size_t SizeV>
+struct FixedWidthCharsets {
+    std::array<Charset, SizeV> charsets;
+
+    constexpr auto operator()(Stream stream) const noexcept -> Result
+    {
+        const char* data = stream.data();
+        if (stream.size() >= SizeV) [[likely]] {
+            const bool is_valid = [&]<std::size_t ...Is>(std::index_sequence<Is...>) {
+                return (true & ... & charsets[Is].contains(static_cast<std::uint8_t>(data[Is])));
+            }(std::make_index_sequence<SizeV>());
+            if (is_valid) [[likely]] {
+                return Result{stream.advanced(SizeV), true};
+            }
+        }
+
+        std::size_t index = 0;
+        while (index < SizeV && index < stream.size() && charsets[index].contains(static_cast<std::uint8_t>(data[index]))) {
+            ++index;
+        }
+        return single_byte_failure(stream, index);
+    }
+
+    [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+    {
+        return FirstSet{charsets[0], false};
+    }
+};
+
+/**
+ * A parser that expects the stream to start with the `expected` bytes.
+ * adjacent chars and fixed strings of a sequence are fused into it,
+ * and it fails where their sequence would: past a char that didn't match,
+ * or at the start of a string that didn't.
+ */
+template <std::size_t CapacityV>
+struct FusedLiterals {
+    FixedString<CapacityV, const char> expected;
+    std::array<std::size_t, CapacityV> failure_offsets = {0};  // where it fails on a mismatch of each byte
+
+    constexpr auto operator()(Stream stream) const noexcept -> Result
+    {
+        const std::string_view bytes = expected.as_string_view();
+        const std::string_view input = stream.as_string_view();
+        if (input.starts_with(bytes)) [[likely]] {
+            return Result{stream.advanced(bytes.size()), true};
+        }
+
+        std::size_t index = 0;
+        while (index < input.size() && input[index] == bytes[index]) {
+            ++index;
+        }
+        std::size_t offset = failure_offsets[index];
+        if (index == input.size() && offset > index) {
+            // a char that the stream ended at isn't consumed.
+            offset = index;
+        }
+        return Result{stream.advanced(offset), false};
+    }
+
+    [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+    {
+        const std::string_view bytes = expected.as_string_view();
+        if (bytes.empty()) {
+            return FirstSet{Charset(), true};
+        }
+        return FirstSet{Charset(bytes.substr(0, 1)), false};
+    }
+};
+
+/**
+ * The bytes of a parser that expects a fixed string, their most count,
+ * and where it fails on a mismatch of each of them,
+ * for fusing adjacent ones of a sequence into one `FusedLiterals`.
+ */
+template <typename ParserT>
+struct LiteralTraits {
+    static constexpr bool is_literal = false;
+};
+
+template <>
+struct LiteralTraits<fn::ExpectChar<>> {
+    static constexpr bool is_literal = true;
+    static constexpr std::size_t capacity = 1;
+
+    [[nodiscard]] static constexpr auto bytes_of(const fn::ExpectChar<>& parser) noexcept -> std::string_view
+    {
+        return std::string_view(&parser.expected, 1);
+    }
+
+    [[nodiscard]] static constexpr auto failure_offset_of(const fn::ExpectChar<>&, std::size_t) noexcept
+        -> std::size_t
+    {
+        return 1;
+    }
+};
+
+template <std::size_t SizeV, typename CharT>
+struct LiteralTraits<fn::ExpectFixedString<SizeV, CharT>> {
+    static constexpr bool is_literal = true;
+    static constexpr std::size_t capacity = SizeV;
+
+    [[nodiscard]] static constexpr auto bytes_of(const fn::ExpectFixedString<SizeV, CharT>& parser) noexcept
+        -> std::string_view
+    {
+        return parser.expected.as_string_view();
+    }
+
+    [[nodiscard]] static constexpr auto failure_offset_of(const fn::ExpectFixedString<SizeV, CharT>&,
+                                                          std::size_t) noexcept -> std::size_t
+    {
+        return 0;
+    }
+};
+
+template <std::size_t CapacityV>
+struct LiteralTraits<FusedLiterals<CapacityV>> {
+    static constexpr bool is_literal = true;
+    static constexpr std::size_t capacity = CapacityV;
+
+    [[nodiscard]] static constexpr auto bytes_of(const FusedLiterals<CapacityV>& parser) noexcept -> std::string_view
+    {
+        return parser.expected.as_string_view();
+    }
+
+    [[nodiscard]] static constexpr auto failure_offset_of(const FusedLiterals<CapacityV>& parser,
+                                                          std::size_t index) noexcept -> std::size_t
+    {
+        return parser.failure_offsets[index];
+    }
+};
+
+/**
+ * The charsets of a parser that expects a fixed count of bytes by charsets,
+ * for fusing adjacent ones of a sequence into one `FixedWidthCharsets`.
+ */
+template <typename ParserT>
+struct CharsetsTraits {
+    static constexpr bool is_charsets = false;
+};
+
+template <>
+struct CharsetsTraits<fn::ExpectCharset> {
+    static constexpr bool is_charsets = true;
+    static constexpr std::size_t width = 1;
+
+    [[nodiscard]] static constexpr auto charsets_of(const fn::ExpectCharset& parser) noexcept -> std::array<Charset, 1>
+    {
+        return {parser.charset};
+    }
+};
+
+template <>
+struct CharsetsTraits<fn::ExpectChar<fn::Negation{.negated = true}>> {
+    static constexpr bool is_charsets = true;
+    static constexpr std::size_t width = 1;
+
+    [[nodiscard]] static constexpr auto charsets_of(const fn::ExpectChar<fn::Negation{.negated = true}>& parser) noexcept
+        -> std::array<Charset, 1>
+    {
+        return {Charset(std::string_view(&parser.expected, 1)).opposite()};
+    }
+};
+
+template <std::size_t SetSizeV>
+struct CharsetsTraits<fn::ExpectCharRangeSet<SetSizeV>> {
+    static constexpr bool is_charsets = true;
+    static constexpr std::size_t width = 1;
+
+    [[nodiscard]] static constexpr auto charsets_of(const fn::ExpectCharRangeSet<SetSizeV>& parser) noexcept
+        -> std::array<Charset, 1>
+    {
+        return {charset_of_ranges(parser.charset_ranges)};
+    }
+};
+
+template <std::size_t SizeV>
+struct CharsetsTraits<FixedWidthCharsets<SizeV>> {
+    static constexpr bool is_charsets = true;
+    static constexpr std::size_t width = SizeV;
+
+    [[nodiscard]] static constexpr auto charsets_of(const FixedWidthCharsets<SizeV>& parser) noexcept
+        -> std::array<Charset, SizeV>
+    {
+        return parser.charsets;
+    }
+};
+
+template <typename LhsT, typename RhsT>
+[[nodiscard]] constexpr auto fused_literals(const LhsT& lhs, const RhsT& rhs) noexcept
+{
+    constexpr std::size_t capacity = LiteralTraits<LhsT>::capacity + LiteralTraits<RhsT>::capacity;
+
+    const std::string_view lhs_bytes = LiteralTraits<LhsT>::bytes_of(lhs);
+    const std::string_view rhs_bytes = LiteralTraits<RhsT>::bytes_of(rhs);
+
+    std::array<char, capacity + 1> bytes = {0};
+    std::array<std::size_t, capacity> failure_offsets = {0};
+    for (std::size_t index = 0; index < lhs_bytes.size(); ++index) {
+        bytes[index] = lhs_bytes[index];
+        failure_offsets[index] = LiteralTraits<LhsT>::failure_offset_of(lhs, index);
+    }
+    for (std::size_t index = 0; index < rhs_bytes.size(); ++index) {
+        bytes[lhs_bytes.size() + index] = rhs_bytes[index];
+        failure_offsets[lhs_bytes.size() + index] = lhs_bytes.size()
+                                                  + LiteralTraits<RhsT>::failure_offset_of(rhs, index);
+    }
+    return FusedLiterals<capacity>{
+        FixedString<capacity, const char>(bytes, lhs_bytes.size() + rhs_bytes.size()), failure_offsets
+    };
+}
+
+template <typename LhsT, typename RhsT>
+[[nodiscard]] constexpr auto fused_charsets(const LhsT& lhs, const RhsT& rhs) noexcept
+{
+    constexpr std::size_t lhs_width = CharsetsTraits<LhsT>::width;
+    constexpr std::size_t rhs_width = CharsetsTraits<RhsT>::width;
+
+    const auto lhs_charsets = CharsetsTraits<LhsT>::charsets_of(lhs);
+    const auto rhs_charsets = CharsetsTraits<RhsT>::charsets_of(rhs);
+
+    FixedWidthCharsets<lhs_width + rhs_width> fused;
+    for (std::size_t index = 0; index < lhs_width; ++index) {
+        fused.charsets[index] = lhs_charsets[index];
+    }
+    for (std::size_t index = 0; index < rhs_width; ++index) {
+        fused.charsets[lhs_width + index] = rhs_charsets[index];
+    }
+    return fused;
+}
+
+template <typename ParserT>
+struct is_sequence : std::false_type {};
+
+template <typename ...Fs>
+struct is_sequence<fn::Sequence<Fs...>> : std::true_type {};
+
+/** the parsers of nested sequences spliced into a flat tuple, for fusing across their bounds. */
+template <typename ParserT>
+[[nodiscard]] constexpr auto flattened_sequence(const ParserT& parser) noexcept
+{
+    if constexpr (is_sequence<ParserT>::value) {
+        return std::apply(
+            [](const auto& ...parsers) { return std::tuple_cat(flattened_sequence(parsers)...); },
+            parser.parsers);
+    } else {
+        return std::tuple<ParserT>(parser);
+    }
+}
+
+/** appends the parser to the tuple of sequenced parsers, fusing it into the last one if they're alike. */
+template <typename ...Ts, typename ParserT>
+[[nodiscard]] constexpr auto fused_append(const std::tuple<Ts...>& parsers, const ParserT& parser) noexcept
+{
+    if constexpr (sizeof...(Ts) == 0) {
+        return std::tuple<ParserT>(parser);
+    } else {
+        using last_type = std::tuple_element_t<sizeof...(Ts) - 1, std::tuple<Ts...>>;
+        const auto& last = std::get<sizeof...(Ts) - 1>(parsers);
+        const auto leading = [&]<std::size_t ...Is>(std::index_sequence<Is...>) {
+            return std::tuple<std::tuple_element_t<Is, std::tuple<Ts...>>...>(std::get<Is>(parsers)...);
+        }(std::make_index_sequence<sizeof...(Ts) - 1>());
+
+        if constexpr (LiteralTraits<last_type>::is_literal && LiteralTraits<ParserT>::is_literal) {
+            return std::tuple_cat(leading, std::make_tuple(fused_literals(last, parser)));
+        } else if constexpr (CharsetsTraits<last_type>::is_charsets && CharsetsTraits<ParserT>::is_charsets) {
+            return std::tuple_cat(leading, std::make_tuple(fused_charsets(last, parser)));
+        } else {
+            return std::tuple_cat(parsers, std::tuple<ParserT>(parser));
+        }
+    }
+}
+
+template <is_parser ...Fs>
+struct Optimizer<fn::Sequence<Fs...>> {
+    using parser_type = fn::Sequence<Fs...>;
+
+    /**
+     * flattens nested sequences, and fuses the adjacent literals into one string compare
+     * and the adjacent single-byte charsets into one fixed-width check.
+     * a sequence fused into a single parser is that parser.
+     */
+    static constexpr auto optimize(const parser_type& parser)
+    {
+        const auto fused = std::apply(
+            [](const auto& ...parsers) {
+                std::tuple<> initial;
+                return fuse_all(initial, parsers...);
+            },
+            flattened_sequence(parser));
+
+        if constexpr (std::tuple_size_v<std::remove_cvref_t<decltype(fused)>> == 1) {
+            return std::get<0>(fused);
+        } else {
+            return std::apply(
+                []<typename ...Ts>(const Ts& ...parsers) { return fn::Sequence<Ts...>(parsers...); },
+                fused);
+        }
+    }
+
+private:
+    template <typename TupleT, typename ...Ts>
+    static constexpr auto fuse_all(const TupleT& parsers, const Ts& ...rest) noexcept
+    {
+        if constexpr (sizeof...(Ts) == 0) {
+            return parsers;
+        } else {
+            return [&]<typename HeadT, typename ...TailTs>(const HeadT& head, const TailTs& ...tail) {
+                return fuse_all(fused_append(parsers, head), tail...);
+            }(rest...);
+        }
+    }
+};
+
+template <std::size_t CountV>
+using alternatives_mask_t = std::conditional_t<
+    CountV <= 8, std::uint8_t,
+    std::conditional_t<CountV <= 16, std::uint16_t, std::conditional_t<CountV <= 32, std::uint32_t, std::uint64_t>>>;
+
+/**
+ * An ordered choice of `parsers` that only tries the alternatives that can match
+ * the first byte of the stream by their first sets, looked up in a table by the byte.
+ * the alternatives that nothing is known about, and the nullable ones, are tried on any byte.
+ * as `fn::AnyOf`, it fails with the failure of the last alternative.
+ */
+template <is_parser ...Fs>
+struct DispatchedAnyOf {
+    static_assert(sizeof...(Fs) > 0 && sizeof...(Fs) <= 64);
+
+    using mask_type = alternatives_mask_t<sizeof...(Fs)>;
+
+    std::tuple<Fs...> parsers;
+    std::array<mask_type, 256> viable_by_byte = {0};
+    mask_type viable_at_end = 0;
+
+    constexpr explicit DispatchedAnyOf(Fs... alternatives) noexcept
+        : parsers(std::move(alternatives)...)
+    {
+        [this]<std::size_t ...Is>(std::index_sequence<Is...>) {
+            (add_viable<Is>(first_set_of(std::get<Is>(parsers))), ...);
+        }(std::index_sequence_for<Fs...>());
+    }
+
+    constexpr auto operator()(Stream stream) const noexcept -> Result
+    {
+        const mask_type viable = stream.size() > 0
+                               ? viable_by_byte[static_cast<std::uint8_t>(stream.front())]
+                               : viable_at_end;
+        return parse_rec<0>(stream, viable);
+    }
+
+    [[nodiscard]] constexpr auto first_set() const noexcept -> FirstSet
+    {
+        return std::apply(
+            [](const auto& ...alternatives) {
+                FirstSet first_set{Charset(), false};
+                ((first_set = first_set.joined(first_set_of(alternatives))), ...);
+                return first_set;
+            },
+            parsers);
+    }
+
+private:
+    template <std::size_t I>
+    constexpr void add_viable(const FirstSet& first_set) noexcept
+    {
+        constexpr auto bit = static_cast<mask_type>(mask_type{1} << I);
+        for (std::size_t byte = 0; byte < 256; ++byte) {
+            if (first_set.nullable || first_set.bytes.contains(static_cast<std::uint8_t>(byte))) {
+                viable_by_byte[byte] |= bit;
+            }
+        }
+        if (first_set.nullable) {
+            viable_at_end |= bit;
+        }
+    }
+
+    template <std::size_t I>
+    [[nodiscard]] constexpr auto parse_rec(Stream stream, mask_type viable) const noexcept -> Result
+    {
+        if constexpr (I + 1 == sizeof...(Fs)) {
+            // the last alternative is tried anyway, to fail where `fn::AnyOf` would.
+            // one that can't match the first byte fails before any visitor of it runs.
+            return std::get<I>(parsers)(stream);
+        } else {
+            if (viable & (mask_type{1} << I)) {
+                const Result result = std::get<I>(parsers)(stream);
+                if (result) [[likely]] {
+                    return result;
+                }
+            }
+            return parse_rec<I + 1>(stream, viable);
+        }
+    }
+};
+
+template <typename ParserT>
+struct is_anyof : std::false_type {};
+
+template <typename ...Fs>
+struct is_anyof<fn::AnyOf<Fs...>> : std::bool_constant<(sizeof...(Fs) > 0)> {};
+
+template <typename ...Fs>
+struct is_anyof<DispatchedAnyOf<Fs...>> : std::true_type {};
+
+/** the alternatives of nested anyofs spliced into a flat tuple, an empty anyof (always succeeding) is kept. */
+template <typename ParserT>
+[[nodiscard]] constexpr auto flattened_anyof(const ParserT& parser) noexcept
+{
+    if constexpr (is_anyof<ParserT>::value) {
+        return std::apply(
+            [](const auto& ...parsers) { return std::tuple_cat(flattened_anyof(parsers)...); },
+            parser.parsers);
+    } else {
+        return std::tuple<ParserT>(parser);
+    }
+}
+
+/** whether the parser matches exactly one byte out of a charset (its first set). */
+template <typename ParserT>
+constexpr bool is_single_byte_charset = [] {
+    if constexpr (std::same_as<ParserT, fn::ExpectChar<>>) {
+        return true;
+    } else if constexpr (CharsetsTraits<ParserT>::is_charsets) {
+        return CharsetsTraits<ParserT>::width == 1;
+    } else {
+        return false;
+    }
+}();
+
+/** appends the alternative to the tuple of alternatives, merging it into the last one if both are single bytes. */
+template <typename ...Ts, typename ParserT>
+[[nodiscard]] constexpr auto merged_append(const std::tuple<Ts...>& parsers, const ParserT& parser) noexcept
+{
+    if constexpr (sizeof...(Ts) == 0) {
+        return std::tuple<ParserT>(parser);
+    } else {
+        using last_type = std::tuple_element_t<sizeof...(Ts) - 1, std::tuple<Ts...>>;
+        if constexpr (is_single_byte_charset<last_type> && is_single_byte_charset<ParserT>) {
+            const auto leading = [&]<std::size_t ...Is>(std::index_sequence<Is...>) {
+                return std::tuple<std::tuple_element_t<Is, std::tuple<Ts...>>...>(std::get<Is>(parsers)...);
+            }(std::make_index_sequence<sizeof...(Ts) - 1>());
+            const Charset merged = first_set_of(std::get<sizeof...(Ts) - 1>(parsers)).bytes
+                                 + first_set_of(parser).bytes;
+            return std::tuple_cat(leading, std::make_tuple(fn::ExpectCharset{merged}));
+        } else {
+            return std::tuple_cat(parsers, std::tuple<ParserT>(parser));
+        }
+    }
+}
+
+template <is_parser ...Fs>
+struct Optimizer<fn::AnyOf<Fs...>> {
+    using parser_type = fn::AnyOf<Fs...>;
+
+    /**
+     * flattens nested anyofs, and merges the adjacent single-byte alternatives into one charset.
+     * the alternatives are then dispatched by the first byte of the stream
+     * if the first sets of any of them are known.
+     * an anyof merged into a single parser is that parser.
+     */
+    static constexpr auto optimize(const parser_type& parser)
+    {
+        if constexpr (sizeof...(Fs) == 0) {
+            return parser;
+        } else {
+            const auto merged = std::apply(
+                [](const auto& ...parsers) {
+                    std::tuple<> initial;
+                    return merge_all(initial, parsers...);
+                },
+                flattened_anyof(parser));
+
+            return std::apply(
+                []<typename ...Ts>(const Ts& ...parsers) {
+                    if constexpr (sizeof...(Ts) == 1) {
+                        return (parsers, ...);
+                    } else if constexpr (sizeof...(Ts) <= 64 && (false || ... || FirstSetTraits<Ts>::is_known)) {
+                        return DispatchedAnyOf<Ts...>(parsers...);
+                    } else {
+                        return fn::AnyOf<Ts...>(parsers...);
+                    }
+                },
+                merged);
+        }
+    }
+
+private:
+    template <typename TupleT, typename ...Ts>
+    static constexpr auto merge_all(const TupleT& parsers, const Ts& ...rest) noexcept
+    {
+        if constexpr (sizeof...(Ts) == 0) {
+            return parsers;
+        } else {
+            return [&]<typename HeadT, typename ...TailTs>(const HeadT& head, const TailTs& ...tail) {
+                return merge_all(merged_append(parsers, head), tail...);
+            }(rest...);
+        }
     }
 };
 
@@ -0,0 +1,429 @@
+#ifndef PARSI_INTERNAL_SIMD_HPP
+#define PARSI_INTERNAL_SIMD_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "parsi/charset.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(PARSI_NO_SIMD)
+#define PARSI_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define PARSI_SIMD_X86 0
+#endif
+
+namespace parsi::internal {
+
+/**
+ * Nibble lookup tables of a charset for the vectorized charset scans:
+ * the low nibble of a byte selects a row of 8 bits (one per high nibble, 0-7 in `low_rows`
+ * and 8-15 in `high_rows`), and the high nibble selects the bit within the row.
+ */
+struct NibbleTables {
+    std::array<std::uint8_t, 16> low_rows = {0};
+    std::array<std::uint8_t, 16> high_rows = {0};
+};
+
+/**
+ * sets the bits of the bytes that `contains` in the 16 `low_rows` and 16 `high_rows` of nibble tables,
+ * for charsets stored in other forms than `Charset`.
+ */
+template <typename ContainsF>
+constexpr void fill_nibble_rows(ContainsF contains, std::uint8_t* low_rows, std::uint8_t* high_rows) noexcept
+{
+    for (std::size_t byte = 0; byte < 256; ++byte) {
+        if (contains(static_cast<std::uint8_t>(byte))) {
+            std::uint8_t* rows = byte < 128 ? low_rows : high_rows;
+            rows[byte & 0x0F] |= static_cast<std::uint8_t>(1u << ((byte >> 4) & 7));
+        }
+    }
+}
+
+[[nodiscard]] constexpr auto make_nibble_tables(const Charset& charset) noexcept -> NibbleTables
+{
+    NibbleTables tables;
+    fill_nibble_rows([&charset](std::uint8_t byte) { return charset.contains(byte); }, tables.low_rows.data(),
+                     tables.high_rows.data());
+    return tables;
+}
+
+template <std::size_t SizeV>
+[[nodiscard]] constexpr auto is_in_char_ranges(const std::array<CharRange, SizeV>& ranges, char chr) noexcept -> bool
+{
+    return [&]<std::size_t ...Is>(std::index_sequence<Is...>) {
+        return (false || ... || (ranges[Is].begin <= chr && chr <= ranges[Is].end));
+    }(std::make_index_sequence<SizeV>());
+}
+
+#if PARSI_SIMD_X86
+
+namespace simd {
+
+// the kernels classify 16/32 bytes at once, and leave the tail shorter than that to the scalar loops.
+// the avx2 ones are picked at runtime unless the translation unit is already built for avx2,
+// the charset ones need ssse3 (pshufb) and the char range ones only sse2, the x86-64 baseline.
+// the cpu is checked once, the compiled parsers of parsi-c run the same kernels.
+//
+// a pshufb lookup with the top bit of the index set yields zero, which picks the half of the nibble tables.
+// a char range check is an unsigned `chr - begin <= end - begin`, which is `begin <= chr && chr <= end`
+// for the signed chars of `CharRange` when `begin <= end`, empty ranges are masked out.
+// the literal search only compares the rest of the literal where both its first and last bytes match.
+
+[[nodiscard]] inline auto has_avx2() noexcept -> bool
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    static const bool k_supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return k_supported;
+#endif
+}
+
+[[nodiscard]] inline auto has_ssse3() noexcept -> bool
+{
+#if defined(__SSSE3__)
+    return true;
+#else
+    static const bool k_supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return k_supported;
+#endif
+}
+
+__attribute__((target("ssse3")))
+inline auto scan_charset_ssse3(const std::uint8_t* low_table, const std::uint8_t* high_table, const char* begin,
+                               const char* end) noexcept -> const char*
+{
+    const __m128i low_rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low_table));
+    const __m128i high_rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high_table));
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i index_mask = _mm_set1_epi8(static_cast<char>(0x8F));
+    const __m128i top_bit = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const __m128i index = _mm_and_si128(chunk, index_mask);
+        const __m128i row = _mm_or_si128(_mm_shuffle_epi8(low_rows, index),
+                                         _mm_shuffle_epi8(high_rows, _mm_xor_si128(index, top_bit)));
+        const __m128i bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble_mask));
+        const __m128i matched = _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+        const auto mismatches = ~static_cast<unsigned>(_mm_movemask_epi8(matched)) & 0xFFFF;
+        if (mismatches != 0) {
+            return begin + __builtin_ctz(mismatches);
+        }
+    }
+    return begin;
+}
+
+__attribute__((target("avx2")))
+inline auto scan_charset_avx2(const std::uint8_t* low_table, const std::uint8_t* high_table, const char* begin,
+                              const char* end) noexcept -> const char*
+{
+    const __m256i low_rows = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low_table)));
+    const __m256i high_rows = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(high_table)));
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i index_mask = _mm256_set1_epi8(static_cast<char>(0x8F));
+    const __m256i top_bit = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+
+    for (; end - begin >= 32; begin += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const __m256i index = _mm256_and_si256(chunk, index_mask);
+        const __m256i row = _mm256_or_si256(_mm256_shuffle_epi8(low_rows, index),
+                                            _mm256_shuffle_epi8(high_rows, _mm256_xor_si256(index, top_bit)));
+        const __m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask));
+        const __m256i matched = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+        const auto mismatches = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(matched));
+        if (mismatches != 0) {
+            _mm256_zeroupper();
+            return begin + __builtin_ctz(mismatches);
+        }
+    }
+    _mm256_zeroupper();
+    return scan_charset_ssse3(low_table, high_table, begin, end);
+}
+
+template <std::size_t SizeV>
+inline auto scan_char_ranges_sse2(const std::array<CharRange, SizeV>& ranges, const char* begin,
+                                  const char* end) noexcept -> const char*
+{
+    __m128i offsets[SizeV];
+    __m128i widths[SizeV];
+    __m128i enabled[SizeV];
+    for (std::size_t index = 0; index < SizeV; ++index) {
+        offsets[index] = _mm_set1_epi8(ranges[index].begin);
+        widths[index] = _mm_set1_epi8(static_cast<char>(ranges[index].end - ranges[index].begin));
+        enabled[index] = _mm_set1_epi8(ranges[index].begin <= ranges[index].end ? -1 : 0);
+    }
+
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        __m128i matched = _mm_setzero_si128();
+        for (std::size_t index = 0; index < SizeV; ++index) {
+            const __m128i offset = _mm_sub_epi8(chunk, offsets[index]);
+            const __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(offset, widths[index]), offset);
+            matched = _mm_or_si128(matched, _mm_and_si128(in_range, enabled[index]));
+        }
+        const auto mismatches = ~static_cast<unsigned>(_mm_movemask_epi8(matched)) & 0xFFFF;
+        if (mismatches != 0) {
+            return begin + __builtin_ctz(mismatches);
+        }
+    }
+    return begin;
+}
+
+template <std::size_t SizeV>
+__attribute__((target("avx2")))
+inline auto scan_char_ranges_avx2(const std::array<CharRange, SizeV>& ranges, const char* begin,
+                                  const char* end) noexcept -> const char*
+{
+    __m256i offsets[SizeV];
+    __m256i widths[SizeV];
+    __m256i enabled[SizeV];
+    for (std::size_t index = 0; index < SizeV; ++index) {
+        offsets[index] = _mm256_set1_epi8(ranges[index].begin);
+        widths[index] = _mm256_set1_epi8(static_cast<char>(ranges[index].end - ranges[index].begin));
+        enabled[index] = _mm256_set1_epi8(ranges[index].begin <= ranges[index].end ? -1 : 0);
+    }
+
+    for (; end - begin >= 32; begin += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i matched = _mm256_setzero_si256();
+        for (std::size_t index = 0; index < SizeV; ++index) {
+            const __m256i offset = _mm256_sub_epi8(chunk, offsets[index]);
+            const __m256i in_range = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, widths[index]), offset);
+            matched = _mm256_or_si256(matched, _mm256_and_si256(in_range, enabled[index]));
+        }
+        const auto mismatches = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(matched));
+        if (mismatches != 0) {
+            _mm256_zeroupper();
+            return begin + __builtin_ctz(mismatches);
+        }
+    }
+    _mm256_zeroupper();
+    return scan_char_ranges_sse2(ranges, begin, end);
+}
+
+inline auto scan_byte_sse2(char byte, const char* begin, const char* end) noexcept -> const char*
+{
+    const __m128i expected = _mm_set1_epi8(byte);
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const auto mismatches = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, expected))) & 0xFFFF;
+        if (mismatches != 0) {
+            return begin + __builtin_ctz(mismatches);
+        }
+    }
+    return begin;
+}
+
+__attribute__((target("avx2")))
+inline auto scan_byte_avx2(char byte, const char* begin, const char* end) noexcept -> const char*
+{
+    const __m256i expected = _mm256_set1_epi8(byte);
+    for (; end - begin >= 32; begin += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const auto mismatches = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, expected)));
+        if (mismatches != 0) {
+            _mm256_zeroupper();
+            return begin + __builtin_ctz(mismatches);
+        }
+    }
+    _mm256_zeroupper();
+    return scan_byte_sse2(byte, begin, end);
+}
+
+/** the first occurrence of `needle` (2 bytes or more) that starts in the whole chunks from `begin`, or their end. */
+inline auto find_string_sse2(std::string_view needle, const char* begin, const char* end) noexcept -> const char*
+{
+    const __m128i first = _mm_set1_epi8(needle.front());
+    const __m128i last = _mm_set1_epi8(needle.back());
+    const std::size_t last_offset = needle.size() - 1;
+
+    for (; end - begin >= static_cast<std::ptrdiff_t>(last_offset + 16); begin += 16) {
+        const __m128i firsts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const __m128i lasts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + last_offset));
+        auto candidates = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firsts, first), _mm_cmpeq_epi8(lasts, last))));
+        for (; candidates != 0; candidates &= candidates - 1) {
+            const char* candidate = begin + __builtin_ctz(candidates);
+            if (std::memcmp(candidate + 1, needle.data() + 1, last_offset - 1) == 0) {
+                return candidate;
+            }
+        }
+    }
+    return begin;
+}
+
+__attribute__((target("avx2")))
+inline auto find_string_avx2(std::string_view needle, const char* begin, const char* end) noexcept -> const char*
+{
+    const __m256i first = _mm256_set1_epi8(needle.front());
+    const __m256i last = _mm256_set1_epi8(needle.back());
+    const std::size_t last_offset = needle.size() - 1;
+
+    for (; end - begin >= static_cast<std::ptrdiff_t>(last_offset + 32); begin += 32) {
+        const __m256i firsts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const __m256i lasts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + last_offset));
+        auto candidates = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(firsts, first), _mm256_cmpeq_epi8(lasts, last))));
+        for (; candidates != 0; candidates &= candidates - 1) {
+            const char* candidate = begin + __builtin_ctz(candidates);
+            if (std::memcmp(candidate + 1, needle.data() + 1, last_offset - 1) == 0) {
+                _mm256_zeroupper();
+                return candidate;
+            }
+        }
+    }
+    _mm256_zeroupper();
+    return find_string_sse2(needle, begin, end);
+}
+
+}  // namespace simd
+
+#endif
+
+/**
+ * returns the end of the run of bytes that `contains` that starts at `begin`, up to `end`.
+ * `low_rows` and `high_rows` must be the nibble tables of the same bytes, see `fill_nibble_rows`.
+ */
+template <typename ContainsF>
+[[nodiscard]] constexpr auto scan_nibble_rows(ContainsF contains, const std::uint8_t* low_rows,
+                                              const std::uint8_t* high_rows, const char* begin,
+                                              const char* end) noexcept -> const char*
+{
+    // most runs are short, a mismatch right away needs no vector setup.
+    if (begin == end || !contains(static_cast<std::uint8_t>(*begin))) {
+        return begin;
+    }
+
+#if PARSI_SIMD_X86
+    if (!std::is_constant_evaluated() && end - begin >= 16) {
+        if (simd::has_avx2()) {
+            begin = simd::scan_charset_avx2(low_rows, high_rows, begin, end);
+        }
+        else if (simd::has_ssse3()) {
+            begin = simd::scan_charset_ssse3(low_rows, high_rows, begin, end);
+        }
+    }
+#else
+    (void)low_rows;
+    (void)high_rows;
+#endif
+
+    while (begin != end && contains(static_cast<std::uint8_t>(*begin))) {
+        ++begin;
+    }
+    return begin;
+}
+
+/**
+ * returns the end of the run of bytes in `charset` that starts at `begin`, up to `end`.
+ * `tables` must be the nibble tables of `charset`.
+ */
+[[nodiscard]] constexpr auto scan_charset(const Charset& charset, const NibbleTables& tables, const char* begin,
+                                          const char* end) noexcept -> const char*
+{
+    return scan_nibble_rows([&charset](std::uint8_t byte) { return charset.contains(byte); },
+                            tables.low_rows.data(), tables.high_rows.data(), begin, end);
+}
+
+/**
+ * returns the end of the run of bytes in one of the `ranges` that starts at `begin`, up to `end`.
+ */
+template <std::size_t SizeV>
+[[nodiscard]] constexpr auto scan_char_ranges(const std::array<CharRange, SizeV>& ranges, const char* begin,
+                                              const char* end) noexcept -> const char*
+{
+    if (begin == end || !is_in_char_ranges(ranges, *begin)) {
+        return begin;
+    }
+
+#if PARSI_SIMD_X86
+    if (!std::is_constant_evaluated() && end - begin >= 16) {
+        begin = simd::has_avx2() ? simd::scan_char_ranges_avx2(ranges, begin, end)
+                                 : simd::scan_char_ranges_sse2(ranges, begin, end);
+    }
+#endif
+
+    while (begin != end && is_in_char_ranges(ranges, *begin)) {
+        ++begin;
+    }
+    return begin;
+}
+
+/**
+ * returns the end of the run of `byte`s that starts at `begin`, up to `end`.
+ */
+[[nodiscard]] constexpr auto scan_byte(char byte, const char* begin, const char* end) noexcept -> const char*
+{
+    if (begin == end || *begin != byte) {
+        return begin;
+    }
+
+#if PARSI_SIMD_X86
+    if (!std::is_constant_evaluated() && end - begin >= 16) {
+        begin = simd::has_avx2() ? simd::scan_byte_avx2(byte, begin, end) : simd::scan_byte_sse2(byte, begin, end);
+    }
+#endif
+
+    while (begin != end && *begin == byte) {
+        ++begin;
+    }
+    return begin;
+}
+
+/**
+ * returns the first `byte` from `begin`, or `end` if there's none.
+ */
+[[nodiscard]] constexpr auto find_byte(char byte, const char* begin, const char* end) noexcept -> const char*
+{
+    if (!std::is_constant_evaluated()) {
+        const void* found = std::memchr(begin, byte, static_cast<std::size_t>(end - begin));
+        return found ? static_cast<const char*>(found) : end;
+    }
+
+    while (begin != end && *begin != byte) {
+        ++begin;
+    }
+    return begin;
+}
+
+/**
+ * returns the first occurrence of `needle` from `begin`, or `end` if there's none
+ * (a prefix of it cut off by `end` doesn't count).
+ */
+[[nodiscard]] constexpr auto find_string(std::string_view needle, const char* begin, const char* end) noexcept
+    -> const char*
+{
+    if (needle.size() <= 1) {
+        return needle.empty() ? begin : find_byte(needle.front(), begin, end);
+    }
+
+#if PARSI_SIMD_X86
+    if (!std::is_constant_evaluated()) {
+        begin = simd::has_avx2() ? simd::find_string_avx2(needle, begin, end)
+                                 : simd::find_string_sse2(needle, begin, end);
+    }
+#endif
+
+    const std::size_t found = std::string_view(begin, static_cast<std::size_t>(end - begin)).find(needle);
+    return found == std::string_view::npos ? end : begin + found;
+}
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_INTERNAL_SIMD_HPP
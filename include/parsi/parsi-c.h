@@ -22,9 +22,41 @@ typedef enum {
     parsi_parser_type_sequence,
     parsi_parser_type_anyof,
     parsi_parser_type_repeat,
-    parsi_parser_type_optional
+    parsi_parser_type_optional,
+    parsi_parser_type_capture,
+    parsi_parser_type_custom_ctx,   /* `custom` calling its `ctx_func`, see `parsi_custom_parser_ctx` */
+    parsi_parser_type_extract_ctx   /* `extract` calling its `ctx_func`, see `parsi_combine_extract_ctx` */
 } parsi_parser_type_enum;
 
+typedef enum {
+    parsi_compile_flag_none = 0,
+    /**
+     * dispatch instructions with direct threaded code (computed goto)
+     * instead of a central switch, falls back to switch where unsupported.
+     */
+    parsi_compile_flag_threaded_dispatch = 1 << 0,
+    /**
+     * translate the parser into native machine code (x86-64 only),
+     * falls back to the interpreter on other hosts or if executable memory isn't available.
+     */
+    parsi_compile_flag_jit = 1 << 1,
+    /**
+     * cache the results of shared and recursive subparsers per input position (packrat parsing),
+     * so backtracking over them doesn't re-parse, bounding the parse time to linear in the input
+     * as long as the memo table fits in its limit (see `parsi_set_memo_limit`).
+     * subparsers running callbacks (custom or extract) aren't cached, and it takes precedence over jit.
+     */
+    parsi_compile_flag_memoize = 1 << 2,
+    /**
+     * count the runs, successes and consumed bytes of every node, see `parsi_profile_get`.
+     * profiled parsers are interpreted and compiled without the passes that reshape the tree
+     * (see `parsi_compile`), while parsers compiled without it aren't instrumented at all.
+     */
+    parsi_compile_flag_profile = 1 << 3,
+    /** same as `parsi_compile_flag_profile`, counting cpu cycles (x86 timestamp counter) as well. */
+    parsi_compile_flag_profile_cycles = 1 << 4
+} parsi_compile_flags_enum;
+
 typedef struct {
     // 4 <= 256 / (8 * sizeof(size_t)), considering 64bit size_t
     size_t bitset[4];
@@ -42,9 +74,14 @@ typedef struct {
 
 struct parsi_parser;
 typedef struct parsi_compiled_parser parsi_compiled_parser_t;
+typedef struct parsi_stream_state parsi_stream_state_t;
+typedef struct parsi_arena parsi_arena_t;
 
 typedef parsi_result_t(*parsi_parser_fn_t)(void* context, parsi_stream_t stream);
 
+/** same as `parsi_parser_fn_t`, also given the `call_ctx` of the parse (see `parsi_parse_ctx`). */
+typedef parsi_result_t(*parsi_parser_ctx_fn_t)(void* context, void* call_ctx, parsi_stream_t stream);
+
 typedef void(*parsi_free_fn_t)(void* ptr);
 typedef void(*parsi_string_free_fn_t)(char* str, size_t size);
 typedef void(*parsi_parser_free_fn_t)(struct parsi_parser* parser);
@@ -52,11 +89,21 @@ typedef void(*parsi_parser_list_free_fn_t)(struct parsi_parser* parsers, size_t
 
 typedef bool(*parsi_extract_visitor_fn_t)(void* context, const char* str, size_t size);
 
+/** same as `parsi_extract_visitor_fn_t`, also given the `call_ctx` of the parse (see `parsi_parse_ctx`). */
+typedef bool(*parsi_extract_visitor_ctx_fn_t)(void* context, void* call_ctx, const char* str, size_t size);
+
+/**
+ * a node of a parser tree, the union member of its `type`.
+ * the `ctx_func` of the `_ctx` types takes the place of `func`, so they don't add to the size of a node.
+ */
 typedef struct parsi_parser {
     parsi_parser_type_enum type;
     union {
         struct {
-            parsi_parser_fn_t func;
+            union {
+                parsi_parser_fn_t func;
+                parsi_parser_ctx_fn_t ctx_func;  /* of a `parsi_parser_type_custom_ctx` */
+            };
             void* context;
             parsi_free_fn_t free_context_fn;
         } custom;
@@ -82,7 +129,10 @@ typedef struct parsi_parser {
 
         struct {
             struct parsi_parser* parser;
-            parsi_extract_visitor_fn_t func;
+            union {
+                parsi_extract_visitor_fn_t func;
+                parsi_extract_visitor_ctx_fn_t ctx_func;  /* of a `parsi_parser_type_extract_ctx` */
+            };
             void* context;
             parsi_free_fn_t free_context_fn;
             parsi_parser_free_fn_t free_parser_fn;
@@ -111,6 +161,12 @@ typedef struct parsi_parser {
             struct parsi_parser* parser;
             parsi_parser_free_fn_t free_parser_fn;
         } optional;
+
+        struct {
+            struct parsi_parser* parser;
+            size_t slot;
+            parsi_parser_free_fn_t free_parser_fn;
+        } capture;
     };
 } parsi_parser_t;
 
@@ -120,16 +176,332 @@ parsi_charset_t parsi_charset_n(const char* str, size_t size);
 parsi_parser_t* parsi_alloc_parser(parsi_parser_t parser);
 void parsi_free_parser(parsi_parser_t* parser);
 
+/**
+ * compile the given parser tree into a flat program.
+ * the tree (except callback contexts) isn't referenced after compilation.
+ * the same subparser referenced multiple times (or recursively by a pointer) is compiled once,
+ * and so are structurally identical subtrees, equal types, operands and callbacks all the way down.
+ * nested sequences and anyofs are flattened, adjacent literals of a sequence compared as one string
+ * and alternatives of a single byte merged into one charset, with the same results and failure positions.
+ * returns NULL on failure.
+ */
 parsi_compiled_parser_t* parsi_compile(parsi_parser_t* parser);
+
+/** same as `parsi_compile`, with a combination of `parsi_compile_flags_enum` flags. */
+parsi_compiled_parser_t* parsi_compile_ex(parsi_parser_t* parser, uint32_t flags);
 void parsi_free_compiled_parser(parsi_compiled_parser_t*);
 
+/**
+ * a compiled parser is immutable once compiled (or loaded) and configured,
+ * so it may be shared by any number of threads parsing at the same time.
+ * the profile and memo counters are updated atomically,
+ * while the `parsi_set_*` configuration must be done before sharing it.
+ * callbacks are called from the parsing thread, per-thread output should be
+ * passed through `parsi_parse_ctx` rather than kept in the callback contexts.
+ */
 parsi_result_t parsi_parse(parsi_compiled_parser_t* parser, parsi_stream_t stream);
 
+/**
+ * same as `parsi_parse`, with `call_ctx` handed to the `ctx_func` callbacks of the parser
+ * (see `parsi_custom_parser_ctx` and `parsi_combine_extract_ctx`) along with their own context.
+ * the other callbacks are called as usual, and `parsi_parse` passes NULL as `call_ctx`.
+ */
+parsi_result_t parsi_parse_ctx(parsi_compiled_parser_t* parser, parsi_stream_t stream, void* call_ctx);
+
+/**
+ * parses each of the `count` inputs with the same compiled parser,
+ * storing the result of `inputs[i]` into `outputs[i]`.
+ * cheaper than calling `parsi_parse` in a loop over many small inputs.
+ */
+void parsi_parse_many(parsi_compiled_parser_t* parser, const parsi_stream_t* inputs, parsi_result_t* outputs, size_t count);
+
+//-- parallel parsing
+
+/**
+ * called by `parsi_parse_parallel` with each record, its index among them and its result.
+ * returns false to stop, leaving the rest of the records unreported.
+ */
+typedef bool(*parsi_record_fn_t)(void* context, size_t index, parsi_stream_t record, parsi_result_t result);
+
+/**
+ * splits the input into records, each ending at (and without) any byte of `delimiters`,
+ * and parses them with the same compiled parser on `nthreads` threads (0 for one per cpu),
+ * the calling one included.
+ * the input is handed to the threads in chunks of many records, each split right after a delimiter,
+ * so the parser only ever sees whole records (e.g. lines of logs or of NDJSON).
+ * the callback is called from the calling thread, record by record in their input order,
+ * while the parser's own callbacks are called from any of the threads (see `parsi_parse`).
+ * an empty record after the last delimiter isn't reported.
+ * returns true once every record was reported, false if the callback stopped it or on allocation failure.
+ */
+bool parsi_parse_parallel(parsi_compiled_parser_t* parser, parsi_stream_t stream, parsi_charset_t delimiters,
+                          size_t nthreads, parsi_record_fn_t callback, void* context);
+
+//-- captures
+
+typedef struct {
+    size_t offset;  /* from the start of the input, SIZE_MAX if nothing was captured */
+    size_t length;
+} parsi_span_t;
+
+/**
+ * same as `parsi_parse`, also filling the first `nslots` of `slots` with the spans matched
+ * by the capture nodes of the parser (see `parsi_combine_capture`) by their slot,
+ * only the captures on the path of the successful parse count, with the last one of a slot kept
+ * (e.g. in a repeat), while those in alternatives that failed later on are dropped.
+ * the slots are left unset (`{SIZE_MAX, 0}`) on failure or if their capture didn't match.
+ * no callbacks are involved, the slots are filled in once the parse is done.
+ * extract visitors are called as in `parsi_parse`, and capturing parses are interpreted.
+ */
+parsi_result_t parsi_parse_captures(parsi_compiled_parser_t* parser, parsi_stream_t stream, parsi_span_t* slots,
+                                    size_t nslots);
+
+//-- parse stack
+
+/**
+ * limit how many combinators (sequences, anyofs, repeats, ...) may be pending at once,
+ * which bounds the memory a parse takes on deeply nested input.
+ * a parse reaching the limit fails, 0 (the default) means no limit.
+ * a left recursive parser tree, one that reaches a parser again before consuming any input,
+ * never returns from a parse without a limit (`parsi_compile_grammar` rejects such grammars).
+ * parsers with a limit are interpreted, the jit code nests on the native stack.
+ */
+void parsi_set_max_depth(parsi_compiled_parser_t* parser, size_t max_depth);
+
+/** bytes of stack buffer that each pending combinator takes, see `parsi_parse_with_stack`. */
+size_t parsi_stack_frame_size(void);
+
+/**
+ * same as `parsi_parse`, with the pending combinators kept in the caller's `buffer` of `size` bytes,
+ * which never allocates and limits the nesting to `size / parsi_stack_frame_size()` levels
+ * (or the max depth, if lower), failing the parse beyond it.
+ * without a buffer, parses start on the native stack and move to a block pooled per thread.
+ * always interpreted.
+ */
+parsi_result_t parsi_parse_with_stack(parsi_compiled_parser_t* parser, parsi_stream_t stream, void* buffer, size_t size);
+
+//-- streaming
+
+typedef enum {
+    parsi_stream_status_need_more = 0,  /* the result depends on input that isn't fed yet */
+    parsi_stream_status_valid,
+    parsi_stream_status_invalid
+} parsi_stream_status_enum;
+
+/**
+ * start parsing input that arrives in chunks, such as from a socket, with `call_ctx` as in `parsi_parse_ctx`.
+ * the parse is suspended wherever the input fed so far runs out and resumed by the next chunk
+ * from the same point, without going over the consumed bytes again.
+ * only the bytes that the parse may still go back to (for another alternative or an extract) are kept,
+ * which is the whole input only if something pending spans all of it.
+ * streaming parses are interpreted and not memoized, and custom parsers are run again with more input
+ * whenever their result reaches the end of the input fed so far.
+ * the parser must outlive the state, which belongs to one thread at a time.
+ * returns NULL on failure.
+ */
+parsi_stream_state_t* parsi_stream_begin(parsi_compiled_parser_t* parser, void* call_ctx);
+
+/**
+ * parse the next `chunk` of input, which isn't referenced after the call.
+ * returns `parsi_stream_status_need_more` until the result is known, and the result after that,
+ * ignoring any further chunks.
+ */
+parsi_stream_status_enum parsi_stream_feed(parsi_stream_state_t* state, parsi_stream_t chunk);
+
+/**
+ * finish the parse at the end of the input, and free the state.
+ * stores where the parse stopped (as with the stream of `parsi_parse`'s result) in `*position`
+ * if not NULL, as an offset from the start of the first chunk.
+ * returns either `parsi_stream_status_valid` or `parsi_stream_status_invalid`.
+ */
+parsi_stream_status_enum parsi_stream_end(parsi_stream_state_t* state, size_t* position);
+
+//-- serialization
+
+/**
+ * a custom (`parse_fn` or `parse_ctx_fn`) or extract (`visit_fn` or `visit_ctx_fn`) callback of a compiled parser,
+ * only the function of the callback's kind is set.
+ */
+typedef struct {
+    parsi_parser_fn_t parse_fn;
+    parsi_extract_visitor_fn_t visit_fn;
+    void* context;
+    parsi_parser_ctx_fn_t parse_ctx_fn;
+    parsi_extract_visitor_ctx_fn_t visit_ctx_fn;
+} parsi_callback_t;
+
+/** returns the name to save the callback under, NULL if it can't be saved. */
+typedef const char*(*parsi_callback_name_fn_t)(void* ctx, parsi_callback_t callback);
+
+/**
+ * fills `callback` (the function of the callback's kind and its context) for the given name,
+ * returns false if the name isn't known.
+ */
+typedef bool(*parsi_callback_bind_fn_t)(void* ctx, const char* name, parsi_callback_t* callback);
+
+/**
+ * save the compiled parser into `buffer` if it fits in `size` bytes (`buffer` may be NULL to measure),
+ * with its custom and extract callbacks saved by the name `name_fn` gives them.
+ * the data is only meant to be loaded on the same architecture by the same version of parsi.
+ * returns the number of bytes it takes, or 0 if a callback couldn't be named or the parser is profiled.
+ */
+size_t parsi_compiled_serialize(const parsi_compiled_parser_t* parser, parsi_callback_name_fn_t name_fn, void* name_ctx, void* buffer, size_t size);
+
+/**
+ * load a parser saved by `parsi_compiled_serialize`, with the callbacks bound by name through `bind_fn`,
+ * and prepared per the given `parsi_compile_flags_enum` flags.
+ * the program is copied in one piece and isn't validated beyond its header and size,
+ * so `data` must come from a trusted `parsi_compiled_serialize`.
+ * the data isn't referenced after loading.
+ * returns NULL if the data is truncated, from another format version, or has an unknown callback.
+ */
+parsi_compiled_parser_t* parsi_compiled_load(const void* data, size_t size, parsi_callback_bind_fn_t bind_fn, void* bind_ctx, uint32_t flags);
+
+/** same as `parsi_compiled_load`, from the file at `path` (memory mapped where supported). */
+parsi_compiled_parser_t* parsi_compiled_load_file(const char* path, parsi_callback_bind_fn_t bind_fn, void* bind_ctx, uint32_t flags);
+
+//-- grammar
+
+/**
+ * compile the grammar in the PEG `peg_text` (with a combination of `parsi_compile_flags_enum` flags),
+ * starting at its first rule:
+ *
+ *     grammar    <- rule+
+ *     rule       <- name '<-' expression
+ *     expression <- sequence ('/' sequence)*   (ordered choice)
+ *     sequence   <- item*
+ *     item       <- primary ('*' / '+' / '?' / '{' m '}' / '{' m ',' '}' / '{' m ',' n '}')*
+ *     primary    <- name ':' primary   (capture)
+ *                 / name               (rule)
+ *                 / '(' expression ')' / 'literal' / "literal" / [class] / [^class]
+ *                 / '.'                (any byte)
+ *                 / '!.'               (end of input)
+ *
+ * names are made of letters, digits, '_' and '-' (not starting with a digit or '-'),
+ * literals and classes take the `\n`, `\r`, `\t`, `\0` and `\xHH` escapes, or a backslash before any other byte,
+ * and '#' comments out the rest of the line.
+ * repetitions are those of `parsi_combine_repeat`, so `x{m,n}` fails on more than `n` of `x`.
+ * the visitor of a capture, and the custom parser of a name that isn't a rule,
+ * are bound by their name through `bind_fn` as with `parsi_compiled_load`.
+ * the whole grammar is compiled at once, each rule being emitted once however often it's referred to.
+ * left recursion isn't supported: a rule that may refer to itself again before consuming any input,
+ * directly (`a <- a 'x' / 'y'`) or through other rules (`a <- b`, `b <- a`), is rejected.
+ * returns NULL on a syntax error, a name that couldn't be bound or a left recursive rule,
+ * with the offset of the offending text (the definition of the rule for left recursion)
+ * in `*error_offset` if not NULL.
+ */
+parsi_compiled_parser_t* parsi_compile_grammar(const char* peg_text, parsi_callback_bind_fn_t bind_fn, void* bind_ctx,
+                                               uint32_t flags, size_t* error_offset);
+
+//-- code generation
+
+/**
+ * write C++ source that rebuilds the parser tree out of the header-only templates of `parsi/parsi.hpp`
+ * into `buffer` if it fits in `size` bytes (`buffer` may be NULL to measure),
+ * to be compiled ahead of time into a parser that needs neither the interpreter nor the jit.
+ * it exports `extern "C" parsi_result_t <symbol>(parsi_stream_t stream, void* context)`,
+ * which parses as `parsi_parse` does: the same validity and, on success, the same rest of the stream,
+ * though a failure may stop elsewhere, captures are only matched, and there's no depth limit.
+ * custom and extract callbacks are called by the name `name_fn` gives them, as functions declared
+ * `extern "C"` with the signature of `parsi_parser_fn_t` and `parsi_extract_visitor_fn_t`,
+ * passed the `context` of the generated function rather than their own.
+ * subparsers referred to more than once, recursively included, are generated once.
+ * inputs are limited to 4GiB by the templates.
+ * returns the size of the source with its terminating null byte, or 0 if the symbol or a callback's name
+ * isn't an identifier, a callback is named as the symbol, a string is null, or the tree has an unknown node.
+ */
+size_t parsi_generate_cpp(parsi_parser_t* parser, const char* symbol, parsi_callback_name_fn_t name_fn, void* name_ctx,
+                          char* buffer, size_t size);
+
+/**
+ * same as `parsi_generate_cpp`, for the grammar in the PEG `peg_text` (see `parsi_compile_grammar`),
+ * with its callbacks called by their names in the grammar.
+ * returns 0 on a syntax error or a left recursive rule, with the offset of the offending text
+ * in `*error_offset` if not NULL.
+ */
+size_t parsi_generate_cpp_grammar(const char* peg_text, const char* symbol, char* buffer, size_t size,
+                                  size_t* error_offset);
+
+//-- profiling
+
+typedef struct {
+    const struct parsi_parser* node;  /* only to identify the node, it may have been freed since compilation */
+    parsi_parser_type_enum type;
+    uint64_t invocations;
+    uint64_t successes;
+    uint64_t failures;
+    uint64_t consumed;  /* bytes consumed by the successful invocations */
+    uint64_t cycles;    /* including the node's descendants, zero unless profiling cycles */
+} parsi_profile_entry_t;
+
+/**
+ * copy the counters of up to `capacity` profiled nodes into `entries`,
+ * accumulated over all parses since compilation or the last reset.
+ * every distinct node of the compiled tree has one entry, identified by the first of the
+ * structurally identical nodes (which count together, see `parsi_compile`),
+ * in the order they were first reached from the root.
+ * returns the number of profiled nodes, 0 unless compiled with `parsi_compile_flag_profile`.
+ */
+size_t parsi_profile_get(const parsi_compiled_parser_t* parser, parsi_profile_entry_t* entries, size_t capacity);
+void parsi_profile_reset(parsi_compiled_parser_t* parser);
+
+//-- memoization
+
+typedef struct {
+    size_t lookups;
+    size_t hits;
+    size_t evictions; /* cached results overwritten by others, only once the table is over its limit */
+} parsi_memo_stats_t;
+
+/**
+ * set the upper bound in bytes of the memo table allocated per parse (16 MiB by default).
+ * inputs whose full table exceeds it use a lossy cache of that size instead,
+ * and a limit of 0 turns memoization off.
+ */
+void parsi_set_memo_limit(parsi_compiled_parser_t* parser, size_t max_bytes);
+
+/** memo table counters accumulated over all parses since compilation or the last reset. */
+parsi_memo_stats_t parsi_memo_stats(const parsi_compiled_parser_t* parser);
+void parsi_memo_stats_reset(parsi_compiled_parser_t* parser);
+
+//-- arena
+
+/**
+ * create an arena handing out parsers, parser lists and strings from a single block
+ * of `capacity` bytes, all of them freed at once with `parsi_arena_free`.
+ * the block never grows (pointers into it stay valid), allocations return NULL once it's full.
+ * parsers in an arena must not be freed with `parsi_free_parser`.
+ */
+parsi_arena_t* parsi_arena_create(size_t capacity);
+void parsi_arena_free(parsi_arena_t* arena);
+
+/** number of bytes handed out of the arena's block so far. */
+size_t parsi_arena_used(const parsi_arena_t* arena);
+
+parsi_parser_t* parsi_arena_parser(parsi_arena_t* arena, parsi_parser_t parser);
+
+/** copy `size` parsers followed by a none terminator, e.g. for `parsi_combine_sequence`. */
+parsi_parser_t* parsi_arena_parser_list(parsi_arena_t* arena, const parsi_parser_t* parsers, size_t size);
+
+char* parsi_arena_string(parsi_arena_t* arena, const char* str, size_t size);
+
+/**
+ * deep copy the parser tree into the arena, with every node, child list and owned string
+ * laid out in traversal order. shared and recursive subparsers stay shared.
+ * the copy owns nothing (free functions are cleared), callback contexts and static strings
+ * are referred to as they are. returns NULL if the arena is too small.
+ */
+parsi_parser_t* parsi_arena_copy(parsi_arena_t* arena, const parsi_parser_t* parser);
+
+/** number of bytes `parsi_arena_copy` needs for the given tree in an empty arena. */
+size_t parsi_arena_size_of(const parsi_parser_t* parser);
+
 //-- helpers
 
 /** create a null/none parser object, useful for none-terminated lists */
 parsi_parser_t parsi_none();
 parsi_parser_t parsi_custom_parser(parsi_parser_fn_t func, void* context, parsi_free_fn_t free_context_fn);
+parsi_parser_t parsi_custom_parser_ctx(parsi_parser_ctx_fn_t func, void* context, parsi_free_fn_t free_context_fn);
 parsi_parser_t parsi_expect_eos();
 parsi_parser_t parsi_expect_char(char chr);
 parsi_parser_t parsi_expect_charset(parsi_charset_t charset);
@@ -137,6 +509,7 @@ parsi_parser_t parsi_expect_charset_str(const char* charset_str);
 parsi_parser_t parsi_expect_string(char* str, size_t size, parsi_string_free_fn_t free_string_fn);
 parsi_parser_t parsi_expect_static_string(const char* str);
 parsi_parser_t parsi_combine_extract(parsi_parser_t* parser, parsi_extract_visitor_fn_t func, void* context, parsi_free_fn_t free_context_fn, parsi_parser_free_fn_t free_parser_fn);
+parsi_parser_t parsi_combine_extract_ctx(parsi_parser_t* parser, parsi_extract_visitor_ctx_fn_t func, void* context, parsi_free_fn_t free_context_fn, parsi_parser_free_fn_t free_parser_fn);
 parsi_parser_t parsi_combine_sequence(parsi_parser_t* parsers, parsi_parser_list_free_fn_t free_list_fn);
 parsi_parser_t parsi_combine_sequence_n(parsi_parser_t* parsers, size_t size, parsi_parser_list_free_fn_t free_list_fn);
 parsi_parser_t parsi_combine_anyof(parsi_parser_t* parsers, parsi_parser_list_free_fn_t free_list_fn);
@@ -144,6 +517,9 @@ parsi_parser_t parsi_combine_anyof_n(parsi_parser_t* parsers, size_t size, parsi
 parsi_parser_t parsi_combine_repeat(parsi_parser_t* parser, size_t min, size_t max, parsi_parser_free_fn_t free_parser_fn);
 parsi_parser_t parsi_combine_optional(parsi_parser_t* parser, parsi_parser_free_fn_t free_parser_fn);
 
+/** matches as `parser` does, capturing what it matched into `slot` with `parsi_parse_captures`. */
+parsi_parser_t parsi_combine_capture(parsi_parser_t* parser, size_t slot, parsi_parser_free_fn_t free_parser_fn);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
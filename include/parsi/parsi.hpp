@@ -12,6 +12,7 @@
 #include "parsi/fn/optional.hpp"
 #include "parsi/fn/repeated.hpp"
 #include "parsi/fn/sequence.hpp"
+#include "parsi/fn/skip_until.hpp"
 #include "parsi/internal/optimizer.hpp"
 
 namespace parsi {
@@ -96,6 +97,42 @@ template <std::same_as<CharRange> ...Ts>
     return fn::ExpectCharRangeSet<1 + sizeof...(Ts)>{.charset_ranges = {first, rest...}};
 }
 
+/**
+ * Creates a parser that skips the stream up to the first `delimiter` character,
+ * or to its end if there's none. It never fails.
+ *
+ * @see fn::SkipUntilChar
+ */
+[[nodiscard]] constexpr auto skip_until(char delimiter) noexcept -> fn::SkipUntilChar
+{
+    return fn::SkipUntilChar{delimiter};
+}
+
+/**
+ * Creates a parser that skips the stream up to the first character
+ * that is in the given `delimiters` charset, or to its end if there's none.
+ * It never fails.
+ *
+ * @see fn::SkipUntilCharset
+ */
+[[nodiscard]] constexpr auto skip_until(Charset delimiters) noexcept -> fn::SkipUntilCharset
+{
+    return fn::SkipUntilCharset(delimiters);
+}
+
+/**
+ * Creates a parser that skips the stream up to the first occurrence
+ * of the given fixed string, or to its end if there's none.
+ * It never fails.
+ *
+ * @see fn::SkipUntilFixedString
+ */
+template <std::size_t SizeV>
+[[nodiscard]] constexpr auto skip_until(const char (&str)[SizeV]) noexcept
+{
+    return fn::SkipUntilFixedString<SizeV, const char>{FixedString<SizeV, const char>::make(str, SizeV).value()};
+}
+
 /**
  * Creates an instance of fn::Sequence;
  * a combinator to combine multiple parsers
@@ -0,0 +1,284 @@
+#include "parsi/parsi-c.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+
+/**
+ * Header of the arena's block, the handed out memory follows it in the same allocation.
+ */
+struct alignas(std::max_align_t) parsi_arena {
+    std::size_t capacity;
+    std::size_t used;
+};
+
+namespace {
+
+[[nodiscard]] constexpr auto align_up(std::size_t offset, std::size_t alignment) noexcept -> std::size_t
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/** bump allocates from the arena, or only counts the bytes if there's no arena. */
+auto arena_allocate(parsi_arena_t* arena, std::size_t& used, std::size_t size, std::size_t alignment) noexcept
+    -> void*
+{
+    const std::size_t offset = align_up(used, alignment);
+    if (!arena) {
+        used = offset + size;
+        return nullptr;
+    }
+    if (offset > arena->capacity || size > arena->capacity - offset) {
+        return nullptr;
+    }
+    used = offset + size;
+    return reinterpret_cast<unsigned char*>(arena + 1) + offset;
+}
+
+/**
+ * Deep copies parser trees into an arena, in traversal order:
+ * a node is followed by its child list (if any) and then by its descendants.
+ * without an arena, it only measures the size the copy would take.
+ */
+class TreeCopier {
+public:
+    explicit TreeCopier(parsi_arena_t* arena) noexcept
+        : _arena(arena)
+        , _used(arena ? arena->used : 0)
+    {
+    }
+
+    [[nodiscard]] auto used() const noexcept -> std::size_t
+    {
+        return _used;
+    }
+
+    /** returns the copy of the (standalone) node, false on running out of memory. */
+    auto copy_node(const parsi_parser_t* src, parsi_parser_t*& dst) -> bool
+    {
+        dst = nullptr;
+        if (!src) {
+            return true;
+        }
+        if (auto iter = _nodes.find(src); iter != _nodes.end()) {
+            dst = iter->second;
+            return true;
+        }
+
+        dst = allocate<parsi_parser_t>(1);
+        if (_arena && !dst) {
+            return false;
+        }
+        _nodes.emplace(src, dst);
+        return fill(src, dst);
+    }
+
+private:
+    template <typename T>
+    auto allocate(std::size_t count) noexcept -> T*
+    {
+        return static_cast<T*>(arena_allocate(_arena, _used, count * sizeof(T), alignof(T)));
+    }
+
+    auto copy_list(const parsi_parser_t* src, std::size_t size, parsi_parser_t*& dst) -> bool
+    {
+        dst = nullptr;
+        if (!src) {
+            return true;
+        }
+        if (auto iter = _lists.find(src); iter != _lists.end()) {
+            dst = iter->second;
+            return true;
+        }
+
+        dst = allocate<parsi_parser_t>(size + 1);
+        if (_arena && !dst) {
+            return false;
+        }
+        _lists.emplace(src, dst);
+
+        // elements may be referred to by pointer as well (shared or recursive subparsers).
+        for (std::size_t index = 0; index < size; ++index) {
+            _nodes.emplace(&src[index], dst ? &dst[index] : nullptr);
+        }
+        for (std::size_t index = 0; index < size; ++index) {
+            if (!fill(&src[index], dst ? &dst[index] : nullptr)) {
+                return false;
+            }
+        }
+        if (dst) {
+            dst[size] = parsi_none();
+        }
+        return true;
+    }
+
+    auto copy_string(const char* src, std::size_t size, char*& dst) -> bool
+    {
+        dst = allocate<char>(size);
+        if (_arena && !dst && size > 0) {
+            return false;
+        }
+        if (dst && size > 0) {
+            std::memcpy(dst, src, size);
+        }
+        return true;
+    }
+
+    /** copies `src` into `dst` (if any), with its children copied into the arena. */
+    auto fill(const parsi_parser_t* src, parsi_parser_t* dst) -> bool
+    {
+        parsi_parser_t copy = *src;
+        bool copied = true;
+        switch (src->type) {
+            case parsi_parser_type_custom:
+            case parsi_parser_type_custom_ctx:
+                copy.custom.free_context_fn = nullptr;
+                break;
+
+            case parsi_parser_type_string:
+                copied = copy_string(src->expect_string.string, src->expect_string.size, copy.expect_string.string);
+                copy.expect_string.free_string_fn = nullptr;
+                break;
+
+            case parsi_parser_type_extract:
+            case parsi_parser_type_extract_ctx:
+                copied = copy_node(src->extract.parser, copy.extract.parser);
+                copy.extract.free_context_fn = nullptr;
+                copy.extract.free_parser_fn = nullptr;
+                break;
+
+            case parsi_parser_type_sequence:
+                copied = copy_list(src->sequence.parsers, src->sequence.size, copy.sequence.parsers);
+                copy.sequence.free_list_fn = nullptr;
+                break;
+
+            case parsi_parser_type_anyof:
+                copied = copy_list(src->anyof.parsers, src->anyof.size, copy.anyof.parsers);
+                copy.anyof.free_list_fn = nullptr;
+                break;
+
+            case parsi_parser_type_repeat:
+                copied = copy_node(src->repeat.parser, copy.repeat.parser);
+                copy.repeat.free_parser_fn = nullptr;
+                break;
+
+            case parsi_parser_type_optional:
+                copied = copy_node(src->optional.parser, copy.optional.parser);
+                copy.optional.free_parser_fn = nullptr;
+                break;
+
+            case parsi_parser_type_capture:
+                copied = copy_node(src->capture.parser, copy.capture.parser);
+                copy.capture.free_parser_fn = nullptr;
+                break;
+
+            default:
+                break;
+        }
+
+        if (dst) {
+            *dst = copy;
+        }
+        return copied;
+    }
+
+    parsi_arena_t* _arena;
+    std::size_t _used;
+    std::unordered_map<const parsi_parser_t*, parsi_parser_t*> _nodes;
+    std::unordered_map<const parsi_parser_t*, parsi_parser_t*> _lists;
+};
+
+}  // namespace
+
+parsi_arena_t* parsi_arena_create(size_t capacity)
+{
+    if (capacity > SIZE_MAX - sizeof(parsi_arena_t)) {
+        return NULL;
+    }
+    void* block = std::malloc(sizeof(parsi_arena_t) + capacity);
+    if (!block) {
+        return NULL;
+    }
+    return new (block) parsi_arena_t{ .capacity = capacity, .used = 0 };
+}
+
+void parsi_arena_free(parsi_arena_t* arena)
+{
+    std::free(arena);
+}
+
+size_t parsi_arena_used(const parsi_arena_t* arena)
+{
+    return arena->used;
+}
+
+parsi_parser_t* parsi_arena_parser(parsi_arena_t* arena, parsi_parser_t parser)
+{
+    auto parser_ptr = static_cast<parsi_parser_t*>(
+        arena_allocate(arena, arena->used, sizeof(parsi_parser_t), alignof(parsi_parser_t)));
+    if (!parser_ptr) {
+        return NULL;
+    }
+    *parser_ptr = parser;
+    return parser_ptr;
+}
+
+parsi_parser_t* parsi_arena_parser_list(parsi_arena_t* arena, const parsi_parser_t* parsers, size_t size)
+{
+    if (size > SIZE_MAX / sizeof(parsi_parser_t) - 1) {
+        return NULL;
+    }
+    auto list = static_cast<parsi_parser_t*>(
+        arena_allocate(arena, arena->used, (size + 1) * sizeof(parsi_parser_t), alignof(parsi_parser_t)));
+    if (!list) {
+        return NULL;
+    }
+    if (size > 0) {
+        std::memcpy(list, parsers, size * sizeof(parsi_parser_t));
+    }
+    list[size] = parsi_none();
+    return list;
+}
+
+char* parsi_arena_string(parsi_arena_t* arena, const char* str, size_t size)
+{
+    auto str_ptr = static_cast<char*>(arena_allocate(arena, arena->used, size, 1));
+    if (!str_ptr) {
+        return NULL;
+    }
+    if (size > 0) {
+        std::memcpy(str_ptr, str, size);
+    }
+    return str_ptr;
+}
+
+parsi_parser_t* parsi_arena_copy(parsi_arena_t* arena, const parsi_parser_t* parser)
+{
+    try {
+        TreeCopier copier(arena);
+        parsi_parser_t* copy = nullptr;
+        if (!parser || !copier.copy_node(parser, copy)) {
+            return NULL;
+        }
+        arena->used = copier.used();
+        return copy;
+    }
+    catch (const std::bad_alloc&) {
+        return NULL;
+    }
+}
+
+size_t parsi_arena_size_of(const parsi_parser_t* parser)
+{
+    try {
+        TreeCopier copier(nullptr);
+        parsi_parser_t* copy = nullptr;
+        copier.copy_node(parser, copy);
+        return copier.used();
+    }
+    catch (const std::bad_alloc&) {
+        return SIZE_MAX;
+    }
+}
@@ -0,0 +1,470 @@
+#include "codegen.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <new>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace parsi::internal {
+
+namespace {
+
+/** a parser that never matches, for the nodes that always fail. */
+constexpr std::string_view k_fail = "parsi::expect(parsi::Charset())";
+
+[[nodiscard]] auto is_identifier(std::string_view name) noexcept -> bool
+{
+    const auto is_word = [](char chr) {
+        return chr == '_' || ('a' <= chr && chr <= 'z') || ('A' <= chr && chr <= 'Z') || ('0' <= chr && chr <= '9');
+    };
+    return !name.empty() && !('0' <= name[0] && name[0] <= '9') && std::ranges::all_of(name, is_word);
+}
+
+/** appends the bytes as the inside of a C++ literal, with octal escapes for those that aren't printable. */
+void append_escaped(std::string& out, std::string_view bytes)
+{
+    for (const char chr : bytes) {
+        const auto byte = static_cast<unsigned char>(chr);
+        if (chr == '\\' || chr == '\'' || chr == '"') {
+            out += '\\';
+            out += chr;
+        }
+        else if (0x20 <= byte && byte < 0x7F) {
+            out += chr;
+        }
+        else {
+            out += '\\';
+            out += static_cast<char>('0' + (byte >> 6));
+            out += static_cast<char>('0' + ((byte >> 3) & 7));
+            out += static_cast<char>('0' + (byte & 7));
+        }
+    }
+}
+
+void append_size(std::string& out, std::size_t size)
+{
+    if (size == std::numeric_limits<std::size_t>::max()) {
+        out += "SIZE_MAX";
+        return;
+    }
+    out += std::to_string(size);
+    if (size > static_cast<std::size_t>(std::numeric_limits<std::int64_t>::max())) {
+        out += 'u';
+    }
+}
+
+/**
+ * Writes a parser tree as nested template calls.
+ *
+ * Each node referred to more than once (rules, shared and recursive subparsers) becomes
+ * an empty struct of its own, whose call operator is defined after all of them are declared,
+ * so they can refer to each other (and themselves) while the templates hold them by value.
+ */
+class CppGenerator {
+    enum class CallbackKind {
+        custom,
+        visit,
+    };
+
+public:
+    CppGenerator(parsi_callback_name_fn_t name_fn, void* name_ctx) noexcept
+        : _name_fn(name_fn)
+        , _name_ctx(name_ctx)
+    {
+    }
+
+    auto generate(const parsi_parser_t* root, std::string_view symbol, std::string& source) -> bool
+    {
+        if (!is_identifier(symbol)) {
+            return false;
+        }
+
+        _rules.push_back(root);
+        _rule_ids.emplace(root, 0);
+        count_references(root);
+
+        std::vector<std::string> definitions(_rules.size());
+        for (std::size_t index = 0; index < _rules.size(); ++index) {
+            if (!append_expression(_rules[index], definitions[index], true)) {
+                return false;
+            }
+        }
+        // the callbacks are declared next to the entry point.
+        if (_callbacks.contains(std::string(symbol))) {
+            return false;
+        }
+
+        source += "// generated by parsi_generate_cpp, rebuilding a parser out of the templates of parsi/parsi.hpp.\n\n";
+        source += "#include <cstdint>\n#include <string_view>\n#include <utility>\n\n";
+        source += "#include <parsi/parsi-c.h>\n#include <parsi/parsi.hpp>\n\n";
+
+        for (const auto& [name, kind] : _callbacks) {
+            source += kind == CallbackKind::custom ? "extern \"C\" parsi_result_t " : "extern \"C\" bool ";
+            source += name;
+            source += kind == CallbackKind::custom ? "(void* context, parsi_stream_t stream);\n"
+                                                   : "(void* context, const char* str, size_t size);\n";
+        }
+        if (!_callbacks.empty()) {
+            source += '\n';
+        }
+
+        source += "namespace {\n\n";
+        source += "// the context of the running parse, handed to the callbacks.\n";
+        source += "thread_local void* t_context = nullptr;\n\n";
+        if (_uses_no_match) {
+            source += "// succeeds without consuming anything where the parser fails, fails where it succeeds.\n";
+            source += "template <parsi::is_parser F>\n";
+            source += "struct NoMatch {\n";
+            source += "    F parser;\n\n";
+            source += "    [[nodiscard]] constexpr auto operator()(parsi::Stream stream) const noexcept -> parsi::Result\n";
+            source += "    {\n";
+            source += "        return parsi::Result{stream, !parser(stream)};\n";
+            source += "    }\n";
+            source += "};\n\n";
+            source += "template <parsi::is_parser F>\n";
+            source += "[[nodiscard]] constexpr auto no_match(F parser) noexcept -> NoMatch<F>\n";
+            source += "{\n";
+            source += "    return NoMatch<F>{parser};\n";
+            source += "}\n\n";
+        }
+
+        for (const auto& [name, kind] : _callbacks) {
+            if (kind == CallbackKind::custom) {
+                source += "struct Custom_" + name + " {\n";
+                source += "    [[nodiscard]] auto operator()(parsi::Stream stream) const noexcept -> parsi::Result\n";
+                source += "    {\n";
+                source += "        const parsi_result_t result = " + name
+                        + "(t_context, parsi_stream_t{ .cursor = stream.data(), .size = stream.size() });\n";
+                source += "        return parsi::Result{parsi::Stream(result.stream.cursor, result.stream.size), "
+                          "result.is_valid};\n";
+                source += "    }\n";
+                source += "};\n\n";
+            }
+            else {
+                source += "struct Visit_" + name + " {\n";
+                source += "    [[nodiscard]] auto operator()(std::string_view str) const noexcept -> bool\n";
+                source += "    {\n";
+                source += "        return " + name + "(t_context, str.data(), str.size());\n";
+                source += "    }\n";
+                source += "};\n\n";
+            }
+        }
+
+        for (std::size_t index = 0; index < _rules.size(); ++index) {
+            source += "struct Rule" + std::to_string(index) + " {\n";
+            source += "    [[nodiscard]] auto operator()(parsi::Stream stream) const noexcept -> parsi::Result;\n";
+            source += "};\n\n";
+        }
+        for (std::size_t index = 0; index < _rules.size(); ++index) {
+            source += "auto Rule" + std::to_string(index) + "::operator()(parsi::Stream stream) const noexcept -> parsi::Result\n";
+            source += "{\n";
+            source += "    static constexpr auto parser = " + definitions[index] + ";\n";
+            source += "    return parser(stream);\n";
+            source += "}\n\n";
+        }
+        source += "}  // namespace\n\n";
+
+        source += "extern \"C\" parsi_result_t " + std::string(symbol) + "(parsi_stream_t stream, void* context)\n";
+        source += "{\n";
+        source += "    void* const outer_context = std::exchange(t_context, context);\n";
+        source += "    const parsi::Result result = Rule0{}(parsi::Stream(stream.cursor, stream.size));\n";
+        source += "    t_context = outer_context;\n";
+        source += "    return parsi_result_t{\n";
+        source += "        .is_valid = result.is_valid(),\n";
+        source += "        .stream = { .cursor = result.cursor(), .size = static_cast<size_t>(stream.cursor + stream.size - "
+                  "result.cursor()) },\n";
+        source += "    };\n";
+        source += "}\n";
+        return true;
+    }
+
+private:
+    /** gives a struct to the nodes reached more than once, in the order they're first reached. */
+    void count_references(const parsi_parser_t* root)
+    {
+        std::unordered_map<const parsi_parser_t*, std::size_t> references;
+        std::vector<const parsi_parser_t*> pending{ root };
+        const auto refer = [&](const parsi_parser_t* child) {
+            if (!child) {
+                return;
+            }
+            if (++references[child] == 1) {
+                pending.push_back(child);
+            }
+            else if (_rule_ids.emplace(child, _rules.size()).second) {
+                _rules.push_back(child);
+            }
+        };
+        const auto refer_list = [&](const parsi_parser_t* parsers, std::size_t size) {
+            for (std::size_t index = parsers ? size : 0; index-- > 0;) {
+                refer(&parsers[index]);
+            }
+        };
+
+        references[root] = 1;
+        while (!pending.empty()) {
+            const parsi_parser_t* parser = pending.back();
+            pending.pop_back();
+            switch (parser->type) {
+                case parsi_parser_type_extract:
+                case parsi_parser_type_extract_ctx:
+                    refer(parser->extract.parser);
+                    break;
+                case parsi_parser_type_sequence:
+                    refer_list(parser->sequence.parsers, parser->sequence.size);
+                    break;
+                case parsi_parser_type_anyof:
+                    refer_list(parser->anyof.parsers, parser->anyof.size);
+                    break;
+                case parsi_parser_type_repeat:
+                    refer(parser->repeat.parser);
+                    break;
+                case parsi_parser_type_optional:
+                    refer(parser->optional.parser);
+                    break;
+                case parsi_parser_type_capture:
+                    refer(parser->capture.parser);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    /** names the callback, declared once per name and kind. */
+    auto callback_name_of(const parsi_callback_t& callback, CallbackKind kind, std::string& name) -> bool
+    {
+        const char* callback_name = _name_fn ? _name_fn(_name_ctx, callback) : nullptr;
+        if (!callback_name || !is_identifier(callback_name)) {
+            return false;
+        }
+        name = callback_name;
+        const auto [iter, inserted] = _callbacks.emplace(name, kind);
+        return inserted || iter->second == kind;
+    }
+
+    auto append_list(std::string_view combinator, const parsi_parser_t* parsers, std::size_t size, std::string& out)
+        -> bool
+    {
+        out += combinator;
+        out += '(';
+        for (std::size_t index = 0; index < size; ++index) {
+            if (index > 0) {
+                out += ", ";
+            }
+            if (!append_expression(&parsers[index], out)) {
+                return false;
+            }
+        }
+        out += ')';
+        return true;
+    }
+
+    void append_literal(std::string_view literal, std::string& out)
+    {
+        if (literal.empty()) {
+            out += "parsi::sequence()";
+        }
+        else if (literal.size() == 1) {
+            out += "parsi::expect('";
+            append_escaped(out, literal);
+            out += "')";
+        }
+        else if (literal.find('\0') == std::string_view::npos) {
+            out += "parsi::expect(\"";
+            append_escaped(out, literal);
+            out += "\")";
+        }
+        else {
+            // fixed strings end at their first null byte.
+            out += "parsi::sequence(";
+            for (std::size_t index = 0; index < literal.size(); ++index) {
+                out += index > 0 ? ", parsi::expect('" : "parsi::expect('";
+                append_escaped(out, literal.substr(index, 1));
+                out += "')";
+            }
+            out += ')';
+        }
+    }
+
+    /** appends the parser as an expression, or as a reference to its struct unless it's the one being defined. */
+    auto append_expression(const parsi_parser_t* parser, std::string& out, bool definition = false) -> bool
+    {
+        if (!parser) {
+            out += k_fail;
+            return true;
+        }
+        if (auto iter = _rule_ids.find(parser); !definition && iter != _rule_ids.end()) {
+            out += "Rule" + std::to_string(iter->second) + "{}";
+            return true;
+        }
+
+        switch (parser->type) {
+            case parsi_parser_type_none:
+                out += k_fail;
+                return true;
+
+            case parsi_parser_type_custom:
+            case parsi_parser_type_custom_ctx: {
+                const bool with_ctx = parser->type == parsi_parser_type_custom_ctx;
+                std::string name;
+                parsi_callback_t callback{};
+                callback.parse_fn = with_ctx ? nullptr : parser->custom.func;
+                callback.context = parser->custom.context;
+                callback.parse_ctx_fn = with_ctx ? parser->custom.ctx_func : nullptr;
+                if (!callback_name_of(callback, CallbackKind::custom, name)) {
+                    return false;
+                }
+                out += "Custom_" + name + "{}";
+                return true;
+            }
+
+            case parsi_parser_type_eos:
+                out += "parsi::eos()";
+                return true;
+
+            case parsi_parser_type_char:
+                append_literal(std::string_view(&parser->expect_char.expected, 1), out);
+                return true;
+
+            case parsi_parser_type_charset: {
+                constexpr std::size_t cell_bits = 8 * sizeof(parser->expect_charset.expected.bitset[0]);
+                std::string members;
+                std::string others;
+                for (std::size_t chr = 0; chr < 256; ++chr) {
+                    const bool member = (parser->expect_charset.expected.bitset[chr / cell_bits] >> (chr % cell_bits)) & 1;
+                    (member ? members : others) += static_cast<char>(chr);
+                }
+                if (members.size() == 1) {
+                    append_literal(members, out);
+                    return true;
+                }
+                // the shorter of the two to spell out.
+                const bool negated = others.size() < members.size();
+                out += negated ? "parsi::expect_not(parsi::Charset(\"" : "parsi::expect(parsi::Charset(\"";
+                append_escaped(out, negated ? others : members);
+                out += "\", " + std::to_string(negated ? others.size() : members.size()) + "))";
+                return true;
+            }
+
+            case parsi_parser_type_string:
+            case parsi_parser_type_static_string: {
+                const char* str = parser->type == parsi_parser_type_string ? parser->expect_string.string
+                                                                           : parser->expect_static_string.string;
+                const std::size_t size = parser->type == parsi_parser_type_string ? parser->expect_string.size
+                                                                                  : parser->expect_static_string.size;
+                if (size > 0 && !str) {
+                    return false;
+                }
+                append_literal(std::string_view(str, size), out);
+                return true;
+            }
+
+            case parsi_parser_type_extract:
+            case parsi_parser_type_extract_ctx: {
+                const bool with_ctx = parser->type == parsi_parser_type_extract_ctx;
+                std::string name;
+                parsi_callback_t callback{};
+                callback.visit_fn = with_ctx ? nullptr : parser->extract.func;
+                callback.context = parser->extract.context;
+                callback.visit_ctx_fn = with_ctx ? parser->extract.ctx_func : nullptr;
+                if (!callback_name_of(callback, CallbackKind::visit, name)) {
+                    return false;
+                }
+                out += "parsi::extract(";
+                if (!append_expression(parser->extract.parser, out)) {
+                    return false;
+                }
+                out += ", Visit_" + name + "{})";
+                return true;
+            }
+
+            case parsi_parser_type_sequence:
+                if (parser->sequence.parsers && parser->sequence.size == 1) {
+                    return append_expression(parser->sequence.parsers, out);
+                }
+                return append_list("parsi::sequence", parser->sequence.parsers,
+                                   parser->sequence.parsers ? parser->sequence.size : 0, out);
+
+            case parsi_parser_type_anyof:
+                if (!parser->anyof.parsers) {
+                    // a null list always succeeds, same as an empty sequence.
+                    out += "parsi::sequence()";
+                    return true;
+                }
+                if (parser->anyof.size == 0) {
+                    // unlike the template's, an empty anyof fails.
+                    out += k_fail;
+                    return true;
+                }
+                return append_list("parsi::anyof", parser->anyof.parsers, parser->anyof.size, out);
+
+            case parsi_parser_type_repeat:
+                if (parser->repeat.min > parser->repeat.max) {
+                    out += k_fail;
+                    return true;
+                }
+                if (parser->repeat.max == 0) {
+                    // the template succeeds right away, while no more than 0 matches means none.
+                    _uses_no_match = true;
+                    out += "no_match(";
+                    if (!append_expression(parser->repeat.parser, out)) {
+                        return false;
+                    }
+                    out += ')';
+                    return true;
+                }
+                out += "parsi::repeat<";
+                append_size(out, parser->repeat.min);
+                out += ", ";
+                append_size(out, parser->repeat.max);
+                out += ">(";
+                if (!append_expression(parser->repeat.parser, out)) {
+                    return false;
+                }
+                out += ')';
+                return true;
+
+            case parsi_parser_type_optional:
+                out += "parsi::optional(";
+                if (!append_expression(parser->optional.parser, out)) {
+                    return false;
+                }
+                out += ')';
+                return true;
+
+            case parsi_parser_type_capture:
+                // only `parsi_parse_captures` records the spans.
+                return append_expression(parser->capture.parser, out);
+        }
+
+        // unknown parser type.
+        return false;
+    }
+
+    parsi_callback_name_fn_t _name_fn;
+    void* _name_ctx;
+    std::vector<const parsi_parser_t*> _rules;  // by struct index, the root first
+    std::unordered_map<const parsi_parser_t*, std::size_t> _rule_ids;
+    std::map<std::string, CallbackKind> _callbacks;  // by name
+    bool _uses_no_match = false;
+};
+
+}  // namespace
+
+auto generate_cpp(const parsi_parser_t* parser, const char* symbol, parsi_callback_name_fn_t name_fn, void* name_ctx,
+                  std::string& source) -> bool
+{
+    if (!parser || !symbol) {
+        return false;
+    }
+    CppGenerator generator(name_fn, name_ctx);
+    return generator.generate(parser, symbol, source);
+}
+
+}  // namespace parsi::internal
@@ -0,0 +1,20 @@
+#ifndef PARSI_SRC_CODEGEN_HPP
+#define PARSI_SRC_CODEGEN_HPP
+
+#include <string>
+
+#include "parsi/parsi-c.h"
+
+namespace parsi::internal {
+
+/**
+ * writes the C++ source of `parser` rebuilt out of the header-only templates into `source`,
+ * exported as `symbol` (see `parsi_generate_cpp`).
+ * returns false if a part of the tree has no template counterpart or a name isn't an identifier.
+ */
+[[nodiscard]] auto generate_cpp(const parsi_parser_t* parser, const char* symbol, parsi_callback_name_fn_t name_fn,
+                                void* name_ctx, std::string& source) -> bool;
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_CODEGEN_HPP
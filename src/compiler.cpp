@@ -0,0 +1,900 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "first_set.hpp"
+#include "program.hpp"
+#include "scan.hpp"
+#include "trie.hpp"
+
+namespace parsi::internal {
+
+namespace {
+
+/** anyofs with fewer alternatives are cheaper to try in order than to dispatch. */
+constexpr std::size_t k_dispatch_min_alternatives = 4;
+
+/** anyofs of fewer literals are cheaper to compare one by one than to walk a trie of. */
+constexpr std::size_t k_trie_min_alternatives = 4;
+
+/** bound by the 24 bits of immediate that count the ends of merged literals. */
+constexpr std::size_t k_max_merged_literals = std::size_t{1} << 24;
+
+/** how deep to look into anyofs and sequences for a parser matching a single byte. */
+constexpr std::size_t k_max_single_byte_depth = 8;
+
+/**
+ * Finds out which nodes of a parser tree are structurally identical, of the same type
+ * with the same operands and callbacks, and identical children all the way down,
+ * so each distinct subtree is compiled (and memoized and profiled) once.
+ * a node that is reached again through its own children is only identical to itself,
+ * as telling cyclic trees apart would take more than comparing them bottom up.
+ */
+class SubtreeIndex {
+public:
+    /** the first node found of the same structure as `parser`. */
+    auto canonical_of(const parsi_parser_t* parser) -> const parsi_parser_t*
+    {
+        return _canonicals[id_of(parser)];
+    }
+
+private:
+    static constexpr std::size_t k_pending = std::numeric_limits<std::size_t>::max();
+
+    auto id_of(const parsi_parser_t* parser) -> std::size_t
+    {
+        if (auto iter = _ids.find(parser); iter != _ids.end()) {
+            if (iter->second == k_pending) {
+                iter->second = add_canonical(parser);
+            }
+            return iter->second;
+        }
+        _ids.emplace(parser, k_pending);
+
+        std::vector<std::uint64_t> key;
+        if (parser) {
+            append_key(parser, key);
+        }
+
+        // the structure is only known for nodes that weren't reached through their children meanwhile.
+        std::size_t& id = _ids[parser];
+        if (id == k_pending) {
+            auto [iter, inserted] = _interned.emplace(std::move(key), _canonicals.size());
+            if (inserted) {
+                _canonicals.push_back(parser);
+            }
+            id = iter->second;
+        }
+        return id;
+    }
+
+    auto add_canonical(const parsi_parser_t* parser) -> std::size_t
+    {
+        _canonicals.push_back(parser);
+        return _canonicals.size() - 1;
+    }
+
+    void append_key(const parsi_parser_t* parser, std::vector<std::uint64_t>& key)
+    {
+        const auto append_pointer = [&key](auto pointer) {
+            key.push_back(reinterpret_cast<std::uintptr_t>(pointer));
+        };
+        const auto append_bytes = [&key](const char* str, std::size_t size) {
+            key.push_back(str ? size : 0);
+            for (std::size_t offset = 0; str && offset < size; offset += sizeof(std::uint64_t)) {
+                std::uint64_t word = 0;
+                std::memcpy(&word, str + offset, std::min(size - offset, sizeof(word)));
+                key.push_back(word);
+            }
+        };
+        const auto append_list = [&](const parsi_parser_t* parsers, std::size_t size) {
+            key.push_back(parsers ? size : std::numeric_limits<std::uint64_t>::max());
+            for (std::size_t index = 0; parsers && index < size; ++index) {
+                key.push_back(id_of(&parsers[index]));
+            }
+        };
+
+        // both kinds of strings compile to the same instruction.
+        key.push_back(parser->type == parsi_parser_type_static_string ? parsi_parser_type_string : parser->type);
+        switch (parser->type) {
+            case parsi_parser_type_none:
+            case parsi_parser_type_eos:
+                break;
+
+            // the plain and ctx callbacks share their slot, the type tells them apart.
+            case parsi_parser_type_custom:
+            case parsi_parser_type_custom_ctx:
+                append_pointer(parser->custom.func);
+                append_pointer(parser->custom.context);
+                break;
+
+            case parsi_parser_type_char:
+                key.push_back(static_cast<unsigned char>(parser->expect_char.expected));
+                break;
+
+            case parsi_parser_type_charset:
+                key.insert(key.end(), std::begin(parser->expect_charset.expected.bitset),
+                           std::end(parser->expect_charset.expected.bitset));
+                break;
+
+            case parsi_parser_type_string:
+                append_bytes(parser->expect_string.string, parser->expect_string.size);
+                break;
+
+            case parsi_parser_type_static_string:
+                append_bytes(parser->expect_static_string.string, parser->expect_static_string.size);
+                break;
+
+            case parsi_parser_type_extract:
+            case parsi_parser_type_extract_ctx:
+                append_pointer(parser->extract.func);
+                append_pointer(parser->extract.context);
+                key.push_back(id_of(parser->extract.parser));
+                break;
+
+            case parsi_parser_type_sequence:
+                append_list(parser->sequence.parsers, parser->sequence.size);
+                break;
+
+            case parsi_parser_type_anyof:
+                append_list(parser->anyof.parsers, parser->anyof.size);
+                break;
+
+            case parsi_parser_type_repeat:
+                key.push_back(parser->repeat.min);
+                key.push_back(parser->repeat.max);
+                key.push_back(id_of(parser->repeat.parser));
+                break;
+
+            case parsi_parser_type_optional:
+                key.push_back(id_of(parser->optional.parser));
+                break;
+
+            case parsi_parser_type_capture:
+                key.push_back(parser->capture.slot);
+                key.push_back(id_of(parser->capture.parser));
+                break;
+
+            default:
+                // unknown to the index, so only identical to itself.
+                append_pointer(parser);
+                break;
+        }
+    }
+
+    std::unordered_map<const parsi_parser_t*, std::size_t> _ids;
+    std::map<std::vector<std::uint64_t>, std::size_t> _interned;
+    std::vector<const parsi_parser_t*> _canonicals;  // by id
+};
+
+/** the subparsers of a sequence or an anyof being emitted, with those of nested ones in their place. */
+using Elements = std::vector<const parsi_parser_t*>;
+
+class Compiler {
+public:
+    Compiler(Program& program, Profiling profiling) noexcept
+        : _program(program)
+        , _profiling(profiling)
+        , _optimizing(profiling == Profiling::none)
+    {
+    }
+
+    auto compile(const parsi_parser_t* parser) -> bool
+    {
+        if (_optimizing) {
+            count_references(parser);
+        }
+        return emit(parser);
+    }
+
+    auto emit(const parsi_parser_t* parser) -> bool
+    {
+        if (!parser) {
+            return finish(emit_header(Opcode::fail));
+        }
+
+        // a combinator identical to one that was already emitted (or is being emitted, when it's an ancestor)
+        // is only referred to, so shared, duplicated and cyclic subparsers are compiled once.
+        // leaves are cheaper to copy than to call.
+        const parsi_parser_t* canonical = _subtrees.canonical_of(parser);
+        if (is_combinator(parser->type)) {
+            if (auto iter = _emitted.find(canonical); iter != _emitted.end()) {
+                const std::size_t pc = emit_header(Opcode::call);
+                emit_word(static_cast<Word>(iter->second));
+                return finish(pc);
+            }
+            _emitted.emplace(canonical, position());
+        }
+
+        if (_profiling != Profiling::none) {
+            const std::size_t pc = emit_header(Opcode::profile, _profiling == Profiling::cycles ? 1 : 0);
+            emit_word(profile_slot_of(canonical));
+            return emit_node(parser) && finish(pc);
+        }
+        return emit_node(parser);
+    }
+
+    /** number of profile slots handed out. */
+    [[nodiscard]] auto profile_slots() const noexcept -> std::size_t
+    {
+        return _profile_slots.size();
+    }
+
+private:
+    auto emit_node(const parsi_parser_t* parser) -> bool
+    {
+        switch (parser->type) {
+            case parsi_parser_type_none:
+                return finish(emit_header(Opcode::fail));
+
+            case parsi_parser_type_custom:
+            case parsi_parser_type_custom_ctx: {
+                const bool with_ctx = parser->type == parsi_parser_type_custom_ctx;
+                const std::size_t pc = emit_header(Opcode::custom);
+                emit_word(emit_callback(Callback{
+                    .parse_fn = with_ctx ? nullptr : parser->custom.func,
+                    .parse_ctx_fn = with_ctx ? parser->custom.ctx_func : nullptr,
+                    .context = parser->custom.context,
+                }));
+                return finish(pc);
+            }
+
+            case parsi_parser_type_eos:
+                return finish(emit_header(Opcode::eos));
+
+            case parsi_parser_type_char:
+                return finish(emit_header(Opcode::byte, static_cast<unsigned char>(parser->expect_char.expected)));
+
+            case parsi_parser_type_charset: {
+                const std::size_t pc = emit_header(Opcode::charset);
+                emit_charset(parser->expect_charset.expected);
+                return finish(pc);
+            }
+
+            case parsi_parser_type_string:
+                return emit_string(parser->expect_string.string, parser->expect_string.size);
+
+            case parsi_parser_type_static_string:
+                return emit_string(parser->expect_static_string.string, parser->expect_static_string.size);
+
+            case parsi_parser_type_extract:
+            case parsi_parser_type_extract_ctx: {
+                const bool with_ctx = parser->type == parsi_parser_type_extract_ctx;
+                const std::size_t pc = emit_header(Opcode::extract);
+                emit_word(emit_callback(Callback{
+                    .visit_fn = with_ctx ? nullptr : parser->extract.func,
+                    .visit_ctx_fn = with_ctx ? parser->extract.ctx_func : nullptr,
+                    .context = parser->extract.context,
+                }));
+                return emit(parser->extract.parser) && finish(pc);
+            }
+
+            case parsi_parser_type_sequence:
+                return emit_sequence(parser);
+
+            case parsi_parser_type_anyof:
+                if (!parser->anyof.parsers) {
+                    // a null list always succeeds, same as an empty sequence.
+                    return finish(emit_header(Opcode::sequence));
+                }
+                return emit_anyof(parser);
+
+            case parsi_parser_type_repeat: {
+                if (parser->repeat.min > parser->repeat.max) [[unlikely]] {
+                    return finish(emit_header(Opcode::fail));
+                }
+                if (Word words[k_charset_words] = {}; single_byte_set_of(parser->repeat.parser, words)) {
+                    return emit_scan(parser, words);
+                }
+                const std::size_t pc = emit_header(Opcode::repeat);
+                emit_size(parser->repeat.min);
+                emit_size(parser->repeat.max);
+                return emit(parser->repeat.parser) && finish(pc);
+            }
+
+            case parsi_parser_type_optional: {
+                if (_optimizing && never_fails(parser->optional.parser)) {
+                    return emit(parser->optional.parser);
+                }
+                const std::size_t pc = emit_header(Opcode::optional);
+                return emit(parser->optional.parser) && finish(pc);
+            }
+
+            case parsi_parser_type_capture: {
+                const std::size_t pc = emit_header(Opcode::capture);
+                emit_size(parser->capture.slot);
+                return emit(parser->capture.parser) && finish(pc);
+            }
+        }
+
+        // unknown parser type.
+        return false;
+    }
+
+    [[nodiscard]] static constexpr auto is_combinator(parsi_parser_type_enum type) noexcept -> bool
+    {
+        return type == parsi_parser_type_extract
+            || type == parsi_parser_type_extract_ctx
+            || type == parsi_parser_type_sequence
+            || type == parsi_parser_type_anyof
+            || type == parsi_parser_type_repeat
+            || type == parsi_parser_type_optional
+            || type == parsi_parser_type_capture;
+    }
+
+    [[nodiscard]] auto position() const noexcept -> std::size_t
+    {
+        return _program.code.size();
+    }
+
+    auto emit_header(Opcode opcode, Word immediate = 0) -> std::size_t
+    {
+        const std::size_t pc = position();
+        _program.code.push_back(static_cast<Word>(opcode) | (immediate << 8));
+        _program.code.push_back(0);  // length, patched by `finish`
+        return pc;
+    }
+
+    void emit_word(Word word)
+    {
+        _program.code.push_back(word);
+    }
+
+    void emit_size(std::size_t size)
+    {
+        const auto value = static_cast<std::uint64_t>(size);
+        emit_word(static_cast<Word>(value & 0xFFFFFFFF));
+        emit_word(static_cast<Word>(value >> 32));
+    }
+
+    void emit_charset(const parsi_charset_t& charset)
+    {
+        Word words[k_charset_words];
+        to_words(charset, words);
+        _program.code.insert(_program.code.end(), std::begin(words), std::end(words));
+    }
+
+    [[nodiscard]] static auto charset_of(const Word (&words)[k_charset_words]) noexcept -> parsi_charset_t
+    {
+        constexpr std::size_t cell_bits = 8 * sizeof(parsi_charset_t{}.bitset[0]);
+        constexpr std::size_t cell_count = std::size(parsi_charset_t{}.bitset);
+
+        parsi_charset_t charset{};
+        for (std::size_t chr = 0; chr < 256 && chr / cell_bits < cell_count; ++chr) {
+            if (charset_contains(words, static_cast<unsigned char>(chr))) {
+                charset.bitset[chr / cell_bits] |= std::size_t{1} << (chr % cell_bits);
+            }
+        }
+        return charset;
+    }
+
+    /**
+     * adds the bytes to `words` if the parser matches a single one of them and fails where it started otherwise:
+     * a char or a charset, and when optimizing, a string of one byte or anyofs and single sequences of those.
+     */
+    auto single_byte_set_of(const parsi_parser_t* parser, Word (&words)[k_charset_words], std::size_t depth = 0) const
+        -> bool
+    {
+        if (!parser) {
+            return false;
+        }
+
+        const auto add_byte = [&words](char chr) {
+            const auto byte = static_cast<unsigned char>(chr);
+            words[byte >> 5] |= static_cast<Word>(1) << (byte & 31);
+        };
+
+        switch (parser->type) {
+            case parsi_parser_type_char:
+                add_byte(parser->expect_char.expected);
+                return true;
+
+            case parsi_parser_type_charset: {
+                Word charset[k_charset_words];
+                to_words(parser->expect_charset.expected, charset);
+                for (std::size_t index = 0; index < k_charset_words; ++index) {
+                    words[index] |= charset[index];
+                }
+                return true;
+            }
+
+            default:
+                break;
+        }
+        if (!_optimizing || depth == k_max_single_byte_depth) {
+            return false;
+        }
+
+        std::string_view literal;
+        if (literal_of(parser, literal)) {
+            if (literal.size() != 1) {
+                return false;
+            }
+            add_byte(literal[0]);
+            return true;
+        }
+        if (parser->type == parsi_parser_type_sequence) {
+            return parser->sequence.parsers && parser->sequence.size == 1
+                && single_byte_set_of(parser->sequence.parsers, words, depth + 1);
+        }
+        if (parser->type == parsi_parser_type_anyof) {
+            if (!parser->anyof.parsers || parser->anyof.size == 0) {
+                return false;
+            }
+            for (std::size_t index = 0; index < parser->anyof.size; ++index) {
+                if (!single_byte_set_of(&parser->anyof.parsers[index], words, depth + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * emits a repeat over a single byte parser as a scan instruction,
+     * picking the byte kernels for charsets of one byte or all bytes but one.
+     */
+    auto emit_scan(const parsi_parser_t* parser, const Word (&words)[k_charset_words]) -> bool
+    {
+        const auto& repeat = parser->repeat;
+        std::size_t members = 0;
+        for (Word word : words) {
+            members += static_cast<std::size_t>(std::popcount(word));
+        }
+
+        const auto first_byte = [&words](bool member) -> Word {
+            for (Word chr = 0; chr < 256; ++chr) {
+                if (charset_contains(words, static_cast<unsigned char>(chr)) == member) {
+                    return chr;
+                }
+            }
+            return 0;
+        };
+
+        std::size_t pc;
+        if (members == 1) {
+            pc = emit_header(Opcode::repeat_byte, first_byte(true));
+        }
+        else if (members == 255) {
+            pc = emit_header(Opcode::repeat_not_byte, first_byte(false));
+        }
+        else {
+            pc = emit_header(Opcode::repeat_charset);
+        }
+        emit_size(repeat.min);
+        emit_size(repeat.max);
+
+        if (opcode_of(_program.code.data(), pc) == Opcode::repeat_charset) {
+            Word tables[k_charset_words];
+            make_nibble_tables(words, tables);
+            _program.code.insert(_program.code.end(), std::begin(words), std::end(words));
+            _program.code.insert(_program.code.end(), std::begin(tables), std::end(tables));
+        }
+        return finish(pc);
+    }
+
+    /** `ends` are those of all literals but the last, when merging them out of a sequence. */
+    auto emit_string(const char* str, std::size_t size, const std::vector<Word>& ends = {}) -> bool
+    {
+        if (size > std::numeric_limits<Word>::max() || (size > 0 && !str)) [[unlikely]] {
+            return false;
+        }
+
+        const std::size_t pc = emit_header(Opcode::string, static_cast<Word>(ends.size()));
+        emit_word(static_cast<Word>(size));
+
+        const std::size_t offset = position();
+        _program.code.resize(offset + (size + sizeof(Word) - 1) / sizeof(Word), 0);
+        if (size > 0) {
+            std::memcpy(&_program.code[offset], str, size);
+        }
+        _program.code.insert(_program.code.end(), ends.begin(), ends.end());
+        return finish(pc);
+    }
+
+    auto emit_list(Opcode opcode, const Elements& elements) -> bool
+    {
+        const std::size_t pc = emit_header(opcode);
+        for (const parsi_parser_t* element : elements) {
+            if (!emit(element)) {
+                return false;
+            }
+        }
+        return finish(pc);
+    }
+
+    /** a string or a char, whose bytes are then in `literal`. */
+    [[nodiscard]] static auto literal_of(const parsi_parser_t* parser, std::string_view& literal) noexcept -> bool
+    {
+        if (parser->type == parsi_parser_type_char) {
+            literal = std::string_view(&parser->expect_char.expected, 1);
+            return true;
+        }
+        if (parser->type == parsi_parser_type_string && (parser->expect_string.string || parser->expect_string.size == 0)) {
+            literal = std::string_view(parser->expect_string.string, parser->expect_string.size);
+            return true;
+        }
+        if (parser->type == parsi_parser_type_static_string
+            && (parser->expect_static_string.string || parser->expect_static_string.size == 0)) {
+            literal = std::string_view(parser->expect_static_string.string, parser->expect_static_string.size);
+            return true;
+        }
+        return false;
+    }
+
+    /** whether the parser succeeds on any input, so wrapping it in an optional changes nothing. */
+    [[nodiscard]] static auto never_fails(const parsi_parser_t* parser) noexcept -> bool
+    {
+        return parser
+            && (parser->type == parsi_parser_type_optional
+                || (parser->type == parsi_parser_type_repeat && parser->repeat.min == 0
+                    && parser->repeat.max == std::numeric_limits<std::size_t>::max()));
+    }
+
+    /** whether the parser fails with the stream it started at, same as an anyof of only it. */
+    [[nodiscard]] auto fails_where_it_starts(const parsi_parser_t* parser) const -> bool
+    {
+        if (never_fails(parser)) {
+            return true;
+        }
+        std::string_view literal;
+        Word words[k_charset_words] = {};
+        return parser->type == parsi_parser_type_none || parser->type == parsi_parser_type_eos
+            || (parser->type == parsi_parser_type_anyof && parser->anyof.parsers) || literal_of(parser, literal)
+            || single_byte_set_of(parser, words);
+    }
+
+    /**
+     * appends the subparsers of a sequence or an anyof to `elements`, with the ones of nested lists
+     * of the same type in their place, as far as they're not referred to from anywhere else.
+     */
+    void flatten(parsi_parser_type_enum type, const parsi_parser_t* parsers, std::size_t size, Elements& elements)
+    {
+        for (std::size_t index = 0; parsers && index < size; ++index) {
+            const parsi_parser_t* element = &parsers[index];
+            const parsi_parser_t* canonical = _subtrees.canonical_of(element);
+            const bool nested = element->type == type
+                             && (type == parsi_parser_type_sequence || element->anyof.parsers)
+                             && _references[canonical] == 1 && !_emitted.contains(canonical);
+            if (nested && _flattening.insert(canonical).second) {
+                if (type == parsi_parser_type_sequence) {
+                    flatten(type, element->sequence.parsers, element->sequence.size, elements);
+                }
+                else {
+                    flatten(type, element->anyof.parsers, element->anyof.size, elements);
+                }
+                _flattening.erase(canonical);
+                continue;
+            }
+            elements.push_back(element);
+        }
+    }
+
+    /**
+     * emits a sequence flattened when optimizing, with runs of adjacent literals merged into one string
+     * that fails at the end of the last of them that matched, as the sequence would have,
+     * and without the sequence at all when that leaves a single element.
+     */
+    auto emit_sequence(const parsi_parser_t* parser) -> bool
+    {
+        Elements elements;
+        if (!_optimizing) {
+            for (std::size_t index = 0; parser->sequence.parsers && index < parser->sequence.size; ++index) {
+                elements.push_back(&parser->sequence.parsers[index]);
+            }
+            return emit_list(Opcode::sequence, elements);
+        }
+
+        flatten(parsi_parser_type_sequence, parser->sequence.parsers, parser->sequence.size, elements);
+        std::string_view literal;
+        std::erase_if(elements, [&literal](const parsi_parser_t* element) {
+            return literal_of(element, literal) && literal.empty();
+        });
+
+        // runs of literals, by their first element.
+        std::vector<std::size_t> run_ends(elements.size());
+        for (std::size_t index = elements.size(); index-- > 0;) {
+            const bool next = index + 1 < elements.size() && run_ends[index + 1] > index + 1
+                           && run_ends[index + 1] - index <= k_max_merged_literals;
+            run_ends[index] = !literal_of(elements[index], literal) ? index
+                            : next                                  ? run_ends[index + 1]
+                                                                    : index + 1;
+        }
+
+        const auto emit_run = [&](std::size_t& index) -> bool {
+            if (run_ends[index] <= index + 1) {
+                return emit(elements[index++]);
+            }
+            std::string bytes;
+            std::vector<Word> ends;
+            for (const std::size_t first = index, end = run_ends[index]; index < end; ++index) {
+                if (index > first) {
+                    ends.push_back(static_cast<Word>(bytes.size()));
+                }
+                if (literal_of(elements[index], literal)) {
+                    bytes.append(literal);
+                }
+                if (bytes.size() > std::numeric_limits<Word>::max()) [[unlikely]] {
+                    return false;
+                }
+            }
+            return emit_string(bytes.data(), bytes.size(), ends);
+        };
+
+        if (elements.size() == 1 || (!elements.empty() && run_ends[0] == elements.size())) {
+            std::size_t index = 0;
+            return emit_run(index);
+        }
+        const std::size_t pc = emit_header(Opcode::sequence);
+        for (std::size_t index = 0; index < elements.size();) {
+            if (!emit_run(index)) {
+                return false;
+            }
+        }
+        return finish(pc);
+    }
+
+    /**
+     * emits an anyof flattened when optimizing, with adjacent alternatives that match a single byte
+     * merged into one charset, and without the anyof at all when that leaves a single one that fails
+     * where it started, as the anyof would.
+     * then picks a trie for only literals, a dispatch over many alternatives, or else tries them in order.
+     */
+    auto emit_anyof(const parsi_parser_t* parser) -> bool
+    {
+        Elements alternatives;
+        if (!_optimizing) {
+            for (std::size_t index = 0; index < parser->anyof.size; ++index) {
+                alternatives.push_back(&parser->anyof.parsers[index]);
+            }
+        }
+        else {
+            flatten(parsi_parser_type_anyof, parser->anyof.parsers, parser->anyof.size, alternatives);
+
+            // merging single bytes first would hide them from the trie of the literals they're among.
+            std::string_view literal;
+            const bool literals = std::ranges::all_of(alternatives, [&literal](const parsi_parser_t* alternative) {
+                return literal_of(alternative, literal);
+            });
+            if (!(literals && alternatives.size() >= k_trie_min_alternatives)) {
+                alternatives = merge_single_bytes(alternatives);
+            }
+            if (alternatives.size() == 1 && fails_where_it_starts(alternatives[0])) {
+                return emit(alternatives[0]);
+            }
+        }
+
+        if (alternatives.size() >= k_trie_min_alternatives && emit_trie(alternatives)) {
+            return true;
+        }
+        if (alternatives.size() >= k_dispatch_min_alternatives) {
+            return emit_dispatch(alternatives);
+        }
+        return emit_list(Opcode::anyof, alternatives);
+    }
+
+    /** replaces each run of alternatives that match a single byte with one charset of all their bytes. */
+    auto merge_single_bytes(const Elements& alternatives) -> Elements
+    {
+        Elements merged;
+        for (std::size_t index = 0; index < alternatives.size();) {
+            Word words[k_charset_words] = {};
+            std::size_t end = index;
+            while (end < alternatives.size() && single_byte_set_of(alternatives[end], words)) {
+                ++end;
+            }
+            if (end - index < 2) {
+                merged.push_back(alternatives[index]);
+                index = std::max(end, index + 1);
+                continue;
+            }
+            _merged_nodes.push_back(parsi_expect_charset(charset_of(words)));
+            merged.push_back(&_merged_nodes.back());
+            index = end;
+        }
+        return merged;
+    }
+
+    /**
+     * emits an anyof as a table from the next byte to an anyof of only the alternatives
+     * that can start with it, in their original order.
+     * alternatives that can match empty input or whose first bytes aren't known
+     * (custom parsers, left recursion) are kept in every one of them.
+     * an alternative in multiple of them is emitted once, or copied if it's a leaf.
+     */
+    auto emit_dispatch(const Elements& alternatives) -> bool
+    {
+        const std::size_t size = alternatives.size();
+        std::vector<FirstSet> first_sets;
+        first_sets.reserve(size);
+        bool selective = false;
+        for (const parsi_parser_t* alternative : alternatives) {
+            first_sets.push_back(_first_sets.first_set_of(alternative));
+            selective = selective || !(first_sets.back().nullable || first_sets.back().opaque);
+        }
+        if (!selective) {
+            return emit_list(Opcode::anyof, alternatives);
+        }
+
+        const std::size_t pc = emit_header(Opcode::dispatch);
+        const std::size_t table = position();
+        _program.code.resize(table + k_dispatch_entries, 0);
+
+        std::map<std::vector<std::size_t>, std::size_t> children;
+        std::vector<std::size_t> candidates;
+        for (std::size_t byte = 0; byte < k_dispatch_entries; ++byte) {
+            candidates.clear();
+            for (std::size_t index = 0; index < size; ++index) {
+                if (first_sets[index].admits(byte)) {
+                    candidates.push_back(index);
+                }
+            }
+            if (candidates.empty()) {
+                continue;
+            }
+
+            auto [iter, inserted] = children.emplace(candidates, position());
+            if (inserted) {
+                const std::size_t child = emit_header(Opcode::anyof);
+                for (std::size_t index : candidates) {
+                    if (!emit(alternatives[index])) {
+                        return false;
+                    }
+                }
+                if (!finish(child)) {
+                    return false;
+                }
+            }
+            _program.code[table + byte] = static_cast<Word>(iter->second - pc);
+        }
+        return finish(pc);
+    }
+
+    /**
+     * emits an anyof of only strings and chars as a trie of them, which finds the first one that matches
+     * in one pass over the input, instead of comparing each in turn.
+     * returns false without emitting anything if there's another kind of alternative,
+     * when profiling (to keep counting the alternatives) or if the trie is too large.
+     */
+    auto emit_trie(const Elements& alternatives) -> bool
+    {
+        if (_profiling != Profiling::none) {
+            return false;
+        }
+
+        std::vector<std::string_view> literals(alternatives.size());
+        for (std::size_t index = 0; index < alternatives.size(); ++index) {
+            if (!literal_of(alternatives[index], literals[index])) {
+                return false;
+            }
+        }
+
+        const std::size_t pc = emit_header(Opcode::trie);
+        if (!make_trie(literals, pc, _program.code) || !finish(pc)) {
+            _program.code.resize(pc);
+            return false;
+        }
+        return true;
+    }
+
+    /** counts the parents referring to each node, all identical ones counting as one. */
+    void count_references(const parsi_parser_t* root)
+    {
+        std::vector<const parsi_parser_t*> pending{ root };
+        std::unordered_set<const parsi_parser_t*> visited;
+        const auto refer = [&](const parsi_parser_t* child) {
+            ++_references[_subtrees.canonical_of(child)];
+            pending.push_back(child);
+        };
+        const auto refer_list = [&](const parsi_parser_t* parsers, std::size_t size) {
+            for (std::size_t index = 0; parsers && index < size; ++index) {
+                refer(&parsers[index]);
+            }
+        };
+
+        ++_references[_subtrees.canonical_of(root)];
+        while (!pending.empty()) {
+            const parsi_parser_t* parser = _subtrees.canonical_of(pending.back());
+            pending.pop_back();
+            if (!parser || !visited.insert(parser).second) {
+                continue;
+            }
+            switch (parser->type) {
+                case parsi_parser_type_extract:
+                case parsi_parser_type_extract_ctx:
+                    refer(parser->extract.parser);
+                    break;
+                case parsi_parser_type_sequence:
+                    refer_list(parser->sequence.parsers, parser->sequence.size);
+                    break;
+                case parsi_parser_type_anyof:
+                    refer_list(parser->anyof.parsers, parser->anyof.size);
+                    break;
+                case parsi_parser_type_repeat:
+                    refer(parser->repeat.parser);
+                    break;
+                case parsi_parser_type_optional:
+                    refer(parser->optional.parser);
+                    break;
+                case parsi_parser_type_capture:
+                    refer(parser->capture.parser);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    /** copies of a leaf, and identical nodes, share the slot of the first of them. */
+    auto profile_slot_of(const parsi_parser_t* parser) -> Word
+    {
+        auto [iter, inserted] = _profile_slots.emplace(parser, _program.profile_nodes.size());
+        if (inserted) {
+            _program.profile_nodes.push_back(ProfileNode{ .parser = parser, .type = parser->type });
+        }
+        return static_cast<Word>(iter->second);
+    }
+
+    auto emit_callback(Callback callback) -> Word
+    {
+        _program.callbacks.push_back(callback);
+        return static_cast<Word>(_program.callbacks.size() - 1);
+    }
+
+    /** patches the length of the instruction at `pc` now that all of its children are emitted. */
+    auto finish(std::size_t pc) -> bool
+    {
+        const std::size_t length = position() - pc;
+        if (position() > std::numeric_limits<Word>::max()) [[unlikely]] {
+            return false;
+        }
+        _program.code[pc + 1] = static_cast<Word>(length);
+        return true;
+    }
+
+    Program& _program;
+    SubtreeIndex _subtrees;
+    std::unordered_map<const parsi_parser_t*, std::size_t> _emitted;  // by canonical node
+    FirstSetAnalysis _first_sets;
+    Profiling _profiling;
+    std::unordered_map<const parsi_parser_t*, std::size_t> _profile_slots;
+
+    // the passes that change the shape of the tree, off when profiling it.
+    bool _optimizing;
+    std::unordered_map<const parsi_parser_t*, std::size_t> _references;  // by canonical node
+    std::unordered_set<const parsi_parser_t*> _flattening;
+    std::deque<parsi_parser_t> _merged_nodes;
+};
+
+}  // namespace
+
+auto compile_program(const parsi_parser_t* parser, Program& program, Profiling profiling) -> bool
+{
+    try {
+        Compiler compiler(program, profiling);
+        if (!compiler.compile(parser)) {
+            return false;
+        }
+        if (compiler.profile_slots() > 0) {
+            program.profile_counters = std::make_unique<ProfileCounters[]>(compiler.profile_slots());
+        }
+        return true;
+    }
+    catch (const std::bad_alloc&) {
+        return false;
+    }
+}
+
+}  // namespace parsi::internal
@@ -0,0 +1,118 @@
+#include "first_set.hpp"
+
+namespace parsi::internal {
+
+auto FirstSetAnalysis::first_set_of(const parsi_parser_t* parser) -> FirstSet
+{
+    FirstSet first_set;
+    if (!parser) {
+        return first_set;
+    }
+    if (auto iter = _first_sets.find(parser); iter != _first_sets.end()) {
+        if (_computing.contains(parser) && !_left_recursive) {
+            _left_recursive = parser;
+        }
+        return iter->second;
+    }
+
+    // a parser reached again while its own first set is being computed is left recursive.
+    _first_sets.emplace(parser, FirstSet{ .opaque = true });
+    _computing.insert(parser);
+
+    const auto add_byte = [&first_set](unsigned char chr) {
+        first_set.bytes[chr >> 5] |= static_cast<Word>(1) << (chr & 31);
+    };
+
+    switch (parser->type) {
+        case parsi_parser_type_none:
+            break;
+
+        case parsi_parser_type_custom:
+        case parsi_parser_type_custom_ctx:
+            first_set.opaque = true;
+            break;
+
+        case parsi_parser_type_eos:
+            first_set.nullable = true;
+            break;
+
+        case parsi_parser_type_char:
+            add_byte(static_cast<unsigned char>(parser->expect_char.expected));
+            break;
+
+        case parsi_parser_type_charset:
+            to_words(parser->expect_charset.expected, first_set.bytes);
+            break;
+
+        case parsi_parser_type_string:
+        case parsi_parser_type_static_string: {
+            const char* str = parser->type == parsi_parser_type_string ? parser->expect_string.string
+                                                                       : parser->expect_static_string.string;
+            const std::size_t size = parser->type == parsi_parser_type_string ? parser->expect_string.size
+                                                                              : parser->expect_static_string.size;
+            if (size == 0) {
+                first_set.nullable = true;
+            }
+            else if (str) {
+                add_byte(static_cast<unsigned char>(str[0]));
+            }
+            break;
+        }
+
+        case parsi_parser_type_extract:
+        case parsi_parser_type_extract_ctx:
+            first_set = first_set_of(parser->extract.parser);
+            // the visitor would run on an empty match, even if the alternative fails later on.
+            first_set.opaque = first_set.opaque || first_set.nullable;
+            break;
+
+        case parsi_parser_type_sequence:
+            first_set.nullable = true;
+            for (std::size_t index = 0; parser->sequence.parsers && index < parser->sequence.size; ++index) {
+                const FirstSet element = first_set_of(&parser->sequence.parsers[index]);
+                first_set.nullable = false;
+                first_set.merge(element);
+                if (!first_set.nullable || first_set.opaque) {
+                    break;
+                }
+            }
+            break;
+
+        case parsi_parser_type_anyof:
+            first_set.nullable = !parser->anyof.parsers;
+            for (std::size_t index = 0; parser->anyof.parsers && index < parser->anyof.size; ++index) {
+                first_set.merge(first_set_of(&parser->anyof.parsers[index]));
+            }
+            break;
+
+        case parsi_parser_type_repeat:
+            if (parser->repeat.min > parser->repeat.max) {
+                break;
+            }
+            if (parser->repeat.max > 0) {
+                first_set = first_set_of(parser->repeat.parser);
+            }
+            first_set.nullable = first_set.nullable || parser->repeat.min == 0;
+            break;
+
+        case parsi_parser_type_optional:
+            first_set = first_set_of(parser->optional.parser);
+            first_set.nullable = true;
+            break;
+
+        case parsi_parser_type_capture:
+            // unlike a visitor, a capture of an alternative that fails is dropped.
+            first_set = first_set_of(parser->capture.parser);
+            break;
+
+        default:
+            first_set.opaque = true;
+            break;
+    }
+
+    _computing.erase(parser);
+    _first_sets[parser] = first_set;
+    return first_set;
+}
+
+}  // namespace parsi::internal
@@ -0,0 +1,59 @@
+#ifndef PARSI_SRC_FIRST_SET_HPP
+#define PARSI_SRC_FIRST_SET_HPP
+
+#include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "program.hpp"
+
+namespace parsi::internal {
+
+/** what the next byte of the input must be for a parser to have a chance to succeed. */
+struct FirstSet {
+    Word bytes[k_charset_words] = {};
+    bool nullable = false;  // may succeed without consuming, on any byte or at the end
+    bool opaque = false;    // unknown, may succeed on anything
+
+    void merge(const FirstSet& other) noexcept
+    {
+        for (std::size_t index = 0; index < k_charset_words; ++index) {
+            bytes[index] |= other.bytes[index];
+        }
+        nullable = nullable || other.nullable;
+        opaque = opaque || other.opaque;
+    }
+
+    /** whether the parser may succeed on the next `byte`, or at the end of the input if it's 256. */
+    [[nodiscard]] auto admits(std::size_t byte) const noexcept -> bool
+    {
+        return opaque || nullable || (byte < 256 && charset_contains(bytes, static_cast<unsigned char>(byte)));
+    }
+};
+
+/**
+ * The first sets of the nodes of a parser tree, computed once per node.
+ *
+ * a node reached again while its own first set is being computed, through children
+ * that may all match empty input before it, is left recursive:
+ * its first set is taken as opaque, and the first such node is kept in `left_recursive`.
+ */
+class FirstSetAnalysis {
+public:
+    auto first_set_of(const parsi_parser_t* parser) -> FirstSet;
+
+    /** the first left recursive node found so far, if any. */
+    [[nodiscard]] auto left_recursive() const noexcept -> const parsi_parser_t*
+    {
+        return _left_recursive;
+    }
+
+private:
+    std::unordered_map<const parsi_parser_t*, FirstSet> _first_sets;
+    std::unordered_set<const parsi_parser_t*> _computing;
+    const parsi_parser_t* _left_recursive = nullptr;
+};
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_FIRST_SET_HPP
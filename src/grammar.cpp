@@ -0,0 +1,569 @@
+#include "grammar.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "first_set.hpp"
+
+namespace parsi::internal {
+
+namespace {
+
+/** how deep parentheses and captures may nest, so hostile text can't overflow the native stack. */
+constexpr std::size_t k_max_nesting = 256;
+
+[[nodiscard]] constexpr auto is_name_start(char chr) noexcept -> bool
+{
+    return (chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') || chr == '_';
+}
+
+[[nodiscard]] constexpr auto is_name_char(char chr) noexcept -> bool
+{
+    return is_name_start(chr) || (chr >= '0' && chr <= '9') || chr == '-';
+}
+
+[[nodiscard]] constexpr auto hex_value_of(char chr) noexcept -> int
+{
+    return (chr >= '0' && chr <= '9') ? chr - '0'
+         : (chr >= 'a' && chr <= 'f') ? chr - 'a' + 10
+         : (chr >= 'A' && chr <= 'F') ? chr - 'A' + 10
+                                      : -1;
+}
+
+/**
+ * Recursive descent parser of the grammar text, building the nodes right into the `Grammar`.
+ *
+ * every `parse_*` returns the node it built, or null with `_error` set at the offending position.
+ * rules are known by name before they're defined, references to them point to their node,
+ * which is filled once the definition is parsed (or bound as a custom parser if there's none).
+ */
+class GrammarParser {
+    struct Rule {
+        parsi_parser_t* node;
+        std::size_t first_use;
+        std::size_t definition = 0;
+        bool defined = false;
+    };
+
+public:
+    GrammarParser(std::string_view text, parsi_callback_bind_fn_t bind_fn, void* bind_ctx, Grammar& grammar) noexcept
+        : _text(text)
+        , _bind_fn(bind_fn)
+        , _bind_ctx(bind_ctx)
+        , _grammar(grammar)
+    {
+    }
+
+    auto parse(std::size_t& error_offset) -> bool
+    {
+        skip_spacing();
+        if (at_end()) {
+            return fail(error_offset);
+        }
+
+        while (!at_end()) {
+            const std::size_t start = _pos;
+            const std::string_view name = parse_name();
+            if (name.empty() || !consume("<-")) {
+                _error = start;
+                return fail(error_offset);
+            }
+
+            Rule& rule = rule_of(name, start);
+            if (rule.defined) {
+                _error = start;
+                return fail(error_offset);
+            }
+            rule.defined = true;
+            rule.definition = start;
+            if (!_grammar.root) {
+                _grammar.root = rule.node;
+            }
+
+            const parsi_parser_t* expression = parse_expression(0);
+            if (!expression) {
+                return fail(error_offset);
+            }
+            *rule.node = value_of(expression);
+        }
+
+        return (bind_undefined_rules() && reject_left_recursion()) || fail(error_offset);
+    }
+
+private:
+    [[nodiscard]] auto fail(std::size_t& error_offset) const noexcept -> bool
+    {
+        error_offset = _error;
+        return false;
+    }
+
+    [[nodiscard]] auto at_end() const noexcept -> bool
+    {
+        return _pos >= _text.size();
+    }
+
+    [[nodiscard]] auto peek() const noexcept -> char
+    {
+        return at_end() ? '\0' : _text[_pos];
+    }
+
+    /** skips whitespace and `#` comments to the end of their line. */
+    void skip_spacing() noexcept
+    {
+        while (!at_end()) {
+            if (peek() == '#') {
+                while (!at_end() && peek() != '\n') {
+                    ++_pos;
+                }
+            }
+            else if (peek() == ' ' || peek() == '\t' || peek() == '\r' || peek() == '\n') {
+                ++_pos;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    /** consumes the token (and the spacing after it) if it's next. */
+    auto consume(std::string_view token) noexcept -> bool
+    {
+        if (_text.substr(_pos, token.size()) != token) {
+            return false;
+        }
+        _pos += token.size();
+        skip_spacing();
+        return true;
+    }
+
+    /** parses a name and the spacing after it, returns empty if there's no name. */
+    auto parse_name() noexcept -> std::string_view
+    {
+        if (!is_name_start(peek())) {
+            return {};
+        }
+        const std::size_t start = _pos;
+        while (is_name_char(peek())) {
+            ++_pos;
+        }
+        const std::string_view name = _text.substr(start, _pos - start);
+        skip_spacing();
+        return name;
+    }
+
+    /** whether the next rule's definition starts here, which ends the current one. */
+    [[nodiscard]] auto at_rule_start() noexcept -> bool
+    {
+        const std::size_t start = _pos;
+        const bool is_rule_start = !parse_name().empty() && _text.substr(_pos, 2) == "<-";
+        _pos = start;
+        return is_rule_start;
+    }
+
+    auto rule_of(std::string_view name, std::size_t position) -> Rule&
+    {
+        auto iter = _rules.find(name);
+        if (iter == _rules.end()) {
+            iter = _rules.emplace(std::string(name), Rule{ .node = &node(parsi_none()), .first_use = position }).first;
+            _rule_nodes.insert(iter->second.node);
+        }
+        return iter->second;
+    }
+
+    auto node(parsi_parser_t parser) -> parsi_parser_t&
+    {
+        return _grammar.nodes.emplace_back(parser);
+    }
+
+    [[nodiscard]] auto is_rule(const parsi_parser_t* parser) const noexcept -> bool
+    {
+        return _rule_nodes.contains(parser);
+    }
+
+    /**
+     * the node to put into a list (or a rule's definition) in place of `parser`,
+     * which refers to a rule through a sequence of just that rule, so the rule stays shared.
+     */
+    [[nodiscard]] auto value_of(const parsi_parser_t* parser) const -> parsi_parser_t
+    {
+        if (is_rule(parser)) {
+            return parsi_combine_sequence_n(const_cast<parsi_parser_t*>(parser), 1, nullptr);
+        }
+        return *parser;
+    }
+
+    auto list_of(parsi_parser_type_enum type, const std::vector<const parsi_parser_t*>& parsers) -> parsi_parser_t*
+    {
+        auto& list = _grammar.lists.emplace_back();
+        list.reserve(parsers.size());
+        for (const parsi_parser_t* parser : parsers) {
+            list.push_back(value_of(parser));
+        }
+        return type == parsi_parser_type_anyof ? &node(parsi_combine_anyof_n(list.data(), list.size(), nullptr))
+                                               : &node(parsi_combine_sequence_n(list.data(), list.size(), nullptr));
+    }
+
+    // expression <- sequence ('/' sequence)*
+    auto parse_expression(std::size_t depth) -> const parsi_parser_t*
+    {
+        if (depth > k_max_nesting) {
+            _error = _pos;
+            return nullptr;
+        }
+
+        std::vector<const parsi_parser_t*> alternatives;
+        do {
+            const parsi_parser_t* sequence = parse_sequence(depth);
+            if (!sequence) {
+                return nullptr;
+            }
+            alternatives.push_back(sequence);
+        } while (consume("/"));
+
+        return alternatives.size() == 1 ? alternatives.front() : list_of(parsi_parser_type_anyof, alternatives);
+    }
+
+    // sequence <- item*
+    auto parse_sequence(std::size_t depth) -> const parsi_parser_t*
+    {
+        std::vector<const parsi_parser_t*> items;
+        while (!at_end() && peek() != '/' && peek() != ')' && !at_rule_start()) {
+            const parsi_parser_t* item = parse_item(depth);
+            if (!item) {
+                return nullptr;
+            }
+            items.push_back(item);
+        }
+
+        return items.size() == 1 ? items.front() : list_of(parsi_parser_type_sequence, items);
+    }
+
+    // item <- primary ('*' / '+' / '?' / '{' m '}' / '{' m ',' '}' / '{' m ',' n '}')*
+    auto parse_item(std::size_t depth) -> const parsi_parser_t*
+    {
+        const parsi_parser_t* item = parse_primary(depth);
+        while (item) {
+            auto* const parser = const_cast<parsi_parser_t*>(item);
+            if (consume("*")) {
+                item = &node(parsi_combine_repeat(parser, 0, SIZE_MAX, nullptr));
+            }
+            else if (consume("+")) {
+                item = &node(parsi_combine_repeat(parser, 1, SIZE_MAX, nullptr));
+            }
+            else if (consume("?")) {
+                item = &node(parsi_combine_optional(parser, nullptr));
+            }
+            else if (peek() == '{') {
+                const std::size_t brace = _pos;
+                consume("{");
+                std::size_t min = 0;
+                std::size_t max = 0;
+                if (!parse_number(min)) {
+                    return nullptr;
+                }
+                max = min;
+                if (consume(",")) {
+                    max = SIZE_MAX;
+                    if (peek() != '}' && !parse_number(max)) {
+                        return nullptr;
+                    }
+                }
+                if (!consume("}") || min > max) {
+                    _error = brace;
+                    return nullptr;
+                }
+                item = &node(parsi_combine_repeat(parser, min, max, nullptr));
+            }
+            else {
+                break;
+            }
+        }
+        return item;
+    }
+
+    auto parse_number(std::size_t& number) noexcept -> bool
+    {
+        const std::size_t start = _pos;
+        number = 0;
+        while (peek() >= '0' && peek() <= '9') {
+            const auto digit = static_cast<std::size_t>(peek() - '0');
+            if (number > (std::numeric_limits<std::size_t>::max() - digit) / 10) {
+                _error = start;
+                return false;
+            }
+            number = number * 10 + digit;
+            ++_pos;
+        }
+        if (_pos == start) {
+            _error = start;
+            return false;
+        }
+        skip_spacing();
+        return true;
+    }
+
+    // primary <- name ':' primary / name / '(' expression ')' / literal / class / '.' / '!.'
+    auto parse_primary(std::size_t depth) -> const parsi_parser_t*
+    {
+        const std::size_t start = _pos;
+        switch (peek()) {
+            case '(': {
+                consume("(");
+                const parsi_parser_t* expression = parse_expression(depth + 1);
+                if (expression && !consume(")")) {
+                    _error = _pos;
+                    return nullptr;
+                }
+                return expression;
+            }
+
+            case '\'':
+            case '"':
+                return parse_literal();
+
+            case '[':
+                return parse_class();
+
+            case '.':
+                consume(".");
+                return &node(parsi_expect_charset(any_byte()));
+
+            case '!':
+                // only the end of input is supported as a predicate.
+                consume("!");
+                if (!consume(".")) {
+                    _error = start;
+                    return nullptr;
+                }
+                return &node(parsi_expect_eos());
+
+            default:
+                break;
+        }
+
+        const std::string_view name = parse_name();
+        if (name.empty()) {
+            _error = start;
+            return nullptr;
+        }
+        if (!consume(":")) {
+            return rule_of(name, start).node;
+        }
+
+        if (depth > k_max_nesting) {
+            _error = start;
+            return nullptr;
+        }
+        const parsi_parser_t* captured = parse_primary(depth + 1);
+        if (!captured) {
+            return nullptr;
+        }
+        parsi_callback_t callback{};
+        if (!bind(name, callback) || (!callback.visit_fn && !callback.visit_ctx_fn)) {
+            _error = start;
+            return nullptr;
+        }
+        parsi_parser_t capture = callback.visit_fn
+                                     ? parsi_combine_extract(const_cast<parsi_parser_t*>(captured), callback.visit_fn,
+                                                             callback.context, nullptr, nullptr)
+                                     : parsi_combine_extract_ctx(const_cast<parsi_parser_t*>(captured),
+                                                                 callback.visit_ctx_fn, callback.context, nullptr,
+                                                                 nullptr);
+        return &node(capture);
+    }
+
+    /** parses a byte of a literal or a class, handling escapes. */
+    auto parse_char(char& chr) noexcept -> bool
+    {
+        if (at_end()) {
+            return false;
+        }
+        chr = _text[_pos++];
+        if (chr != '\\') {
+            return true;
+        }
+        if (at_end()) {
+            return false;
+        }
+        switch (const char escaped = _text[_pos++]) {
+            case 'n': chr = '\n'; return true;
+            case 'r': chr = '\r'; return true;
+            case 't': chr = '\t'; return true;
+            case '0': chr = '\0'; return true;
+            case 'x': {
+                const int high = hex_value_of(peek());
+                const int low = high < 0 ? -1 : hex_value_of(_pos + 1 < _text.size() ? _text[_pos + 1] : '\0');
+                if (low < 0) {
+                    return false;
+                }
+                _pos += 2;
+                chr = static_cast<char>(high * 16 + low);
+                return true;
+            }
+            default:
+                // any other escaped byte stands for itself, such as quotes, brackets or backslashes.
+                chr = escaped;
+                return true;
+        }
+    }
+
+    // literal <- '\'' char* '\'' / '"' char* '"'
+    auto parse_literal() -> const parsi_parser_t*
+    {
+        const std::size_t start = _pos;
+        const char quote = _text[_pos++];
+        std::string& string = _grammar.strings.emplace_back();
+        while (peek() != quote) {
+            char chr = 0;
+            if (!parse_char(chr)) {
+                _error = start;
+                return nullptr;
+            }
+            string.push_back(chr);
+        }
+        consume(std::string_view(&quote, 1));
+
+        if (string.size() == 1) {
+            return &node(parsi_expect_char(string.front()));
+        }
+        // an empty literal matches the empty string, same as an empty sequence.
+        return string.empty() ? &node(parsi_combine_sequence_n(nullptr, 0, nullptr))
+                              : &node(parsi_expect_string(string.data(), string.size(), nullptr));
+    }
+
+    // class <- '[' '^'? (char ('-' char)?)* ']'
+    auto parse_class() -> const parsi_parser_t*
+    {
+        const std::size_t start = _pos;
+        ++_pos;
+        const bool negated = peek() == '^';
+        if (negated) {
+            ++_pos;
+        }
+
+        std::string members;
+        while (peek() != ']') {
+            char first = 0;
+            if (!parse_char(first)) {
+                _error = start;
+                return nullptr;
+            }
+            char last = first;
+            if (peek() == '-' && _pos + 1 < _text.size() && _text[_pos + 1] != ']') {
+                ++_pos;
+                if (!parse_char(last) || static_cast<unsigned char>(last) < static_cast<unsigned char>(first)) {
+                    _error = start;
+                    return nullptr;
+                }
+            }
+            for (unsigned chr = static_cast<unsigned char>(first); chr <= static_cast<unsigned char>(last); ++chr) {
+                members.push_back(static_cast<char>(chr));
+            }
+        }
+        consume("]");
+
+        parsi_charset_t charset = parsi_charset_n(members.data(), members.size());
+        if (negated) {
+            for (std::size_t& word : charset.bitset) {
+                word = ~word;
+            }
+        }
+        return &node(parsi_expect_charset(charset));
+    }
+
+    [[nodiscard]] static auto any_byte() noexcept -> parsi_charset_t
+    {
+        parsi_charset_t charset{};
+        for (std::size_t& word : charset.bitset) {
+            word = ~std::size_t{0};
+        }
+        return charset;
+    }
+
+    auto bind(std::string_view name, parsi_callback_t& callback) -> bool
+    {
+        const std::string name_str(name);
+        return _bind_fn && _bind_fn(_bind_ctx, name_str.c_str(), &callback);
+    }
+
+    /** the rules that are referred to but not defined are custom parsers bound by their name. */
+    auto bind_undefined_rules() -> bool
+    {
+        const Rule* failed = nullptr;
+        for (auto& [name, rule] : _rules) {
+            if (rule.defined) {
+                continue;
+            }
+            parsi_callback_t callback{};
+            if (!bind(name, callback) || (!callback.parse_fn && !callback.parse_ctx_fn)) {
+                // the error is reported at the earliest reference of all the unbound names.
+                if (!failed || rule.first_use < failed->first_use) {
+                    failed = &rule;
+                }
+                continue;
+            }
+            *rule.node = callback.parse_fn ? parsi_custom_parser(callback.parse_fn, callback.context, nullptr)
+                                           : parsi_custom_parser_ctx(callback.parse_ctx_fn, callback.context, nullptr);
+        }
+        if (failed) {
+            _error = failed->first_use;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * a rule that refers to itself again before consuming any input, directly or through other rules,
+     * would never return from a parse, so the error is reported at the first of them to be defined.
+     */
+    auto reject_left_recursion() -> bool
+    {
+        std::vector<const Rule*> defined;
+        for (const auto& [name, rule] : _rules) {
+            if (rule.defined) {
+                defined.push_back(&rule);
+            }
+        }
+        std::sort(defined.begin(), defined.end(),
+                  [](const Rule* lhs, const Rule* rhs) { return lhs->definition < rhs->definition; });
+
+        FirstSetAnalysis analysis;
+        for (const Rule* rule : defined) {
+            static_cast<void>(analysis.first_set_of(rule->node));
+            if (const parsi_parser_t* recursive = analysis.left_recursive()) {
+                const auto iter = std::find_if(defined.begin(), defined.end(),
+                                               [recursive](const Rule* other) { return other->node == recursive; });
+                _error = iter != defined.end() ? (*iter)->definition : rule->definition;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string_view _text;
+    std::size_t _pos = 0;
+    std::size_t _error = 0;
+    parsi_callback_bind_fn_t _bind_fn;
+    void* _bind_ctx;
+    Grammar& _grammar;
+    std::map<std::string, Rule, std::less<>> _rules;
+    std::unordered_set<const parsi_parser_t*> _rule_nodes;
+};
+
+}  // namespace
+
+auto parse_grammar(const char* text, parsi_callback_bind_fn_t bind_fn, void* bind_ctx, Grammar& grammar,
+                   std::size_t& error_offset) -> bool
+{
+    GrammarParser parser(text ? std::string_view(text) : std::string_view(), bind_fn, bind_ctx, grammar);
+    return parser.parse(error_offset);
+}
+
+}  // namespace parsi::internal
@@ -0,0 +1,37 @@
+#ifndef PARSI_SRC_GRAMMAR_HPP
+#define PARSI_SRC_GRAMMAR_HPP
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "parsi/parsi-c.h"
+
+namespace parsi::internal {
+
+/**
+ * The parser tree of a grammar's text, owning all of its nodes and strings.
+ *
+ * Every rule is a node of its own that its references point to,
+ * so the compiler emits each rule once no matter how often it's referred to.
+ */
+struct Grammar {
+    std::deque<parsi_parser_t> nodes;
+    std::deque<std::vector<parsi_parser_t>> lists;
+    std::deque<std::string> strings;
+    const parsi_parser_t* root = nullptr;  // the first rule
+};
+
+/**
+ * parses the PEG `text` (see `parsi_compile_grammar`) into `grammar`,
+ * with the captures and the custom parsers bound by name through `bind_fn`.
+ * returns false with the offset of the offending text in `error_offset`
+ * on a syntax error, a name that couldn't be bound or a left recursive rule.
+ */
+[[nodiscard]] auto parse_grammar(const char* text, parsi_callback_bind_fn_t bind_fn, void* bind_ctx, Grammar& grammar,
+                                 std::size_t& error_offset) -> bool;
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_GRAMMAR_HPP
@@ -0,0 +1,1030 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "memo.hpp"
+#include "program.hpp"
+#include "scan.hpp"
+#include "trie.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PARSI_HAS_COMPUTED_GOTO 1
+#else
+#define PARSI_HAS_COMPUTED_GOTO 0
+#endif
+
+namespace parsi::internal {
+
+namespace {
+
+/**
+ * A pending combinator whose child is being run,
+ * resumed once the child's result is known.
+ */
+struct Frame {
+    std::size_t pc;
+    std::size_t child;
+    std::size_t count;
+    parsi_stream_t stream;
+    const void* resume = nullptr;  // resume label in threaded dispatch
+};
+
+/**
+ * The heap block of frames kept by each thread between parses,
+ * so parses of deeply nested inputs don't allocate every time.
+ */
+struct FramePool {
+    Frame* frames = nullptr;
+    std::size_t capacity = 0;
+
+    ~FramePool()
+    {
+        std::free(frames);
+    }
+};
+
+thread_local FramePool t_frame_pool;
+
+/**
+ * Stack of pending frames that starts on the native stack
+ * and moves to the heap (the thread's pooled block if it's large enough)
+ * only for deeply nested grammars, or that lives in a caller's buffer without ever growing.
+ * pushing more than `limit` frames fails.
+ */
+class FrameStack {
+    static constexpr std::size_t k_inline_capacity = 32;
+
+public:
+    explicit FrameStack(std::size_t limit = SIZE_MAX) noexcept
+        : _capacity(std::min(k_inline_capacity, limit))
+        , _limit(limit)
+    {
+    }
+
+    FrameStack(void* buffer, std::size_t size, std::size_t limit) noexcept
+        : _limit(limit)
+        , _growable(false)
+    {
+        if (std::align(alignof(Frame), sizeof(Frame), buffer, size)) {
+            _frames = static_cast<Frame*>(buffer);
+            _capacity = std::min(size / sizeof(Frame), limit);
+        }
+        else {
+            _capacity = 0;
+        }
+    }
+
+    FrameStack(const FrameStack&) = delete;
+    FrameStack& operator=(const FrameStack&) = delete;
+
+    ~FrameStack()
+    {
+        release();
+    }
+
+    [[nodiscard]] auto empty() const noexcept -> bool
+    {
+        return _size == 0;
+    }
+
+    [[nodiscard]] auto top() noexcept -> Frame&
+    {
+        return _frames[_size - 1];
+    }
+
+    [[nodiscard]] auto begin() noexcept -> Frame*
+    {
+        return _frames;
+    }
+
+    [[nodiscard]] auto end() noexcept -> Frame*
+    {
+        return _frames + _size;
+    }
+
+    [[nodiscard]] auto push(Frame frame) noexcept -> bool
+    {
+        if (_size == _capacity) [[unlikely]] {
+            if (!grow()) {
+                return false;
+            }
+        }
+        _frames[_size++] = frame;
+        return true;
+    }
+
+    void pop() noexcept
+    {
+        --_size;
+    }
+
+    void clear() noexcept
+    {
+        _size = 0;
+    }
+
+private:
+    [[nodiscard]] auto on_heap() const noexcept -> bool
+    {
+        return _growable && _frames != _inline_frames;
+    }
+
+    // kept out of line, inlined into `push` it bloats the interpreter loop.
+    [[gnu::noinline]] auto grow() noexcept -> bool
+    {
+        if (!_growable || _capacity >= _limit) {
+            return false;
+        }
+
+        const std::size_t capacity = _capacity <= _limit / 2 ? _capacity * 2 : _limit;
+        std::size_t block_capacity = capacity;
+        Frame* frames = nullptr;
+        if (t_frame_pool.capacity >= capacity) {
+            frames = std::exchange(t_frame_pool.frames, nullptr);
+            block_capacity = std::exchange(t_frame_pool.capacity, 0);
+        }
+        else {
+            frames = static_cast<Frame*>(std::malloc(capacity * sizeof(Frame)));
+            if (!frames) {
+                return false;
+            }
+        }
+
+        std::memcpy(frames, _frames, _size * sizeof(Frame));
+        release();
+        _frames = frames;
+        _capacity = std::min(block_capacity, _limit);
+        _block_capacity = block_capacity;
+        return true;
+    }
+
+    /** hands the heap block over to the thread's pool, keeping the larger of the two. */
+    void release() noexcept
+    {
+        if (!on_heap()) {
+            return;
+        }
+        if (t_frame_pool.capacity < _block_capacity) {
+            std::free(t_frame_pool.frames);
+            t_frame_pool.frames = _frames;
+            t_frame_pool.capacity = _block_capacity;
+        }
+        else {
+            std::free(_frames);
+        }
+    }
+
+    Frame _inline_frames[k_inline_capacity];
+    Frame* _frames = _inline_frames;
+    std::size_t _size = 0;
+    std::size_t _capacity;
+    std::size_t _block_capacity = 0;  // of the heap block, which may exceed the limit when pooled
+    std::size_t _limit;
+    bool _growable = true;
+};
+
+/** the cpu's timestamp counter where available, zero otherwise. */
+inline auto read_cycle_counter() noexcept -> std::uint64_t
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * The spans captured so far in a parse, in the order they were captured,
+ * with a mark for each pending anyof, repeat and optional at the captures its current alternative
+ * (or iteration) started from, to drop what that captured when it fails.
+ * so once the parse is done, only the captures on its successful path are left.
+ */
+class Captures {
+    struct Entry {
+        std::size_t slot;
+        parsi_span_t span;
+    };
+
+public:
+    Captures(const char* input, std::size_t count) noexcept
+        : _input(input)
+        , _count(count)
+    {
+    }
+
+    void mark() noexcept
+    {
+        if (_failed) {
+            return;
+        }
+        try {
+            _marks.push_back(_entries.size());
+        }
+        catch (const std::bad_alloc&) {
+            _failed = true;
+        }
+    }
+
+    /** moves the innermost mark past the captures so far, as the alternative (or iteration) succeeded. */
+    void remark() noexcept
+    {
+        if (!_failed) {
+            _marks.back() = _entries.size();
+        }
+    }
+
+    /** drops the captures since the innermost mark, as the alternative (or iteration) failed. */
+    void rewind() noexcept
+    {
+        if (!_failed) {
+            _entries.erase(_entries.begin() + static_cast<std::ptrdiff_t>(_marks.back()), _entries.end());
+        }
+    }
+
+    void unmark() noexcept
+    {
+        if (!_failed) {
+            _marks.pop_back();
+        }
+    }
+
+    void capture(std::size_t slot, parsi_stream_t begin, parsi_stream_t end) noexcept
+    {
+        if (_failed || slot >= _count) {
+            return;
+        }
+        try {
+            _entries.push_back(Entry{
+                .slot = slot,
+                .span = { .offset = static_cast<std::size_t>(begin.cursor - _input), .length = begin.size - end.size },
+            });
+        }
+        catch (const std::bad_alloc&) {
+            _failed = true;
+        }
+    }
+
+    /** whether a capture was lost for lack of memory. */
+    [[nodiscard]] auto failed() const noexcept -> bool
+    {
+        return _failed;
+    }
+
+    /** fills the slots with the captures, the last one of each slot winning. */
+    void fill(parsi_span_t* slots) const noexcept
+    {
+        for (const Entry& entry : _entries) {
+            slots[entry.slot] = entry.span;
+        }
+    }
+
+private:
+    const char* _input;
+    std::size_t _count;
+    std::vector<Entry> _entries;
+    std::vector<std::size_t> _marks;
+    bool _failed = false;
+};
+
+/** where a streaming parse stopped for more input. */
+struct Suspension {
+    std::size_t pc = 0;        // of the instruction that ran out of input
+    parsi_stream_t stream{};   // the instruction's input
+    std::size_t scanned = 0;   // bytes already matched by a suspended scan instruction
+    bool final = false;        // no more input follows what's been fed
+    bool suspended = false;
+};
+
+constexpr auto advanced(parsi_stream_t stream, std::size_t count) noexcept -> parsi_stream_t
+{
+    return parsi_stream_t{ .cursor = stream.cursor + count, .size = stream.size - count };
+}
+
+// the interpreter body is shared between switch and threaded dispatch.
+// with threaded dispatch, every handler jumps straight to the next handler
+// through the label address stored for the instruction (or in the frame when resuming),
+// instead of going back through the central switches.
+#if PARSI_HAS_COMPUTED_GOTO
+#define PARSI_UNUSED_LABEL __attribute__((unused))
+#define PARSI_LABEL(name) name: PARSI_UNUSED_LABEL;
+#define PARSI_ENTER()                  \
+    do {                               \
+        if constexpr (ThreadedV) {     \
+            goto* threaded_code[pc];   \
+        }                              \
+        else {                         \
+            goto enter;                \
+        }                              \
+    } while (false)
+#define PARSI_LEAVE()                  \
+    do {                               \
+        if constexpr (ThreadedV) {     \
+            if (stack.empty()) {       \
+                return result;         \
+            }                          \
+            goto* stack.top().resume;  \
+        }                              \
+        else {                         \
+            goto leave;                \
+        }                              \
+    } while (false)
+// label addresses must only be taken in threaded dispatch, as they pessimize switch dispatch.
+#define PARSI_RESUME_INIT(name) .resume = &&name
+#else
+#define PARSI_UNUSED_LABEL
+#define PARSI_LABEL(name)
+#define PARSI_ENTER() goto enter
+#define PARSI_LEAVE() goto leave
+#define PARSI_RESUME_INIT(name) .resume = nullptr
+#endif
+
+// in a streaming parse, stops at the current instruction to be run again once more input is fed,
+// when the result depends on input that isn't there yet.
+#define PARSI_SUSPEND_IF(condition, scanned_count)                                         \
+    do {                                                                                   \
+        if constexpr (StreamingV) {                                                        \
+            if (!suspension->final && (condition)) {                                       \
+                *suspension = Suspension{ .pc = pc, .stream = stream, .scanned = (scanned_count),  \
+                                          .final = false, .suspended = true };             \
+                return parsi_result_t{ .is_valid = false, .stream = stream };              \
+            }                                                                              \
+        }                                                                                  \
+    } while (false)
+
+#define PARSI_PUSH_AND_ENTER(resume_label, child_pc, initial_count)                        \
+    do {                                                                                   \
+        const std::size_t child = (child_pc);                                              \
+        bool pushed = false;                                                               \
+        if constexpr (ThreadedV) {                                                         \
+            pushed = stack.push(Frame{ .pc = pc, .child = child, .count = (initial_count), .stream = stream,  \
+                                       PARSI_RESUME_INIT(resume_label) });                 \
+        }                                                                                  \
+        else {                                                                             \
+            pushed = stack.push(Frame{ .pc = pc, .child = child, .count = (initial_count), .stream = stream });  \
+        }                                                                                  \
+        if (!pushed) [[unlikely]] {                                                        \
+            return parsi_result_t{ .is_valid = false, .stream = stream };                  \
+        }                                                                                  \
+        pc = child;                                                                        \
+        PARSI_ENTER();                                                                     \
+    } while (false)
+
+/**
+ * runs the `program` with the frames on `stack` and results of `memo_call`s cached in `memo` (if any),
+ * handing `call_ctx` to the callbacks taking one,
+ * or when `labels` is given, only hands out the threaded dispatch label of each opcode's handler (indexed by opcode).
+ * a streaming run resumes from `suspension` on the frames left on `stack`, instead of starting over on `stream`,
+ * and may be suspended again (with the result not known yet) unless its input is final.
+ * capture instructions record their spans into `captures`, if any, and only match otherwise.
+ */
+template <bool ThreadedV, bool StreamingV = false>
+auto run(const Program& program, parsi_stream_t stream, FrameStack& stack, void* call_ctx = nullptr,
+         MemoTable* memo = nullptr, const void* const** labels = nullptr, Suspension* suspension = nullptr,
+         Captures* captures = nullptr) noexcept -> parsi_result_t
+{
+#if PARSI_HAS_COMPUTED_GOTO
+    if constexpr (ThreadedV) {
+        static const void* const k_labels[k_opcode_count] = {
+            &&enter_fail, &&enter_custom, &&enter_eos, &&enter_byte,
+            &&enter_charset, &&enter_string, &&enter_extract, &&enter_sequence,
+            &&enter_anyof, &&enter_repeat, &&enter_optional, &&enter_call,
+            &&enter_scan, &&enter_scan, &&enter_scan, &&enter_memo_call,
+            &&enter_dispatch, &&enter_profile, &&enter_trie, &&enter_capture,
+        };
+        if (labels) {
+            *labels = k_labels;
+            return parsi_result_t{ .is_valid = false, .stream = stream };
+        }
+    }
+    const void* const* const threaded_code = program.threaded_code.data();
+#else
+    (void)labels;
+#endif
+
+    const Word* const code = program.code.data();
+    const Callback* const callbacks = program.callbacks.data();
+
+    std::size_t pc = 0;
+    parsi_result_t result;
+    if constexpr (StreamingV) {
+        pc = suspension->pc;
+        stream = suspension->stream;
+    }
+    else {
+        (void)suspension;
+        stack.clear();
+    }
+
+    PARSI_ENTER();
+
+    // runs the instruction at `pc` on `stream`, and either finishes with `result`
+    // or pushes a frame and descends into the instruction's first child.
+enter: PARSI_UNUSED_LABEL;
+    switch (opcode_of(code, pc)) {
+        case Opcode::fail:
+        PARSI_LABEL(enter_fail)
+            result = parsi_result_t{ .is_valid = false, .stream = stream };
+            PARSI_LEAVE();
+
+        case Opcode::custom: {
+        PARSI_LABEL(enter_custom)
+            const Callback& callback = callbacks[code[pc + k_header_size]];
+            result = callback.parse_fn ? callback.parse_fn(callback.context, stream)
+                                       : callback.parse_ctx_fn(callback.context, call_ctx, stream);
+            PARSI_SUSPEND_IF(result.stream.size == 0, 0);
+            PARSI_LEAVE();
+        }
+
+        case Opcode::eos:
+        PARSI_LABEL(enter_eos)
+            PARSI_SUSPEND_IF(stream.size == 0, 0);
+            result = parsi_result_t{ .is_valid = (stream.size == 0), .stream = stream };
+            PARSI_LEAVE();
+
+        case Opcode::byte:
+        PARSI_LABEL(enter_byte)
+            if (stream.size >= 1 && static_cast<unsigned char>(*stream.cursor) == immediate_of(code, pc)) {
+                result = parsi_result_t{ .is_valid = true, .stream = advanced(stream, 1) };
+                PARSI_LEAVE();
+            }
+            PARSI_SUSPEND_IF(stream.size == 0, 0);
+            result = parsi_result_t{ .is_valid = false, .stream = stream };
+            PARSI_LEAVE();
+
+        case Opcode::charset:
+        PARSI_LABEL(enter_charset)
+            if (stream.size >= 1 && charset_contains(&code[pc + k_header_size], static_cast<unsigned char>(*stream.cursor))) {
+                result = parsi_result_t{ .is_valid = true, .stream = advanced(stream, 1) };
+                PARSI_LEAVE();
+            }
+            PARSI_SUSPEND_IF(stream.size == 0, 0);
+            result = parsi_result_t{ .is_valid = false, .stream = stream };
+            PARSI_LEAVE();
+
+        case Opcode::string: {
+        PARSI_LABEL(enter_string)
+            const std::size_t size = code[pc + k_header_size];
+            if (stream.size >= size && std::memcmp(stream.cursor, string_bytes_of(code, pc), size) == 0) {
+                result = parsi_result_t{ .is_valid = true, .stream = advanced(stream, size) };
+                PARSI_LEAVE();
+            }
+            // a prefix of the string at the end of the input may be completed by the next chunk.
+            PARSI_SUSPEND_IF(stream.size < size
+                                 && (stream.size == 0 || std::memcmp(stream.cursor, string_bytes_of(code, pc), stream.size) == 0),
+                             0);
+            result = parsi_result_t{
+                .is_valid = false,
+                .stream = immediate_of(code, pc) == 0
+                            ? stream
+                            : advanced(stream, matched_literals_of(&code[pc], stream.cursor, stream.cursor + stream.size)),
+            };
+            PARSI_LEAVE();
+        }
+
+        case Opcode::sequence:
+        PARSI_LABEL(enter_sequence)
+            if (length_of(code, pc) == operands_end_of(Opcode::sequence)) {
+                // no children: an empty sequence succeeds.
+                result = parsi_result_t{ .is_valid = true, .stream = stream };
+                PARSI_LEAVE();
+            }
+            PARSI_PUSH_AND_ENTER(resume_sequence, first_child_of(code, pc), 0);
+
+        case Opcode::anyof:
+        PARSI_LABEL(enter_anyof)
+            if (length_of(code, pc) == operands_end_of(Opcode::anyof)) {
+                // no children: an empty anyof fails.
+                result = parsi_result_t{ .is_valid = false, .stream = stream };
+                PARSI_LEAVE();
+            }
+            if (captures) {
+                captures->mark();
+            }
+            PARSI_PUSH_AND_ENTER(resume_anyof, first_child_of(code, pc), 0);
+
+        case Opcode::extract:
+        PARSI_LABEL(enter_extract)
+            PARSI_PUSH_AND_ENTER(resume_extract, first_child_of(code, pc), 0);
+
+        case Opcode::repeat:
+        PARSI_LABEL(enter_repeat)
+            if (captures) {
+                captures->mark();
+            }
+            PARSI_PUSH_AND_ENTER(resume_repeat, first_child_of(code, pc), 0);
+
+        case Opcode::optional:
+        PARSI_LABEL(enter_optional)
+            if (captures) {
+                captures->mark();
+            }
+            PARSI_PUSH_AND_ENTER(resume_optional, first_child_of(code, pc), 0);
+
+        case Opcode::capture:
+        PARSI_LABEL(enter_capture)
+            PARSI_PUSH_AND_ENTER(resume_capture, first_child_of(code, pc), 0);
+
+        case Opcode::call:
+        PARSI_LABEL(enter_call)
+            pc = code[pc + k_header_size];
+            PARSI_ENTER();
+
+        case Opcode::repeat_byte:
+        case Opcode::repeat_not_byte:
+        case Opcode::repeat_charset:
+        PARSI_LABEL(enter_scan)
+            if constexpr (StreamingV) {
+                result = run_scan(code, pc, stream, std::exchange(suspension->scanned, 0));
+                // a run up to the end of the input goes on in the next chunk, unless it's past the max already.
+                PARSI_SUSPEND_IF(result.stream.size == 0 && stream.size <= size_operand_of(code, pc + k_header_size + 2),
+                                 stream.size);
+            }
+            else {
+                result = run_scan(code, pc, stream);
+            }
+            PARSI_LEAVE();
+
+        case Opcode::memo_call:
+        PARSI_LABEL(enter_memo_call)
+            if (memo) {
+                if (memo->lookup(immediate_of(code, pc), stream, result)) {
+                    PARSI_LEAVE();
+                }
+                PARSI_PUSH_AND_ENTER(resume_memo_call, code[pc + k_header_size], 0);
+            }
+            pc = code[pc + k_header_size];
+            PARSI_ENTER();
+
+        case Opcode::dispatch: {
+        PARSI_LABEL(enter_dispatch)
+            // the child is an anyof of the candidates, so it takes over the result.
+            PARSI_SUSPEND_IF(stream.size == 0, 0);
+            const std::size_t next = stream.size != 0 ? static_cast<unsigned char>(*stream.cursor) : 256;
+            const Word offset = code[pc + k_header_size + next];
+            if (offset == 0) {
+                result = parsi_result_t{ .is_valid = false, .stream = stream };
+                PARSI_LEAVE();
+            }
+            pc += offset;
+            PARSI_ENTER();
+        }
+
+        case Opcode::profile:
+        PARSI_LABEL(enter_profile)
+            // the cycles of a node include those of its descendants.
+            PARSI_PUSH_AND_ENTER(resume_profile, first_child_of(code, pc),
+                                 immediate_of(code, pc) != 0 ? read_cycle_counter() : 0);
+
+        case Opcode::trie: {
+        PARSI_LABEL(enter_trie)
+            bool incomplete = false;
+            const std::size_t size = match_trie(&code[pc], stream.cursor, stream.cursor + stream.size, &incomplete);
+            // more input may complete an earlier literal than the one matched, if any.
+            PARSI_SUSPEND_IF(incomplete, 0);
+            if (size != k_trie_mismatch) {
+                result = parsi_result_t{ .is_valid = true, .stream = advanced(stream, size) };
+                PARSI_LEAVE();
+            }
+            result = parsi_result_t{ .is_valid = false, .stream = stream };
+            PARSI_LEAVE();
+        }
+    }
+
+    // this should be unreachable.
+    return parsi_result_t{ .is_valid = false, .stream = stream };
+
+    // hands `result` over to the innermost pending combinator, if any.
+leave: PARSI_UNUSED_LABEL;
+    if (stack.empty()) {
+        return result;
+    }
+
+    switch (opcode_of(code, stack.top().pc)) {
+        case Opcode::sequence: {
+        PARSI_LABEL(resume_sequence)
+            Frame& frame = stack.top();
+            if (result.is_valid) {
+                frame.child += length_of(code, frame.child);
+                if (frame.child != end_of(code, frame.pc)) {
+                    pc = frame.child;
+                    stream = result.stream;
+                    PARSI_ENTER();
+                }
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::anyof: {
+        PARSI_LABEL(resume_anyof)
+            Frame& frame = stack.top();
+            if (!result.is_valid) {
+                if (captures) {
+                    captures->rewind();
+                }
+                frame.child += length_of(code, frame.child);
+                if (frame.child != end_of(code, frame.pc)) {
+                    pc = frame.child;
+                    stream = frame.stream;
+                    PARSI_ENTER();
+                }
+                result = parsi_result_t{ .is_valid = false, .stream = frame.stream };
+            }
+            if (captures) {
+                captures->unmark();
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::repeat: {
+        PARSI_LABEL(resume_repeat)
+            Frame& frame = stack.top();
+            const std::size_t min = size_operand_of(code, frame.pc + k_header_size);
+            const std::size_t max = size_operand_of(code, frame.pc + k_header_size + 2);
+            if (result.is_valid) {
+                if (++frame.count <= max) [[likely]] {
+                    if (captures) {
+                        captures->remark();
+                    }
+                    frame.stream = result.stream;
+                    pc = frame.child;
+                    stream = result.stream;
+                    PARSI_ENTER();
+                }
+                result.is_valid = false;
+            }
+            else if (frame.count < min) {
+                result.is_valid = false;
+            }
+            else {
+                if (captures) {
+                    captures->rewind();
+                }
+                result = parsi_result_t{ .is_valid = true, .stream = frame.stream };
+            }
+            if (captures) {
+                captures->unmark();
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::optional: {
+        PARSI_LABEL(resume_optional)
+            const Frame& frame = stack.top();
+            if (!result.is_valid) {
+                if (captures) {
+                    captures->rewind();
+                }
+                result = parsi_result_t{ .is_valid = true, .stream = frame.stream };
+            }
+            if (captures) {
+                captures->unmark();
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::capture: {
+        PARSI_LABEL(resume_capture)
+            const Frame& frame = stack.top();
+            if (result.is_valid && captures) {
+                captures->capture(size_operand_of(code, frame.pc + k_header_size), frame.stream, result.stream);
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::extract: {
+        PARSI_LABEL(resume_extract)
+            const Frame& frame = stack.top();
+            if (result.is_valid) {
+                const Callback& callback = callbacks[code[frame.pc + k_header_size]];
+                const std::size_t size = frame.stream.size - result.stream.size;
+                result.is_valid = callback.visit_fn
+                                    ? callback.visit_fn(callback.context, frame.stream.cursor, size)
+                                    : callback.visit_ctx_fn(callback.context, call_ctx, frame.stream.cursor, size);
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::memo_call: {
+        PARSI_LABEL(resume_memo_call)
+            const Frame& frame = stack.top();
+            memo->store(immediate_of(code, frame.pc), frame.stream, result);
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        case Opcode::profile: {
+        PARSI_LABEL(resume_profile)
+            const Frame& frame = stack.top();
+            ProfileCounters& counters = program.profile_counters[code[frame.pc + k_header_size]];
+            counters.invocations.fetch_add(1, std::memory_order_relaxed);
+            if (result.is_valid) {
+                counters.successes.fetch_add(1, std::memory_order_relaxed);
+                counters.consumed.fetch_add(frame.stream.size - result.stream.size, std::memory_order_relaxed);
+            }
+            if (immediate_of(code, frame.pc) != 0) {
+                counters.cycles.fetch_add(read_cycle_counter() - frame.count, std::memory_order_relaxed);
+            }
+            stack.pop();
+            PARSI_LEAVE();
+        }
+
+        default:
+            // only combinators, memo calls and profiled nodes push frames.
+            break;
+    }
+
+    return parsi_result_t{ .is_valid = false, .stream = result.stream };
+}
+
+#undef PARSI_PUSH_AND_ENTER
+#undef PARSI_SUSPEND_IF
+#undef PARSI_RESUME_INIT
+#undef PARSI_LEAVE
+#undef PARSI_ENTER
+#undef PARSI_LABEL
+#undef PARSI_UNUSED_LABEL
+
+}  // namespace
+
+auto thread_program(Program& program) -> bool
+{
+#if PARSI_HAS_COMPUTED_GOTO
+    const void* const* labels = nullptr;
+    FrameStack stack;
+    (void)run<true>(program, parsi_stream_t{}, stack, nullptr, nullptr, &labels);
+
+    // every instruction's header gets the address of its handler,
+    // the rest of the words (operands) are left unused.
+    program.threaded_code.assign(program.code.size(), nullptr);
+    const Word* const code = program.code.data();
+    for (std::size_t pc = 0; pc < program.code.size();) {
+        const Opcode opcode = opcode_of(code, pc);
+        program.threaded_code[pc] = labels[static_cast<std::size_t>(opcode)];
+        pc += is_composite(opcode) ? operands_end_of(opcode) : length_of(code, pc);
+    }
+    return true;
+#else
+    (void)program;
+    return false;
+#endif
+}
+
+namespace {
+
+[[nodiscard]] auto depth_limit_of(const Program& program) noexcept -> std::size_t
+{
+    return program.max_depth != 0 ? program.max_depth : SIZE_MAX;
+}
+
+/** runs the program with a memo table for the input, if the program has memo calls. */
+template <bool ThreadedV>
+auto run_memoized(const Program& program, parsi_stream_t stream, FrameStack& stack, void* call_ctx = nullptr,
+                  Captures* captures = nullptr) noexcept -> parsi_result_t
+{
+    if (program.memo_slots == 0) {
+        return run<ThreadedV>(program, stream, stack, call_ctx, nullptr, nullptr, nullptr, captures);
+    }
+    MemoTable memo(program, stream);
+    return run<ThreadedV>(program, stream, stack, call_ctx, memo.enabled() ? &memo : nullptr, nullptr, nullptr,
+                          captures);
+}
+
+}  // namespace
+
+auto run_program(const Program& program, parsi_stream_t stream, void* call_ctx) noexcept -> parsi_result_t
+{
+    FrameStack stack(depth_limit_of(program));
+    if (!program.threaded_code.empty()) {
+        return run_memoized<true>(program, stream, stack, call_ctx);
+    }
+    return run_memoized<false>(program, stream, stack, call_ctx);
+}
+
+auto run_program_with_stack(const Program& program, parsi_stream_t stream, void* buffer, std::size_t size) noexcept
+    -> parsi_result_t
+{
+    FrameStack stack(buffer, size, depth_limit_of(program));
+    if (!program.threaded_code.empty()) {
+        return run_memoized<true>(program, stream, stack);
+    }
+    return run_memoized<false>(program, stream, stack);
+}
+
+auto run_program_captures(const Program& program, parsi_stream_t stream, parsi_span_t* slots,
+                          std::size_t count) noexcept -> parsi_result_t
+{
+    if (!slots) {
+        count = 0;
+    }
+    std::fill_n(slots, count, parsi_span_t{ .offset = SIZE_MAX, .length = 0 });
+
+    Captures captures(stream.cursor, count);
+    FrameStack stack(depth_limit_of(program));
+    const parsi_result_t result = !program.threaded_code.empty()
+                                    ? run_memoized<true>(program, stream, stack, nullptr, &captures)
+                                    : run_memoized<false>(program, stream, stack, nullptr, &captures);
+    if (!result.is_valid) {
+        return result;
+    }
+    if (captures.failed()) [[unlikely]] {
+        return parsi_result_t{ .is_valid = false, .stream = stream };
+    }
+    captures.fill(slots);
+    return result;
+}
+
+auto frame_size() noexcept -> std::size_t
+{
+    return sizeof(Frame);
+}
+
+namespace {
+
+template <bool ThreadedV>
+void run_many(const Program& program, const parsi_stream_t* inputs, parsi_result_t* outputs, std::size_t count) noexcept
+{
+    // the frame stack (and whatever it grew into) is reused across the inputs.
+    FrameStack stack(depth_limit_of(program));
+    for (std::size_t index = 0; index < count; ++index) {
+        if (index + 1 < count) {
+            prefetch(inputs[index + 1].cursor);
+        }
+        outputs[index] = run_memoized<ThreadedV>(program, inputs[index], stack);
+    }
+}
+
+}  // namespace
+
+void run_program_many(const Program& program, const parsi_stream_t* inputs, parsi_result_t* outputs,
+                      std::size_t count) noexcept
+{
+    if (!program.threaded_code.empty()) {
+        run_many<true>(program, inputs, outputs, count);
+    }
+    else {
+        run_many<false>(program, inputs, outputs, count);
+    }
+}
+
+}  // namespace parsi::internal
+
+/**
+ * A parse of input fed in chunks.
+ *
+ * The input is kept from the earliest position a pending combinator may go back to,
+ * so the buffer only spans what's still needed, and the frames (and the suspended instruction)
+ * are moved over to it with every chunk.
+ */
+struct parsi_stream_state {
+    parsi_stream_state(const parsi::internal::Program& program, void* call_ctx) noexcept
+        : program(program)
+        , call_ctx(call_ctx)
+        , stack(parsi::internal::depth_limit_of(program))
+    {
+    }
+
+    const parsi::internal::Program& program;
+    void* call_ctx;
+    parsi::internal::FrameStack stack;
+    parsi::internal::Suspension suspension;
+    std::unique_ptr<char[]> buffer;
+    std::size_t size = 0;
+    std::size_t capacity = 0;
+    std::size_t released = 0;  // bytes of input dropped before the buffer
+    parsi_stream_status_enum status = parsi_stream_status_need_more;
+    std::size_t position = 0;  // where the parse stopped once it's finished
+};
+
+namespace parsi::internal {
+
+namespace {
+
+constexpr std::size_t k_min_stream_capacity = 4096;
+
+/** whether the frame's combinator may go back to its stream, which then has to be kept. */
+[[nodiscard]] auto reads_back(const Word* code, const Frame& frame) noexcept -> bool
+{
+    switch (opcode_of(code, frame.pc)) {
+        case Opcode::anyof:
+        case Opcode::repeat:
+        case Opcode::optional:
+        case Opcode::extract:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** drops the input nothing may go back to anymore, and appends the chunk after the rest. */
+void append_chunk(parsi_stream_state& state, parsi_stream_t chunk)
+{
+    char* const base = state.buffer.get();
+    std::size_t keep = static_cast<std::size_t>(state.suspension.stream.cursor - base);
+    for (const Frame& frame : state.stack) {
+        if (reads_back(state.program.code.data(), frame)) {
+            keep = std::min(keep, static_cast<std::size_t>(frame.stream.cursor - base));
+        }
+    }
+
+    const std::size_t kept = state.size - keep;
+    std::unique_ptr<char[]> grown;
+    char* target = base;
+    if (kept + chunk.size > state.capacity) {
+        const std::size_t capacity = std::max({ state.capacity * 2, kept + chunk.size, k_min_stream_capacity });
+        grown.reset(new char[capacity]);
+        target = grown.get();
+        state.capacity = capacity;
+    }
+    if (kept != 0) {
+        std::memmove(target, base + keep, kept);
+    }
+    std::memcpy(target + kept, chunk.cursor, chunk.size);
+
+    // the streams all run to the end of the input, which is now further away.
+    // streams before the kept part are only those of sequences and profiled nodes, which don't read them.
+    const auto moved = [&](parsi_stream_t stream) {
+        const auto offset = static_cast<std::size_t>(stream.cursor - base);
+        return parsi_stream_t{ .cursor = target + (std::max(offset, keep) - keep), .size = stream.size + chunk.size };
+    };
+    for (Frame& frame : state.stack) {
+        frame.stream = moved(frame.stream);
+    }
+    state.suspension.stream = moved(state.suspension.stream);
+
+    if (grown) {
+        state.buffer = std::move(grown);
+    }
+    state.size = kept + chunk.size;
+    state.released += keep;
+}
+
+void finish_stream(parsi_stream_state& state, bool is_valid, const char* cursor) noexcept
+{
+    state.status = is_valid ? parsi_stream_status_valid : parsi_stream_status_invalid;
+    state.position = state.released + static_cast<std::size_t>(cursor - state.buffer.get());
+}
+
+auto resume_stream(parsi_stream_state& state) noexcept -> parsi_stream_status_enum
+{
+    state.suspension.suspended = false;
+    const parsi_result_t result = run<false, true>(state.program, state.suspension.stream, state.stack,
+                                                   state.call_ctx, nullptr, nullptr, &state.suspension);
+    if (!state.suspension.suspended) {
+        finish_stream(state, result.is_valid, result.stream.cursor);
+    }
+    return state.status;
+}
+
+}  // namespace
+
+auto begin_stream(const Program& program, void* call_ctx) noexcept -> parsi_stream_state_t*
+{
+    return new (std::nothrow) parsi_stream_state(program, call_ctx);
+}
+
+auto feed_stream(parsi_stream_state_t& state, parsi_stream_t chunk) noexcept -> parsi_stream_status_enum
+{
+    if (state.status != parsi_stream_status_need_more || chunk.size == 0) {
+        return state.status;
+    }
+    try {
+        append_chunk(state, chunk);
+    }
+    catch (const std::bad_alloc&) {
+        finish_stream(state, false, state.suspension.stream.cursor);
+        return state.status;
+    }
+    return resume_stream(state);
+}
+
+auto end_stream(parsi_stream_state_t* state, std::size_t& position) noexcept -> parsi_stream_status_enum
+{
+    if (state->status == parsi_stream_status_need_more) {
+        state->suspension.final = true;
+        (void)resume_stream(*state);
+    }
+    const parsi_stream_status_enum status = state->status;
+    position = state->position;
+    delete state;
+    return status;
+}
+
+}  // namespace parsi::internal
@@ -0,0 +1,950 @@
+#include "jit.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "scan.hpp"
+#include "trie.hpp"
+
+#if PARSI_HAS_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace parsi::internal {
+
+#if PARSI_HAS_JIT
+
+namespace {
+
+enum Reg : std::uint8_t {
+    rax = 0, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+enum Cond : std::uint8_t {
+    cond_b = 0x2,   // below (unsigned), carry set
+    cond_ae = 0x3,  // above or equal (unsigned), carry clear
+    cond_e = 0x4,
+    cond_ne = 0x5,
+    cond_be = 0x6,
+    cond_a = 0x7,
+};
+
+/**
+ * A minimal x86-64 assembler for the few instructions the code generator needs.
+ * all jumps are rel32 and patched once their labels are bound.
+ */
+class Assembler {
+public:
+    using Label = std::size_t;
+
+    [[nodiscard]] auto bytes() const noexcept -> const std::vector<std::uint8_t>&
+    {
+        return _bytes;
+    }
+
+    [[nodiscard]] auto new_label() -> Label
+    {
+        _labels.push_back(k_unbound);
+        return _labels.size() - 1;
+    }
+
+    void bind(Label label)
+    {
+        _labels[label] = _bytes.size();
+    }
+
+    void jmp(Label label)
+    {
+        byte(0xE9);
+        rel32(label);
+    }
+
+    void jcc(Cond cond, Label label)
+    {
+        byte(0x0F);
+        byte(0x80 | cond);
+        rel32(label);
+    }
+
+    void call(Label label)
+    {
+        byte(0xE8);
+        rel32(label);
+    }
+
+    void call(Reg reg)
+    {
+        rex(false, 0, 0, reg);
+        byte(0xFF);
+        modrm_reg(2, reg);
+    }
+
+    /** `jmp reg` */
+    void jmp(Reg reg)
+    {
+        rex(false, 0, 0, reg);
+        byte(0xFF);
+        modrm_reg(4, reg);
+    }
+
+    /** `lea reg, [rip + label]` */
+    void lea(Reg reg, Label label)
+    {
+        rex(true, reg, 0, 0);
+        byte(0x8D);
+        byte(0x05 | ((reg & 7) << 3));  // mod=00, rm=101 (rip relative)
+        rel32(label);
+    }
+
+    /** an entry of a jump table, the displacement of `label` from the end of the entry. */
+    void table_entry(Label label)
+    {
+        rel32(label);
+    }
+
+    void ret()
+    {
+        byte(0xC3);
+    }
+
+    void push(Reg reg)
+    {
+        rex(false, 0, 0, reg);
+        byte(0x50 | (reg & 7));
+    }
+
+    void pop(Reg reg)
+    {
+        rex(false, 0, 0, reg);
+        byte(0x58 | (reg & 7));
+    }
+
+    /** `opcode reg, rm` (or `opcode rm, reg` depending on the opcode) with register operands. */
+    void op_rr(std::initializer_list<std::uint8_t> opcode, bool wide, std::uint8_t reg, Reg rm)
+    {
+        rex(wide, reg, 0, rm);
+        bytes(opcode);
+        modrm_reg(reg & 7, rm);
+    }
+
+    /** `opcode` with a `[base + disp]` memory operand, `reg` may be an opcode extension. */
+    void op_rm(std::initializer_list<std::uint8_t> opcode, bool wide, std::uint8_t reg, Reg base, std::int32_t disp)
+    {
+        rex(wide, reg, 0, base);
+        bytes(opcode);
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));  // mod=10, disp32
+        if ((base & 7) == rsp) {
+            byte(0x24);  // SIB without index
+        }
+        imm32(static_cast<std::uint32_t>(disp));
+    }
+
+    void mov_imm64(Reg reg, std::uint64_t value)
+    {
+        rex(true, 0, 0, reg);
+        byte(0xB8 | (reg & 7));
+        imm64(value);
+    }
+
+    void mov_imm32(Reg reg, std::uint32_t value)
+    {
+        rex(false, 0, 0, reg);
+        byte(0xB8 | (reg & 7));
+        imm32(value);
+    }
+
+    void xor_eax()
+    {
+        byte(0x31);
+        byte(0xC0);
+    }
+
+    void byte(std::uint8_t value)
+    {
+        _bytes.push_back(value);
+    }
+
+    void bytes(std::initializer_list<std::uint8_t> values)
+    {
+        _bytes.insert(_bytes.end(), values.begin(), values.end());
+    }
+
+    void imm16(std::uint16_t value)
+    {
+        byte(value & 0xFF);
+        byte(value >> 8);
+    }
+
+    void imm32(std::uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8) {
+            byte((value >> shift) & 0xFF);
+        }
+    }
+
+    void imm64(std::uint64_t value)
+    {
+        imm32(static_cast<std::uint32_t>(value));
+        imm32(static_cast<std::uint32_t>(value >> 32));
+    }
+
+    /** resolves all jump displacements, returns false if any label is left unbound. */
+    auto link() -> bool
+    {
+        for (const auto& [offset, label] : _fixups) {
+            if (_labels[label] == k_unbound) {
+                return false;
+            }
+            const auto disp = static_cast<std::int64_t>(_labels[label]) - static_cast<std::int64_t>(offset + 4);
+            const auto disp32 = static_cast<std::uint32_t>(static_cast<std::int32_t>(disp));
+            std::memcpy(&_bytes[offset], &disp32, sizeof(disp32));
+        }
+        return true;
+    }
+
+private:
+    static constexpr std::size_t k_unbound = static_cast<std::size_t>(-1);
+
+    void rex(bool wide, std::uint8_t reg, std::uint8_t index, std::uint8_t base)
+    {
+        const std::uint8_t value = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+        if (value != 0x40) {
+            byte(value);
+        }
+    }
+
+    void modrm_reg(std::uint8_t reg, std::uint8_t rm)
+    {
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void rel32(Label label)
+    {
+        _fixups.emplace_back(_bytes.size(), label);
+        imm32(0);
+    }
+
+    std::vector<std::uint8_t> _bytes;
+    std::vector<std::size_t> _labels;
+    std::vector<std::pair<std::size_t, Label>> _fixups;
+};
+
+constexpr auto k_call_ctx_offset = static_cast<std::int32_t>(offsetof(JitCode::Args, call_ctx));
+
+/**
+ * Generates the machine code of a program.
+ *
+ * During the parse, the cursor lives in r12 and the end of the stream in r13
+ * (both callee-saved, so they survive the calls into custom and extract callbacks),
+ * and rbx keeps pointing to the entry's `JitCode::Args` for the callbacks taking the call context.
+ * every instruction's code leaves its validity in eax (0 or 1),
+ * and its resulting stream in r12/r13.
+ * `call` targets become functions of their own with the same convention,
+ * everything else is inlined into its parent.
+ */
+class CodeGenerator {
+public:
+    explicit CodeGenerator(const Program& program) noexcept
+        : _code(program.code.data())
+        , _callbacks(program.callbacks.data())
+    {
+    }
+
+    auto generate() -> bool
+    {
+        // entry: bool (*)(JitCode::Args* args), the stream being the first member.
+        const auto root = function_of(0);
+        _asm.push(r12);
+        _asm.push(r13);
+        _asm.push(rbx);
+        _asm.op_rr({0x89}, true, rdi, rbx);     // mov rbx, rdi
+        _asm.op_rm({0x8B}, true, r12, rbx, 0);  // mov r12, [rbx]
+        _asm.op_rm({0x8B}, true, r13, rbx, 8);  // mov r13, [rbx + 8]
+        _asm.op_rr({0x01}, true, r12, r13);     // add r13, r12
+        _asm.call(root);
+        _asm.op_rm({0x89}, true, r12, rbx, 0);  // mov [rbx], r12
+        _asm.op_rr({0x89}, true, r13, rcx);     // mov rcx, r13
+        _asm.op_rr({0x29}, true, r12, rcx);     // sub rcx, r12
+        _asm.op_rm({0x89}, true, rcx, rbx, 8);  // mov [rbx + 8], rcx
+        _asm.bytes({0x0F, 0xB6, 0xC0});         // movzx eax, al
+        _asm.pop(rbx);
+        _asm.pop(r13);
+        _asm.pop(r12);
+        _asm.ret();
+
+        while (!_pending_functions.empty()) {
+            const std::size_t pc = _pending_functions.back();
+            _pending_functions.pop_back();
+
+            _asm.bind(_functions[pc]);
+            _depth = 0;
+            emit(pc);
+            _asm.ret();
+        }
+
+        return _asm.link();
+    }
+
+    [[nodiscard]] auto bytes() const noexcept -> const std::vector<std::uint8_t>&
+    {
+        return _asm.bytes();
+    }
+
+private:
+    auto function_of(std::size_t pc) -> Assembler::Label
+    {
+        if (auto iter = _functions.find(pc); iter != _functions.end()) {
+            return iter->second;
+        }
+        const auto label = _asm.new_label();
+        _functions.emplace(pc, label);
+        _pending_functions.push_back(pc);
+        return label;
+    }
+
+    void emit(std::size_t pc)
+    {
+        switch (opcode_of(_code, pc)) {
+            case Opcode::fail:
+                _asm.xor_eax();
+                return;
+
+            case Opcode::eos:
+                _asm.xor_eax();
+                _asm.op_rr({0x39}, true, r13, r12);  // cmp r12, r13
+                _asm.bytes({0x0F, 0x94, 0xC0});      // sete al
+                return;
+
+            case Opcode::byte: {
+                const auto done = _asm.new_label();
+                _asm.xor_eax();
+                emit_jump_if_at_end(done);
+                _asm.op_rm({0x80}, false, 7, r12, 0);  // cmp byte [r12], imm8
+                _asm.byte(static_cast<std::uint8_t>(immediate_of(_code, pc)));
+                _asm.jcc(cond_ne, done);
+                emit_advance_and_succeed(1);
+                _asm.bind(done);
+                return;
+            }
+
+            case Opcode::charset: {
+                const auto done = _asm.new_label();
+                _asm.xor_eax();
+                emit_jump_if_at_end(done);
+                emit_charset_test(&_code[pc + k_header_size]);
+                _asm.jcc(cond_ae, done);
+                emit_advance_and_succeed(1);
+                _asm.bind(done);
+                return;
+            }
+
+            case Opcode::string:
+                emit_string(pc);
+                return;
+
+            case Opcode::custom:
+                emit_custom(_callbacks[_code[pc + k_header_size]]);
+                return;
+
+            case Opcode::extract:
+                emit_extract(pc);
+                return;
+
+            case Opcode::sequence: {
+                const auto done = _asm.new_label();
+                _asm.mov_imm32(rax, 1);
+                for (std::size_t child = first_child_of(_code, pc); child < end_of(_code, pc); child += length_of(_code, child)) {
+                    emit(child);
+                    _asm.bytes({0x84, 0xC0});  // test al, al
+                    _asm.jcc(cond_e, done);
+                }
+                _asm.bind(done);
+                return;
+            }
+
+            case Opcode::anyof: {
+                const auto done = _asm.new_label();
+                emit_save_stream();
+                for (std::size_t child = first_child_of(_code, pc); child < end_of(_code, pc); child += length_of(_code, child)) {
+                    emit(child);
+                    _asm.bytes({0x84, 0xC0});  // test al, al
+                    _asm.jcc(cond_ne, done);
+                    emit_restore_stream();
+                }
+                _asm.xor_eax();
+                _asm.bind(done);
+                emit_drop_stream();
+                return;
+            }
+
+            case Opcode::repeat:
+                emit_repeat(pc);
+                return;
+
+            case Opcode::optional: {
+                const auto done = _asm.new_label();
+                emit_save_stream();
+                emit(first_child_of(_code, pc));
+                _asm.bytes({0x84, 0xC0});  // test al, al
+                _asm.jcc(cond_ne, done);
+                emit_restore_stream();
+                _asm.bind(done);
+                emit_drop_stream();
+                _asm.mov_imm32(rax, 1);
+                return;
+            }
+
+            case Opcode::call:
+            case Opcode::memo_call:  // only interpreted programs have a memo table
+                emit_aligned_call([&] { _asm.call(function_of(_code[pc + k_header_size])); });
+                return;
+
+            case Opcode::repeat_byte:
+            case Opcode::repeat_not_byte:
+            case Opcode::repeat_charset:
+                emit_scan(pc);
+                return;
+
+            case Opcode::dispatch:
+                emit_dispatch(pc);
+                return;
+
+            case Opcode::profile:  // only interpreted programs are profiled
+            case Opcode::capture:  // only interpreted parses capture
+                emit(first_child_of(_code, pc));
+                return;
+
+            case Opcode::trie:
+                emit_trie(pc);
+                return;
+        }
+    }
+
+    void emit_jump_if_at_end(Assembler::Label label)
+    {
+        _asm.op_rr({0x39}, true, r13, r12);  // cmp r12, r13
+        _asm.jcc(cond_ae, label);
+    }
+
+    void emit_advance_and_succeed(std::uint32_t count)
+    {
+        _asm.op_rr({0x81}, true, 0, r12);  // add r12, imm32
+        _asm.imm32(count);
+        _asm.mov_imm32(rax, 1);
+    }
+
+    /** sets carry if the byte at r12 is in the charset, clobbers rcx, rdx and rsi. */
+    void emit_charset_test(const Word* charset)
+    {
+        _asm.op_rm({0x0F, 0xB6}, false, rcx, r12, 0);  // movzx ecx, byte [r12]
+        _asm.op_rr({0x89}, false, rcx, rdx);           // mov edx, ecx
+        _asm.bytes({0xC1, 0xEA, 0x05});                // shr edx, 5
+        _asm.mov_imm64(rsi, reinterpret_cast<std::uint64_t>(charset));
+        _asm.bytes({0x8B, 0x14, 0x96});                // mov edx, [rsi + rdx * 4]
+        _asm.bytes({0x0F, 0xA3, 0xCA});                // bt edx, ecx
+    }
+
+    void emit_string(std::size_t pc)
+    {
+        const std::size_t size = _code[pc + k_header_size];
+        const auto* bytes = reinterpret_cast<const std::uint8_t*>(string_bytes_of(_code, pc));
+        const auto fail = _asm.new_label();
+        const auto done = _asm.new_label();
+
+        _asm.op_rr({0x89}, true, r13, rax);  // mov rax, r13
+        _asm.op_rr({0x29}, true, r12, rax);  // sub rax, r12
+        _asm.mov_imm64(rcx, size);
+        _asm.op_rr({0x39}, true, rcx, rax);  // cmp rax, rcx
+        _asm.jcc(cond_b, fail);
+
+        std::size_t offset = 0;
+        for (; offset + 8 <= size; offset += 8) {
+            std::uint64_t chunk = 0;
+            std::memcpy(&chunk, bytes + offset, 8);
+            _asm.mov_imm64(rax, chunk);
+            _asm.op_rm({0x39}, true, rax, r12, static_cast<std::int32_t>(offset));  // cmp [r12 + offset], rax
+            _asm.jcc(cond_ne, fail);
+        }
+        if (offset + 4 <= size) {
+            std::uint32_t chunk = 0;
+            std::memcpy(&chunk, bytes + offset, 4);
+            _asm.op_rm({0x81}, false, 7, r12, static_cast<std::int32_t>(offset));  // cmp dword [r12 + offset], imm32
+            _asm.imm32(chunk);
+            _asm.jcc(cond_ne, fail);
+            offset += 4;
+        }
+        if (offset + 2 <= size) {
+            std::uint16_t chunk = 0;
+            std::memcpy(&chunk, bytes + offset, 2);
+            _asm.byte(0x66);
+            _asm.op_rm({0x81}, false, 7, r12, static_cast<std::int32_t>(offset));  // cmp word [r12 + offset], imm16
+            _asm.imm16(chunk);
+            _asm.jcc(cond_ne, fail);
+            offset += 2;
+        }
+        if (offset < size) {
+            _asm.op_rm({0x80}, false, 7, r12, static_cast<std::int32_t>(offset));  // cmp byte [r12 + offset], imm8
+            _asm.byte(bytes[offset]);
+            _asm.jcc(cond_ne, fail);
+        }
+
+        _asm.mov_imm64(rax, size);
+        _asm.op_rr({0x01}, true, rax, r12);  // add r12, rax
+        _asm.mov_imm32(rax, 1);
+        _asm.jmp(done);
+        _asm.bind(fail);
+        if (immediate_of(_code, pc) != 0) {
+            // merged literals fail past the ones that matched, as their sequence did.
+            emit_aligned_call([&] {
+                _asm.mov_imm64(rdi, reinterpret_cast<std::uint64_t>(&_code[pc]));
+                _asm.op_rr({0x89}, true, r12, rsi);  // mov rsi, r12
+                _asm.op_rr({0x89}, true, r13, rdx);  // mov rdx, r13
+                _asm.mov_imm64(rax, reinterpret_cast<std::uint64_t>(&matched_literals_of));
+                _asm.call(rax);
+            });
+            _asm.op_rr({0x01}, true, rax, r12);  // add r12, rax
+        }
+        _asm.xor_eax();
+        _asm.bind(done);
+    }
+
+    void emit_custom(const Callback& callback)
+    {
+        // parsi_result_t is returned through memory, reserved on the stack.
+        _asm.op_rr({0x81}, true, 5, rsp);  // sub rsp, 32
+        _asm.imm32(32);
+        _depth += 4;
+        emit_aligned_call([&] {
+            _asm.op_rm({0x8D}, true, rdi, rsp, _padding);  // lea rdi, [rsp + padding]
+            _asm.mov_imm64(rsi, reinterpret_cast<std::uint64_t>(callback.context));
+            if (callback.parse_fn) {
+                _asm.op_rr({0x89}, true, r12, rdx);  // mov rdx, r12
+                _asm.op_rr({0x89}, true, r13, rcx);  // mov rcx, r13
+                _asm.op_rr({0x29}, true, r12, rcx);  // sub rcx, r12
+                _asm.mov_imm64(rax, reinterpret_cast<std::uint64_t>(callback.parse_fn));
+            }
+            else {
+                _asm.op_rm({0x8B}, true, rdx, rbx, k_call_ctx_offset);  // mov rdx, [rbx + call_ctx]
+                _asm.op_rr({0x89}, true, r12, rcx);  // mov rcx, r12
+                _asm.op_rr({0x89}, true, r13, r8);   // mov r8, r13
+                _asm.op_rr({0x29}, true, r12, r8);   // sub r8, r12
+                _asm.mov_imm64(rax, reinterpret_cast<std::uint64_t>(callback.parse_ctx_fn));
+            }
+            _asm.call(rax);
+        });
+        _asm.op_rm({0x0F, 0xB6}, false, rax, rsp, 0);  // movzx eax, byte [rsp]
+        _asm.op_rm({0x8B}, true, r12, rsp, 8);         // mov r12, [rsp + 8]
+        _asm.op_rm({0x8B}, true, r13, rsp, 16);        // mov r13, [rsp + 16]
+        _asm.op_rr({0x01}, true, r12, r13);            // add r13, r12
+        _asm.op_rr({0x81}, true, 0, rsp);              // add rsp, 32
+        _asm.imm32(32);
+        _depth -= 4;
+    }
+
+    void emit_extract(std::size_t pc)
+    {
+        const Callback& callback = _callbacks[_code[pc + k_header_size]];
+        const auto done = _asm.new_label();
+
+        emit_save_stream();
+        emit(first_child_of(_code, pc));
+        _asm.bytes({0x84, 0xC0});  // test al, al
+        _asm.jcc(cond_e, done);
+        emit_aligned_call([&] {
+            // size = (saved end - saved cursor) - (r13 - r12),
+            // passed after the cursor, which comes after the call context for the ctx taking visitors.
+            const Reg cursor = callback.visit_fn ? rsi : rdx;
+            const Reg size = callback.visit_fn ? rdx : rcx;
+            _asm.op_rm({0x8B}, true, cursor, rsp, 8 + _padding);  // mov cursor, [rsp + 8] (saved cursor)
+            _asm.op_rm({0x8B}, true, size, rsp, _padding);        // mov size, [rsp] (saved end)
+            _asm.op_rr({0x29}, true, cursor, size);               // sub size, cursor
+            _asm.op_rr({0x89}, true, r13, rax);                   // mov rax, r13
+            _asm.op_rr({0x29}, true, r12, rax);                   // sub rax, r12
+            _asm.op_rr({0x29}, true, rax, size);                  // sub size, rax
+            _asm.mov_imm64(rdi, reinterpret_cast<std::uint64_t>(callback.context));
+            if (callback.visit_fn) {
+                _asm.mov_imm64(rax, reinterpret_cast<std::uint64_t>(callback.visit_fn));
+            }
+            else {
+                _asm.op_rm({0x8B}, true, rsi, rbx, k_call_ctx_offset);  // mov rsi, [rbx + call_ctx]
+                _asm.mov_imm64(rax, reinterpret_cast<std::uint64_t>(callback.visit_ctx_fn));
+            }
+            _asm.call(rax);
+        });
+        _asm.bytes({0x0F, 0xB6, 0xC0});  // movzx eax, al
+        _asm.bind(done);
+        emit_drop_stream();
+    }
+
+    /**
+     * matches the first bytes of the run inline, as most runs are short,
+     * and calls out to the vectorized kernel for the rest of longer runs.
+     * r8 holds the start of the run and r9 its limit.
+     */
+    void emit_scan(std::size_t pc)
+    {
+        constexpr std::int32_t k_inline_bytes = 16;
+
+        const Opcode opcode = opcode_of(_code, pc);
+        const std::size_t min = size_operand_of(_code, pc + k_header_size);
+        const std::size_t max = size_operand_of(_code, pc + k_header_size + 2);
+        const auto loop = _asm.new_label();
+        const auto stop = _asm.new_label();
+        const auto fail = _asm.new_label();
+        const auto done = _asm.new_label();
+
+        // the run ends one byte past max at most: r12 + min(r13 - r12, max + 1)
+        _asm.op_rr({0x89}, true, r13, r9);  // mov r9, r13
+        _asm.op_rr({0x29}, true, r12, r9);  // sub r9, r12
+        if (max != std::numeric_limits<std::size_t>::max()) {
+            _asm.mov_imm64(rax, max + 1);
+            _asm.op_rr({0x39}, true, rax, r9);        // cmp r9, rax
+            _asm.op_rr({0x0F, 0x47}, true, r9, rax);  // cmova r9, rax
+        }
+        _asm.op_rr({0x01}, true, r12, r9);  // add r9, r12
+        _asm.op_rr({0x89}, true, r12, r8);  // mov r8, r12
+
+        _asm.bind(loop);
+        _asm.op_rr({0x39}, true, r9, r12);  // cmp r12, r9
+        _asm.jcc(cond_ae, stop);
+        if (opcode == Opcode::repeat_charset) {
+            emit_charset_test(&_code[pc + k_header_size + 4]);
+            _asm.jcc(cond_ae, stop);
+        }
+        else {
+            _asm.op_rm({0x80}, false, 7, r12, 0);  // cmp byte [r12], imm8
+            _asm.byte(static_cast<std::uint8_t>(immediate_of(_code, pc)));
+            _asm.jcc(opcode == Opcode::repeat_byte ? cond_ne : cond_e, stop);
+        }
+        _asm.op_rr({0x81}, true, 0, r12);  // add r12, 1
+        _asm.imm32(1);
+        _asm.op_rr({0x89}, true, r12, rax);  // mov rax, r12
+        _asm.op_rr({0x29}, true, r8, rax);   // sub rax, r8
+        _asm.op_rr({0x81}, true, 7, rax);    // cmp rax, imm32
+        _asm.imm32(k_inline_bytes);
+        _asm.jcc(cond_b, loop);
+
+        _asm.push(r8);
+        _depth += 1;
+        emit_aligned_call([&] {
+            _asm.mov_imm64(rdi, reinterpret_cast<std::uint64_t>(&_code[pc]));
+            _asm.op_rr({0x89}, true, r12, rsi);  // mov rsi, r12
+            _asm.op_rr({0x89}, true, r9, rdx);   // mov rdx, r9
+            _asm.mov_imm64(rax, reinterpret_cast<std::uint64_t>(scan_kernel_of(opcode)));
+            _asm.call(rax);
+        });
+        _asm.pop(r8);
+        _depth -= 1;
+        _asm.op_rr({0x89}, true, rax, r12);  // mov r12, rax
+
+        _asm.bind(stop);
+        _asm.op_rr({0x89}, true, r12, rcx);  // mov rcx, r12
+        _asm.op_rr({0x29}, true, r8, rcx);   // sub rcx, r8
+        if (max != std::numeric_limits<std::size_t>::max()) {
+            _asm.mov_imm64(rax, max);
+            _asm.op_rr({0x39}, true, rax, rcx);  // cmp rcx, rax
+            _asm.jcc(cond_a, fail);
+        }
+        if (min != 0) {
+            _asm.mov_imm64(rax, min);
+            _asm.op_rr({0x39}, true, rax, rcx);  // cmp rcx, rax
+            _asm.jcc(cond_b, fail);
+        }
+        _asm.mov_imm32(rax, 1);
+        _asm.jmp(done);
+        _asm.bind(fail);
+        _asm.xor_eax();
+        _asm.bind(done);
+    }
+
+    void emit_repeat(std::size_t pc)
+    {
+        const std::size_t min = size_operand_of(_code, pc + k_header_size);
+        const std::size_t max = size_operand_of(_code, pc + k_header_size + 2);
+        const std::size_t child = first_child_of(_code, pc);
+        const auto loop = _asm.new_label();
+        const auto over = _asm.new_label();
+        const auto stop = _asm.new_label();
+        const auto fail = _asm.new_label();
+        const auto done = _asm.new_label();
+
+        // [rsp] count, [rsp + 8] last valid end, [rsp + 16] last valid cursor.
+        emit_save_stream();
+        _asm.bytes({0x6A, 0x00});  // push 0
+        _depth += 1;
+
+        _asm.bind(loop);
+        emit(child);
+        _asm.bytes({0x84, 0xC0});  // test al, al
+        _asm.jcc(cond_e, stop);
+        _asm.op_rm({0xFF}, true, 0, rsp, 0);  // inc qword [rsp]
+        _asm.mov_imm64(rax, max);
+        _asm.op_rm({0x39}, true, rax, rsp, 0);  // cmp [rsp], rax
+        _asm.jcc(cond_a, over);
+        _asm.op_rm({0x89}, true, r13, rsp, 8);   // mov [rsp + 8], r13
+        _asm.op_rm({0x89}, true, r12, rsp, 16);  // mov [rsp + 16], r12
+        _asm.jmp(loop);
+
+        _asm.bind(over);
+        _asm.xor_eax();
+        _asm.jmp(done);
+
+        _asm.bind(stop);
+        _asm.mov_imm64(rax, min);
+        _asm.op_rm({0x39}, true, rax, rsp, 0);  // cmp [rsp], rax
+        _asm.jcc(cond_b, fail);
+        _asm.op_rm({0x8B}, true, r13, rsp, 8);   // mov r13, [rsp + 8]
+        _asm.op_rm({0x8B}, true, r12, rsp, 16);  // mov r12, [rsp + 16]
+        _asm.mov_imm32(rax, 1);
+        _asm.jmp(done);
+
+        _asm.bind(fail);
+        _asm.xor_eax();
+        _asm.bind(done);
+        _asm.op_rr({0x81}, true, 0, rsp);  // add rsp, 8
+        _asm.imm32(8);
+        _depth -= 1;
+        emit_drop_stream();
+    }
+
+    /**
+     * jumps through a table of the children's code by the next byte (or 256 at the end),
+     * each child is inlined once, however many bytes lead to it.
+     */
+    void emit_dispatch(std::size_t pc)
+    {
+        const auto lookup = _asm.new_label();
+        const auto table = _asm.new_label();
+        const auto fail = _asm.new_label();
+        const auto done = _asm.new_label();
+
+        _asm.mov_imm32(rcx, 256);
+        emit_jump_if_at_end(lookup);
+        _asm.op_rm({0x0F, 0xB6}, false, rcx, r12, 0);  // movzx ecx, byte [r12]
+        _asm.bind(lookup);
+        _asm.lea(rdx, table);
+        _asm.bytes({0x48, 0x63, 0x04, 0x8A});        // movsxd rax, dword [rdx + rcx * 4]
+        _asm.bytes({0x48, 0x8D, 0x54, 0x8A, 0x04});  // lea rdx, [rdx + rcx * 4 + 4]
+        _asm.op_rr({0x01}, true, rdx, rax);          // add rax, rdx
+        _asm.jmp(rax);
+
+        std::unordered_map<std::size_t, Assembler::Label> children;
+        std::vector<std::size_t> order;
+        _asm.bind(table);
+        for (std::size_t next = 0; next < k_dispatch_entries; ++next) {
+            const Word offset = _code[pc + k_header_size + next];
+            if (offset == 0) {
+                _asm.table_entry(fail);
+                continue;
+            }
+            auto [iter, inserted] = children.emplace(pc + offset, Assembler::Label{});
+            if (inserted) {
+                iter->second = _asm.new_label();
+                order.push_back(pc + offset);
+            }
+            _asm.table_entry(iter->second);
+        }
+
+        for (std::size_t child : order) {
+            _asm.bind(children[child]);
+            emit(child);
+            _asm.jmp(done);
+        }
+        _asm.bind(fail);
+        _asm.xor_eax();
+        _asm.bind(done);
+    }
+
+    /**
+     * unrolls the trie into compares of the next byte against each node's edges,
+     * the literal matched so far on every path being known at compile time.
+     * rax keeps the size of the input throughout.
+     */
+    void emit_trie(std::size_t pc)
+    {
+        const auto fail = _asm.new_label();
+        const auto done = _asm.new_label();
+        std::map<std::size_t, Assembler::Label> matches;  // by matched size
+
+        _asm.op_rr({0x89}, true, r13, rax);  // mov rax, r13
+        _asm.op_rr({0x29}, true, r12, rax);  // sub rax, r12
+        emit_trie_node(pc, pc + k_header_size, 0, k_trie_no_rank, fail, matches);
+
+        for (const auto& [size, label] : matches) {
+            _asm.bind(label);
+            emit_advance_and_succeed(static_cast<std::uint32_t>(size));
+            _asm.jmp(done);
+        }
+        _asm.bind(fail);
+        _asm.xor_eax();
+        _asm.bind(done);
+    }
+
+    void emit_trie_node(std::size_t pc, std::size_t node, std::size_t depth, Word best_rank, Assembler::Label miss,
+                        std::map<std::size_t, Assembler::Label>& matches)
+    {
+        if (_code[node] < best_rank) {
+            best_rank = _code[node];
+            auto [iter, inserted] = matches.emplace(depth, Assembler::Label{});
+            if (inserted) {
+                iter->second = _asm.new_label();
+            }
+            miss = iter->second;
+        }
+        const Word* edges = &_code[node + k_trie_node_operands];
+        const std::size_t count = _code[node + 2];
+        if (_code[node + 1] >= best_rank || count == 0) {
+            _asm.jmp(miss);
+            return;
+        }
+
+        _asm.op_rr({0x81}, true, 7, rax);  // cmp rax, imm32
+        _asm.imm32(static_cast<std::uint32_t>(depth));
+        _asm.jcc(cond_be, miss);
+        _asm.op_rm({0x0F, 0xB6}, false, rcx, r12, static_cast<std::int32_t>(depth));  // movzx ecx, byte [r12 + depth]
+
+        std::vector<Assembler::Label> children(count);
+        for (auto& child : children) {
+            child = _asm.new_label();
+        }
+        emit_trie_edges(edges, 0, count, children, miss);
+        for (std::size_t index = 0; index < count; ++index) {
+            _asm.bind(children[index]);
+            emit_trie_node(pc, pc + (edges[index] >> 8), depth + 1, best_rank, miss, matches);
+        }
+    }
+
+    /** jumps to the child of the edge with the byte in ecx, searching the sorted edges in halves. */
+    void emit_trie_edges(const Word* edges, std::size_t begin, std::size_t end,
+                         const std::vector<Assembler::Label>& children, Assembler::Label miss)
+    {
+        constexpr std::size_t k_linear_edges = 4;
+
+        const auto emit_compare = [&](std::size_t index) {
+            _asm.op_rr({0x81}, false, 7, rcx);  // cmp ecx, imm32
+            _asm.imm32(edges[index] & 0xFF);
+            _asm.jcc(cond_e, children[index]);
+        };
+
+        while (end - begin > k_linear_edges) {
+            const std::size_t middle = begin + (end - begin) / 2;
+            const auto upper = _asm.new_label();
+            emit_compare(middle);
+            _asm.jcc(cond_a, upper);
+            emit_trie_edges(edges, begin, middle, children, miss);
+            _asm.bind(upper);
+            begin = middle + 1;
+        }
+        for (std::size_t index = begin; index < end; ++index) {
+            emit_compare(index);
+        }
+        _asm.jmp(miss);
+    }
+
+    /** pushes r12 and r13, so `[rsp]` is the saved end and `[rsp + 8]` the saved cursor. */
+    void emit_save_stream()
+    {
+        _asm.push(r12);
+        _asm.push(r13);
+        _depth += 2;
+    }
+
+    void emit_restore_stream()
+    {
+        _asm.op_rm({0x8B}, true, r13, rsp, 0);  // mov r13, [rsp]
+        _asm.op_rm({0x8B}, true, r12, rsp, 8);  // mov r12, [rsp + 8]
+    }
+
+    void emit_drop_stream()
+    {
+        _asm.op_rm({0x8D}, true, rsp, rsp, 16);  // lea rsp, [rsp + 16]
+        _depth -= 2;
+    }
+
+    /**
+     * keeps the stack 16 bytes aligned at the call emitted by `emit_call`,
+     * `_padding` is the extra offset to the pushed values while aligned.
+     */
+    template <typename EmitCallF>
+    void emit_aligned_call(EmitCallF&& emit_call)
+    {
+        // rsp is 8 bytes off alignment at function entry (the return address),
+        // so an even number of pushed slots needs padding.
+        const bool needs_padding = _depth % 2 == 0;
+        if (needs_padding) {
+            _asm.op_rr({0x81}, true, 5, rsp);  // sub rsp, 8
+            _asm.imm32(8);
+            _padding = 8;
+        }
+        emit_call();
+        if (needs_padding) {
+            _asm.op_rm({0x8D}, true, rsp, rsp, 8);  // lea rsp, [rsp + 8] (keeps flags)
+            _padding = 0;
+        }
+    }
+
+    const Word* _code;
+    const Callback* _callbacks;
+    Assembler _asm;
+    std::unordered_map<std::size_t, Assembler::Label> _functions;
+    std::vector<std::size_t> _pending_functions;
+    std::size_t _depth = 0;
+    std::int32_t _padding = 0;
+};
+
+}  // namespace
+
+JitCode::~JitCode()
+{
+    if (_memory) {
+        ::munmap(_memory, _size);
+    }
+}
+
+auto JitCode::compile(const Program& program) -> JitCode
+{
+    CodeGenerator generator(program);
+    if (!generator.generate()) {
+        return JitCode{};
+    }
+
+    const auto& bytes = generator.bytes();
+    const auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t size = (bytes.size() + page_size - 1) / page_size * page_size;
+
+    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return JitCode{};
+    }
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if (::mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        ::munmap(memory, size);
+        return JitCode{};
+    }
+
+    JitCode jit;
+    jit._memory = memory;
+    jit._size = size;
+    jit._entry = reinterpret_cast<entry_type>(memory);
+    return jit;
+}
+
+#else
+
+JitCode::~JitCode() = default;
+
+auto JitCode::compile(const Program&) -> JitCode
+{
+    return JitCode{};
+}
+
+#endif
+
+}  // namespace parsi::internal
@@ -0,0 +1,91 @@
+#ifndef PARSI_SRC_JIT_HPP
+#define PARSI_SRC_JIT_HPP
+
+#include <cstddef>
+#include <utility>
+
+#include "program.hpp"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define PARSI_HAS_JIT 1
+#else
+#define PARSI_HAS_JIT 0
+#endif
+
+namespace parsi::internal {
+
+/**
+ * Native machine code of a compiled program, in its own executable pages.
+ *
+ * The code refers to the program's operands (charsets) and callbacks,
+ * so the program must outlive it.
+ */
+class JitCode {
+public:
+    /** what the machine code runs on, it leaves the resulting stream in `stream`. */
+    struct Args {
+        parsi_stream_t stream;
+        void* call_ctx;
+    };
+
+    using entry_type = bool (*)(Args* args);
+
+    JitCode() noexcept = default;
+
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    JitCode(JitCode&& other) noexcept
+        : _memory(std::exchange(other._memory, nullptr))
+        , _size(std::exchange(other._size, 0))
+        , _entry(std::exchange(other._entry, nullptr))
+    {
+    }
+
+    JitCode& operator=(JitCode&& other) noexcept
+    {
+        std::swap(_memory, other._memory);
+        std::swap(_size, other._size);
+        std::swap(_entry, other._entry);
+        return *this;
+    }
+
+    ~JitCode();
+
+    /**
+     * translates the program into machine code,
+     * returns an empty instance if the host isn't supported or mapping memory fails.
+     */
+    [[nodiscard]] static auto compile(const Program& program) -> JitCode;
+
+    [[nodiscard]] explicit operator bool() const noexcept
+    {
+        return _entry != nullptr;
+    }
+
+    [[nodiscard]] auto run(parsi_stream_t stream, void* call_ctx = nullptr) const noexcept -> parsi_result_t
+    {
+        Args args{ .stream = stream, .call_ctx = call_ctx };
+        const bool is_valid = _entry(&args);
+        return parsi_result_t{ .is_valid = is_valid, .stream = args.stream };
+    }
+
+    void run_many(const parsi_stream_t* inputs, parsi_result_t* outputs, std::size_t count) const noexcept
+    {
+        for (std::size_t index = 0; index < count; ++index) {
+            if (index + 1 < count) {
+                prefetch(inputs[index + 1].cursor);
+            }
+            outputs[index] = run(inputs[index]);
+        }
+    }
+
+private:
+    void* _memory = nullptr;
+    std::size_t _size = 0;
+    entry_type _entry = nullptr;
+};
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_JIT_HPP
@@ -0,0 +1,83 @@
+#include "program.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace parsi::internal {
+
+namespace {
+
+/** the memo slot is kept in the instruction's immediate, which is 24 bits wide. */
+constexpr std::size_t k_max_memo_slots = std::size_t{1} << 24;
+
+/** calls every `visit(pc)` with the position of each instruction in `[begin, end)`. */
+template <typename VisitorT>
+void for_each_instruction(const Word* code, std::size_t begin, std::size_t end, VisitorT&& visit)
+{
+    for (std::size_t pc = begin; pc < end;) {
+        const Opcode opcode = opcode_of(code, pc);
+        visit(pc, opcode);
+        pc += is_composite(opcode) ? operands_end_of(opcode) : length_of(code, pc);
+    }
+}
+
+}  // namespace
+
+void memoize_program(Program& program)
+{
+    Word* const code = program.code.data();
+    const std::size_t size = program.code.size();
+
+    std::vector<std::size_t> targets;
+    for_each_instruction(code, 0, size, [&](std::size_t pc, Opcode opcode) {
+        if (opcode == Opcode::call) {
+            targets.push_back(code[pc + k_header_size]);
+        }
+    });
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    // a target is impure if it runs callbacks or captures, which must not be skipped by a cached result,
+    // either by itself or through the targets it calls, so it's propagated until nothing changes.
+    std::vector<char> impure(targets.size(), 0);
+    const auto index_of = [&](std::size_t target) {
+        return static_cast<std::size_t>(std::lower_bound(targets.begin(), targets.end(), target) - targets.begin());
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (std::size_t index = 0; index < targets.size(); ++index) {
+            if (impure[index]) {
+                continue;
+            }
+            for_each_instruction(code, targets[index], end_of(code, targets[index]), [&](std::size_t pc, Opcode opcode) {
+                if (opcode == Opcode::custom || opcode == Opcode::extract || opcode == Opcode::capture
+                    || (opcode == Opcode::call && impure[index_of(code[pc + k_header_size])])) {
+                    impure[index] = 1;
+                }
+            });
+            changed = changed || impure[index];
+        }
+    }
+
+    std::vector<std::size_t> slots(targets.size(), 0);
+    std::size_t slot_count = 0;
+    for (std::size_t index = 0; index < targets.size() && slot_count < k_max_memo_slots; ++index) {
+        if (!impure[index]) {
+            slots[index] = ++slot_count;
+        }
+    }
+
+    for_each_instruction(code, 0, size, [&](std::size_t pc, Opcode opcode) {
+        if (opcode != Opcode::call) {
+            return;
+        }
+        const std::size_t slot = slots[index_of(code[pc + k_header_size])];
+        if (slot != 0) {
+            code[pc] = static_cast<Word>(Opcode::memo_call) | static_cast<Word>((slot - 1) << 8);
+        }
+    });
+    program.memo_slots = slot_count;
+}
+
+}  // namespace parsi::internal
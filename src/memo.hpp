@@ -0,0 +1,144 @@
+#ifndef PARSI_SRC_MEMO_HPP
+#define PARSI_SRC_MEMO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "program.hpp"
+
+namespace parsi::internal {
+
+/**
+ * Results of `memo_call` targets by (slot, position), for a single parse.
+ *
+ * When a full table (one entry per slot and position) fits in the program's memo limit,
+ * every result is kept, which bounds the parse to linear time.
+ * otherwise a direct mapped cache of the limit's size is used, where colliding entries evict each other.
+ * only the results of subparsers without callbacks are cached, so the end of their stream
+ * is always the end of the input, and a result is just its consumed length and validity.
+ */
+class MemoTable {
+    struct CacheEntry {
+        std::size_t position;
+        std::size_t slot;
+        std::uint64_t value;
+    };
+
+public:
+    MemoTable(const Program& program, parsi_stream_t input) noexcept
+        : _stats(program.memo_stats)
+        , _begin(input.cursor)
+        , _positions(input.size + 1)
+    {
+        if (program.memo_slots == 0) {
+            return;
+        }
+
+        const std::size_t limit = program.memo_limit;
+        if (_positions <= limit / sizeof(std::uint64_t) / program.memo_slots) {
+            _dense = static_cast<std::uint64_t*>(std::calloc(program.memo_slots * _positions, sizeof(std::uint64_t)));
+            if (_dense) {
+                return;
+            }
+        }
+
+        std::size_t capacity = 1;
+        while (capacity * 2 <= limit / sizeof(CacheEntry)) {
+            capacity *= 2;
+        }
+        if (capacity * sizeof(CacheEntry) <= limit) {
+            _cache = static_cast<CacheEntry*>(std::calloc(capacity, sizeof(CacheEntry)));
+            _cache_mask = capacity - 1;
+        }
+    }
+
+    MemoTable(const MemoTable&) = delete;
+    MemoTable& operator=(const MemoTable&) = delete;
+
+    ~MemoTable()
+    {
+        std::free(_dense);
+        std::free(_cache);
+        if (_lookups > 0) {
+            _stats.lookups.fetch_add(_lookups, std::memory_order_relaxed);
+            _stats.hits.fetch_add(_hits, std::memory_order_relaxed);
+            _stats.evictions.fetch_add(_evictions, std::memory_order_relaxed);
+        }
+    }
+
+    /** whether results are cached at all, they aren't if memory for the table isn't available. */
+    [[nodiscard]] auto enabled() const noexcept -> bool
+    {
+        return _dense || _cache;
+    }
+
+    /** looks up the result of `slot` on `stream` into `result`. */
+    [[nodiscard]] auto lookup(std::size_t slot, parsi_stream_t stream, parsi_result_t& result) noexcept -> bool
+    {
+        ++_lookups;
+        const std::uint64_t value = load(slot, position_of(stream));
+        if (value == 0) {
+            return false;
+        }
+        ++_hits;
+        const auto consumed = static_cast<std::size_t>(value >> 2);
+        result = parsi_result_t{
+            .is_valid = ((value >> 1) & 1) != 0,
+            .stream = { .cursor = stream.cursor + consumed, .size = stream.size - consumed },
+        };
+        return true;
+    }
+
+    void store(std::size_t slot, parsi_stream_t stream, const parsi_result_t& result) noexcept
+    {
+        const auto consumed = static_cast<std::uint64_t>(result.stream.cursor - stream.cursor);
+        const std::uint64_t value = (consumed << 2) | (static_cast<std::uint64_t>(result.is_valid) << 1) | 1;
+        const std::size_t position = position_of(stream);
+        if (_dense) {
+            _dense[slot * _positions + position] = value;
+            return;
+        }
+        CacheEntry& entry = _cache[index_of(slot, position)];
+        if (entry.value != 0 && (entry.slot != slot || entry.position != position)) {
+            ++_evictions;
+        }
+        entry = CacheEntry{ .position = position, .slot = slot, .value = value };
+    }
+
+private:
+    [[nodiscard]] auto position_of(parsi_stream_t stream) const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(stream.cursor - _begin);
+    }
+
+    [[nodiscard]] auto index_of(std::size_t slot, std::size_t position) const noexcept -> std::size_t
+    {
+        // fibonacci hashing of the combined key.
+        const std::uint64_t key = (static_cast<std::uint64_t>(position) << 16) ^ slot;
+        return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & _cache_mask;
+    }
+
+    [[nodiscard]] auto load(std::size_t slot, std::size_t position) const noexcept -> std::uint64_t
+    {
+        if (_dense) {
+            return _dense[slot * _positions + position];
+        }
+        const CacheEntry& entry = _cache[index_of(slot, position)];
+        return (entry.slot == slot && entry.position == position) ? entry.value : 0;
+    }
+
+    MemoStats& _stats;
+    const char* _begin;
+    std::size_t _positions;
+    std::uint64_t* _dense = nullptr;
+    CacheEntry* _cache = nullptr;
+    std::size_t _cache_mask = 0;
+    std::size_t _lookups = 0;
+    std::size_t _hits = 0;
+    std::size_t _evictions = 0;
+};
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_MEMO_HPP
@@ -0,0 +1,250 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "program.hpp"
+#include "scan.hpp"
+
+namespace parsi::internal {
+
+namespace {
+
+/** bytes of input per chunk, which then runs on up to the next delimiter. */
+constexpr std::size_t k_chunk_size = std::size_t{1} << 20;
+
+/** chunks parsed ahead of the one being reported, per thread. */
+constexpr std::size_t k_chunks_per_thread = 4;
+
+/** finds the next delimiter with the scan kernels, as a run of the other bytes. */
+class Delimiters {
+public:
+    explicit Delimiters(const parsi_charset_t& charset) noexcept
+    {
+        constexpr std::size_t cell_bits = 8 * sizeof(charset.bitset[0]);
+
+        Word others[k_charset_words] = {};
+        std::size_t members = 0;
+        unsigned char delimiter = 0;
+        for (std::size_t chr = 0; chr < 256; ++chr) {
+            if ((charset.bitset[chr / cell_bits] >> (chr % cell_bits)) & 1) {
+                ++members;
+                delimiter = static_cast<unsigned char>(chr);
+            }
+            else {
+                others[chr >> 5] |= static_cast<Word>(1) << (chr & 31);
+            }
+        }
+
+        // the kernels only read their opcode's operands past min and max.
+        constexpr std::size_t operands = k_header_size + 4;
+        if (members == 1) {
+            _instruction[0] = static_cast<Word>(Opcode::repeat_not_byte) | (static_cast<Word>(delimiter) << 8);
+            _scan = scan_kernel_of(Opcode::repeat_not_byte);
+        }
+        else {
+            _instruction[0] = static_cast<Word>(Opcode::repeat_charset);
+            std::copy(std::begin(others), std::end(others), &_instruction[operands]);
+            make_nibble_tables(others, &_instruction[operands + k_charset_words]);
+            _scan = scan_kernel_of(Opcode::repeat_charset);
+        }
+    }
+
+    /** the first delimiter in [begin, end), or end. */
+    [[nodiscard]] auto next(const char* begin, const char* end) const noexcept -> const char*
+    {
+        return _scan(_instruction, begin, end);
+    }
+
+private:
+    Word _instruction[k_operands_end[static_cast<std::size_t>(Opcode::repeat_charset)]] = {};
+    ScanFn _scan;
+};
+
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    std::vector<parsi_stream_t> records;
+    std::vector<parsi_result_t> results;
+    bool done = false;
+};
+
+/**
+ * Chunks of the input in flight, in a ring of slots that the threads claim in input order
+ * and the calling thread reports and frees in the same order.
+ */
+class ChunkQueue {
+public:
+    ChunkQueue(parsi_stream_t stream, const parsi_charset_t& delimiters, std::size_t slots, ParseManyFn parse_many,
+               void* parse_context)
+        : _delimiters(delimiters)
+        , _next(stream.cursor)
+        , _end(stream.cursor + stream.size)
+        , _slots(slots)
+        , _parse_many(parse_many)
+        , _parse_context(parse_context)
+    {
+    }
+
+    /** claims and parses chunks until there are none left to claim. */
+    void work()
+    {
+        std::unique_lock lock(_mutex);
+        for (;;) {
+            _changed.wait(lock, [this] { return _stopped || _next == _end || _claimed < _reported + _slots.size(); });
+            if (_stopped || _next == _end) {
+                return;
+            }
+            parse_next(lock);
+        }
+    }
+
+    /** reports the records of every chunk in order, parsing chunks as well while waiting for the next one. */
+    auto report(parsi_record_fn_t callback, void* context) -> bool
+    {
+        std::size_t index = 0;
+        std::unique_lock lock(_mutex);
+        for (;;) {
+            Chunk& chunk = _slots[_reported % _slots.size()];
+            if (_failed) {
+                return false;
+            }
+            if (_reported == _claimed && _next == _end) {
+                return true;
+            }
+            if (!chunk.done) {
+                if (_next != _end && _claimed < _reported + _slots.size()) {
+                    parse_next(lock);
+                }
+                else {
+                    _changed.wait(lock);
+                }
+                continue;
+            }
+
+            lock.unlock();
+            for (std::size_t record = 0; record < chunk.records.size(); ++record, ++index) {
+                if (!callback(context, index, chunk.records[record], chunk.results[record])) {
+                    stop();
+                    return false;
+                }
+            }
+            lock.lock();
+
+            chunk.done = false;
+            ++_reported;
+            _changed.notify_all();
+        }
+    }
+
+    /** makes the threads return once done with the chunk they're parsing. */
+    void stop()
+    {
+        const std::lock_guard lock(_mutex);
+        _stopped = true;
+        _changed.notify_all();
+    }
+
+private:
+    /** claims the next chunk under the lock, and parses it without. */
+    void parse_next(std::unique_lock<std::mutex>& lock)
+    {
+        Chunk& chunk = _slots[_claimed % _slots.size()];
+        ++_claimed;
+        chunk.begin = _next;
+        chunk.end = _end;
+        if (static_cast<std::size_t>(_end - _next) > k_chunk_size) {
+            const char* delimiter = _delimiters.next(_next + k_chunk_size - 1, _end);
+            chunk.end = delimiter == _end ? _end : delimiter + 1;
+        }
+        _next = chunk.end;
+
+        lock.unlock();
+        const bool parsed = parse(chunk);
+        lock.lock();
+
+        chunk.done = true;
+        if (!parsed) {
+            _failed = true;
+            _stopped = true;
+        }
+        _changed.notify_all();
+    }
+
+    auto parse(Chunk& chunk) noexcept -> bool
+    {
+        try {
+            chunk.records.clear();
+            for (const char* begin = chunk.begin; begin != chunk.end;) {
+                const char* delimiter = _delimiters.next(begin, chunk.end);
+                chunk.records.push_back(
+                    parsi_stream_t{ .cursor = begin, .size = static_cast<std::size_t>(delimiter - begin) });
+                begin = delimiter == chunk.end ? delimiter : delimiter + 1;
+            }
+            chunk.results.resize(chunk.records.size());
+        }
+        catch (const std::bad_alloc&) {
+            return false;
+        }
+        _parse_many(_parse_context, chunk.records.data(), chunk.results.data(), chunk.records.size());
+        return true;
+    }
+
+    const Delimiters _delimiters;
+    const char* _next;  // start of the next chunk to claim
+    const char* const _end;
+    std::vector<Chunk> _slots;
+    const ParseManyFn _parse_many;
+    void* const _parse_context;
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::size_t _claimed = 0;
+    std::size_t _reported = 0;
+    bool _stopped = false;
+    bool _failed = false;
+};
+
+}  // namespace
+
+auto parse_parallel(parsi_stream_t stream, const parsi_charset_t& delimiters, std::size_t nthreads,
+                    ParseManyFn parse_many, void* parse_context, parsi_record_fn_t callback, void* context) -> bool
+{
+    if (nthreads == 0) {
+        nthreads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    try {
+        ChunkQueue queue(stream, delimiters, nthreads * k_chunks_per_thread, parse_many, parse_context);
+
+        // the calling thread parses as well, and alone if no other thread could be started.
+        std::vector<std::thread> threads;
+        threads.reserve(nthreads - 1);
+        try {
+            while (threads.size() + 1 < nthreads) {
+                threads.emplace_back([&queue] { queue.work(); });
+            }
+        }
+        catch (const std::system_error&) {
+        }
+        catch (const std::bad_alloc&) {
+        }
+
+        const bool reported = queue.report(callback, context);
+        queue.stop();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return reported;
+    }
+    catch (const std::bad_alloc&) {
+        return false;
+    }
+}
+
+}  // namespace parsi::internal
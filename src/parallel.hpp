@@ -0,0 +1,24 @@
+#ifndef PARSI_SRC_PARALLEL_HPP
+#define PARSI_SRC_PARALLEL_HPP
+
+#include <cstddef>
+
+#include "parsi/parsi-c.h"
+
+namespace parsi::internal {
+
+/** parses each of the `count` records, same as `parsi_parse_many`. */
+using ParseManyFn = void (*)(void* context, const parsi_stream_t* records, parsi_result_t* results, std::size_t count);
+
+/**
+ * splits the stream into records at the delimiters and parses them in chunks on `nthreads` threads
+ * (the calling one included), reporting them to the callback from the calling thread in order
+ * (see `parsi_parse_parallel`).
+ */
+[[nodiscard]] auto parse_parallel(parsi_stream_t stream, const parsi_charset_t& delimiters, std::size_t nthreads,
+                                  ParseManyFn parse_many, void* parse_context, parsi_record_fn_t callback,
+                                  void* context) -> bool;
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_PARALLEL_HPP
@@ -1,20 +1,38 @@
 #include "parsi/parsi-c.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <new>
+#include <string>
+
+#include "codegen.hpp"
+#include "grammar.hpp"
+#include "jit.hpp"
+#include "parallel.hpp"
+#include "program.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PARSI_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PARSI_HAS_MMAP 0
+#include <cstdio>
+#include <vector>
+#endif
 
 struct parsi_compiled_parser {
-    parsi_parser_t* parser;
+    parsi::internal::Program program;
+    parsi::internal::JitCode jit;  // empty unless compiled with `parsi_compile_flag_jit`
 };
 
-static bool parsi_charset_check(parsi_charset_t* charset, char chr)
-{
-    const std::size_t idx = static_cast<std::size_t>(chr);
-    const std::size_t bit = static_cast<std::size_t>(1) << (idx & 63ull);  // idx % 64
-    return charset->bitset[idx >> 6ull] & bit;  // idx / 64
-}
-
 parsi_charset_t parsi_charset(const char* str)
 {
     return parsi_charset_n(str, std::strlen(str));
@@ -81,7 +99,15 @@ static void parsi_free_impl(parsi_parser_t* parser)
             }
             break;
 
+        case parsi_parser_type_capture:
+            if (parser->capture.free_parser_fn)
+            {
+                parser->capture.free_parser_fn(parser->capture.parser);
+            }
+            break;
+
         case parsi_parser_type_extract:
+        case parsi_parser_type_extract_ctx:
             if (parser->extract.free_context_fn)
             {
                 parser->extract.free_context_fn(parser->extract.context);
@@ -93,6 +119,7 @@ static void parsi_free_impl(parsi_parser_t* parser)
             break;
 
         case parsi_parser_type_custom:
+        case parsi_parser_type_custom_ctx:
             if (parser->custom.free_context_fn)
             {
                 parser->custom.free_context_fn(parser->custom.context);
@@ -114,155 +141,359 @@ void parsi_free_parser(parsi_parser_t* parser)
     std::free(parser);
 }
 
-parsi_compiled_parser_t* parsi_compile(parsi_parser_t* parser)
+namespace {
+
+/** applies the compile flags to the freshly compiled (or loaded) program. */
+auto prepare(parsi_compiled_parser_t* compiled_parser, uint32_t flags) noexcept -> bool
 {
-    return new parsi_compiled_parser_t{parser};
+    try {
+        // a loaded program may already be memoized.
+        if ((flags & parsi_compile_flag_memoize) && compiled_parser->program.memo_slots == 0) {
+            parsi::internal::memoize_program(compiled_parser->program);
+        }
+        if (flags & parsi_compile_flag_threaded_dispatch) {
+            parsi::internal::thread_program(compiled_parser->program);
+        }
+        // the native code has no memo table or profile counters, such programs stay interpreted.
+        const auto& program = compiled_parser->program;
+        if ((flags & parsi_compile_flag_jit) && program.memo_slots == 0 && program.profile_nodes.empty()) {
+            compiled_parser->jit = parsi::internal::JitCode::compile(compiled_parser->program);
+        }
+    }
+    catch (const std::bad_alloc&) {
+        return false;
+    }
+    return true;
 }
 
-void parsi_free_compiled_parser(parsi_compiled_parser_t* compiled_parser)
+}  // namespace
+
+parsi_compiled_parser_t* parsi_compile(parsi_parser_t* parser)
 {
-    delete compiled_parser;
+    return parsi_compile_ex(parser, parsi_compile_flag_none);
 }
 
-static parsi_result_t parsi_parse_impl(parsi_parser_t* parser, parsi_stream_t stream)
+parsi_compiled_parser_t* parsi_compile_ex(parsi_parser_t* parser, uint32_t flags)
 {
-    if (!parser) {
-        return parsi_result_t{ .is_valid = false, .stream = stream };
+    auto compiled_parser = new (std::nothrow) parsi_compiled_parser_t{};
+    if (!compiled_parser) {
+        return NULL;
     }
 
-    switch (parser->type) {
-        case parsi_parser_type_none:
-            return parsi_result_t{ .is_valid = false, .stream = stream };
+    using parsi::internal::Profiling;
+    const Profiling profiling = (flags & parsi_compile_flag_profile_cycles) ? Profiling::cycles
+                              : (flags & parsi_compile_flag_profile)        ? Profiling::counts
+                                                                             : Profiling::none;
+    if (!parsi::internal::compile_program(parser, compiled_parser->program, profiling)
+        || !prepare(compiled_parser, flags)) {
+        delete compiled_parser;
+        return NULL;
+    }
+    return compiled_parser;
+}
 
-        case parsi_parser_type_custom:
-            return parser->custom.func(parser->custom.context, stream);
+parsi_compiled_parser_t* parsi_compile_grammar(const char* peg_text, parsi_callback_bind_fn_t bind_fn, void* bind_ctx,
+                                               uint32_t flags, size_t* error_offset)
+{
+    parsi_compiled_parser_t* compiled_parser = NULL;
+    std::size_t offset = 0;
+    try {
+        // the tree is only needed while compiling.
+        parsi::internal::Grammar grammar;
+        if (parsi::internal::parse_grammar(peg_text, bind_fn, bind_ctx, grammar, offset)) {
+            compiled_parser = parsi_compile_ex(const_cast<parsi_parser_t*>(grammar.root), flags);
+        }
+    }
+    catch (const std::bad_alloc&) {
+    }
+    if (!compiled_parser && error_offset) {
+        *error_offset = offset;
+    }
+    return compiled_parser;
+}
 
-        case parsi_parser_type_eos:
-            return parsi_result_t{ .is_valid = (stream.size == 0), .stream = stream };
+namespace {
 
-        case parsi_parser_type_char:
-            if (stream.size >= 1 && *stream.cursor == parser->expect_char.expected) {
-                return parsi_result_t{
-                    .is_valid = true,
-                    .stream = parsi_stream_t{ .cursor = stream.cursor + 1, .size = stream.size - 1 }
-                };
-            }
-            return parsi_result_t{ .is_valid = false, .stream = stream };
+/** copies the source with its null byte if it fits, returning the size it takes. */
+auto copy_source(const std::string& source, char* buffer, std::size_t size) noexcept -> std::size_t
+{
+    if (buffer && source.size() < size) {
+        std::memcpy(buffer, source.c_str(), source.size() + 1);
+    }
+    return source.size() + 1;
+}
 
-        case parsi_parser_type_charset:
-            if (stream.size >= 1 && parsi_charset_check(&parser->expect_charset.expected, *stream.cursor)) {
-                return parsi_result_t{
-                    .is_valid = true,
-                    .stream = parsi_stream_t{ .cursor = stream.cursor + 1, .size = stream.size - 1 }
-                };
-            }
-            return parsi_result_t{ .is_valid = false, .stream = stream };
+// the callbacks of a grammar being generated are bound to stand-ins that carry their name as context.
+auto unbound_parse(void* /* context */, parsi_stream_t stream) -> parsi_result_t
+{
+    return parsi_result_t{ .is_valid = false, .stream = stream };
+}
 
-        case parsi_parser_type_string:
-            if (stream.size >= parser->expect_string.size
-                    && strncmp(stream.cursor, parser->expect_string.string, parser->expect_string.size) == 0) {
-                return parsi_result_t{
-                    .is_valid = true,
-                    .stream = parsi_stream_t{
-                        .cursor = stream.cursor + parser->expect_string.size,
-                        .size = stream.size - parser->expect_string.size
-                    }
-                };
-            }
-            return parsi_result_t{ .is_valid = false, .stream = stream };
+auto unbound_visit(void* /* context */, const char* /* str */, size_t /* size */) -> bool
+{
+    return false;
+}
 
-        case parsi_parser_type_static_string:
-            if (stream.size >= parser->expect_static_string.size
-                    && strncmp(stream.cursor, parser->expect_static_string.string, parser->expect_static_string.size) == 0) {
-                return parsi_result_t{
-                    .is_valid = true,
-                    .stream = parsi_stream_t{
-                        .cursor = stream.cursor + parser->expect_static_string.size,
-                        .size = stream.size - parser->expect_static_string.size
-                    }
-                };
-            }
-            return parsi_result_t{ .is_valid = false, .stream = stream };
+}  // namespace
 
-        case parsi_parser_type_extract: {
-            parsi_result_t result = parsi_parse_impl(parser->extract.parser, stream);
-            if (result.is_valid) {
-                result.is_valid = parser->extract.func(parser->extract.context, stream.cursor, stream.size - result.stream.size);
-                return result;
-            }
-            return parsi_result_t{ .is_valid = false, .stream = result.stream };
+size_t parsi_generate_cpp(parsi_parser_t* parser, const char* symbol, parsi_callback_name_fn_t name_fn, void* name_ctx,
+                          char* buffer, size_t size)
+{
+    try {
+        std::string source;
+        if (!parsi::internal::generate_cpp(parser, symbol, name_fn, name_ctx, source)) {
+            return 0;
         }
+        return copy_source(source, buffer, size);
+    }
+    catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
 
-        case parsi_parser_type_sequence: {
-            if (!parser->sequence.parsers) {
-                return parsi_result_t{ .is_valid = true, .stream = stream };
-            }
-
-            parsi_result_t result = { .is_valid = true, .stream = stream };
-            for (std::size_t index = 0; index < parser->sequence.size; ++index) {
-                result = parsi_parse_impl(&parser->sequence.parsers[index], result.stream);
-                if (!result.is_valid) {
-                    return result;
-                }
+size_t parsi_generate_cpp_grammar(const char* peg_text, const char* symbol, char* buffer, size_t size,
+                                  size_t* error_offset)
+{
+    std::size_t offset = 0;
+    try {
+        std::deque<std::string> names;
+        const auto bind = [](void* ctx, const char* name, parsi_callback_t* callback) -> bool {
+            auto& names = *static_cast<std::deque<std::string>*>(ctx);
+            *callback = parsi_callback_t{};
+            callback->parse_fn = unbound_parse;
+            callback->visit_fn = unbound_visit;
+            callback->context = names.emplace_back(name).data();
+            return true;
+        };
+        const auto name_of = [](void* /* ctx */, parsi_callback_t callback) -> const char* {
+            return static_cast<const char*>(callback.context);
+        };
+
+        parsi::internal::Grammar grammar;
+        std::string source;
+        if (parsi::internal::parse_grammar(peg_text, bind, &names, grammar, offset)) {
+            if (!parsi::internal::generate_cpp(grammar.root, symbol, name_of, nullptr, source)) {
+                return 0;
             }
-            return result;
+            return copy_source(source, buffer, size);
         }
+    }
+    catch (const std::bad_alloc&) {
+        return 0;
+    }
+    if (error_offset) {
+        *error_offset = offset;
+    }
+    return 0;
+}
 
-        case parsi_parser_type_anyof: {
-            if (!parser->anyof.parsers) {
-                return parsi_result_t{ .is_valid = true, .stream = stream };
-            }
+void parsi_free_compiled_parser(parsi_compiled_parser_t* compiled_parser)
+{
+    delete compiled_parser;
+}
 
-            for (std::size_t index = 0; index < parser->anyof.size; ++index) {
-                if (auto result = parsi_parse_impl(&parser->anyof.parsers[index], stream); result.is_valid) {
-                    return result;
-                }
-            }
+parsi_result_t parsi_parse(parsi_compiled_parser_t* compiled_parser, parsi_stream_t stream)
+{
+    return parsi_parse_ctx(compiled_parser, stream, nullptr);
+}
 
-            return parsi_result_t{ .is_valid = false, .stream = stream };
-        }
+parsi_result_t parsi_parse_ctx(parsi_compiled_parser_t* compiled_parser, parsi_stream_t stream, void* call_ctx)
+{
+    if (compiled_parser->jit && compiled_parser->program.max_depth == 0) {
+        return compiled_parser->jit.run(stream, call_ctx);
+    }
+    return parsi::internal::run_program(compiled_parser->program, stream, call_ctx);
+}
 
-        case parsi_parser_type_repeat: {
-            if (parser->repeat.min > parser->repeat.max) [[unlikely]] {
-                return parsi_result_t{ .is_valid = false, .stream = stream };
-            }
+void parsi_parse_many(parsi_compiled_parser_t* compiled_parser, const parsi_stream_t* inputs,
+                      parsi_result_t* outputs, size_t count)
+{
+    if (compiled_parser->jit && compiled_parser->program.max_depth == 0) {
+        compiled_parser->jit.run_many(inputs, outputs, count);
+        return;
+    }
+    parsi::internal::run_program_many(compiled_parser->program, inputs, outputs, count);
+}
+
+bool parsi_parse_parallel(parsi_compiled_parser_t* compiled_parser, parsi_stream_t stream, parsi_charset_t delimiters,
+                          size_t nthreads, parsi_record_fn_t callback, void* context)
+{
+    const auto parse_many = [](void* parser, const parsi_stream_t* records, parsi_result_t* results, std::size_t count) {
+        parsi_parse_many(static_cast<parsi_compiled_parser_t*>(parser), records, results, count);
+    };
+    return parsi::internal::parse_parallel(stream, delimiters, nthreads, parse_many, compiled_parser, callback, context);
+}
+
+parsi_result_t parsi_parse_captures(parsi_compiled_parser_t* compiled_parser, parsi_stream_t stream, parsi_span_t* slots,
+                                    size_t nslots)
+{
+    return parsi::internal::run_program_captures(compiled_parser->program, stream, slots, nslots);
+}
 
-            std::size_t count = 0;
-            parsi_result_t result = parsi_parse_impl(parser->repeat.parser, stream);
-            while (result.is_valid) {
-                ++count;
+void parsi_set_max_depth(parsi_compiled_parser_t* compiled_parser, size_t max_depth)
+{
+    compiled_parser->program.max_depth = max_depth;
+}
 
-                if (count > parser->repeat.max) [[unlikely]] {
-                    break;
-                }
+size_t parsi_stack_frame_size(void)
+{
+    return parsi::internal::frame_size();
+}
 
-                stream = result.stream;
-                result = parsi_parse_impl(parser->repeat.parser, stream);
-            }
+parsi_result_t parsi_parse_with_stack(parsi_compiled_parser_t* compiled_parser, parsi_stream_t stream, void* buffer,
+                                      size_t size)
+{
+    return parsi::internal::run_program_with_stack(compiled_parser->program, stream, buffer, size);
+}
 
-            if (count < parser->repeat.min || parser->repeat.max < count) [[unlikely]] {
-                return parsi_result_t{ .is_valid = false, .stream = result.stream };
-            }
+parsi_stream_state_t* parsi_stream_begin(parsi_compiled_parser_t* compiled_parser, void* call_ctx)
+{
+    return parsi::internal::begin_stream(compiled_parser->program, call_ctx);
+}
+
+parsi_stream_status_enum parsi_stream_feed(parsi_stream_state_t* state, parsi_stream_t chunk)
+{
+    return parsi::internal::feed_stream(*state, chunk);
+}
+
+parsi_stream_status_enum parsi_stream_end(parsi_stream_state_t* state, size_t* position)
+{
+    std::size_t stopped = 0;
+    const parsi_stream_status_enum status = parsi::internal::end_stream(state, stopped);
+    if (position) {
+        *position = stopped;
+    }
+    return status;
+}
+
+size_t parsi_compiled_serialize(const parsi_compiled_parser_t* compiled_parser, parsi_callback_name_fn_t name_fn,
+                                void* name_ctx, void* buffer, size_t size)
+{
+    return parsi::internal::serialize_program(compiled_parser->program, name_fn, name_ctx, buffer, size);
+}
+
+parsi_compiled_parser_t* parsi_compiled_load(const void* data, size_t size, parsi_callback_bind_fn_t bind_fn,
+                                             void* bind_ctx, uint32_t flags)
+{
+    auto compiled_parser = new (std::nothrow) parsi_compiled_parser_t{};
+    if (!compiled_parser) {
+        return NULL;
+    }
 
-            return parsi_result_t{ .is_valid = true, .stream = stream };
+    try {
+        if (!parsi::internal::load_program(data, size, bind_fn, bind_ctx, compiled_parser->program)
+            || !prepare(compiled_parser, flags)) {
+            delete compiled_parser;
+            return NULL;
         }
+    }
+    catch (const std::bad_alloc&) {
+        delete compiled_parser;
+        return NULL;
+    }
+    return compiled_parser;
+}
 
-        case parsi_parser_type_optional: {
-            parsi_result_t result = parsi_parse_impl(parser->optional.parser, stream);
-            if (result.is_valid) {
-                return result;
-            }
-            return parsi_result_t{ .is_valid = true, .stream = stream };
+parsi_compiled_parser_t* parsi_compiled_load_file(const char* path, parsi_callback_bind_fn_t bind_fn, void* bind_ctx,
+                                                  uint32_t flags)
+{
+#if PARSI_HAS_MMAP
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        return NULL;
+    }
+    const auto size = static_cast<size_t>(info.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    auto compiled_parser = parsi_compiled_load(data, size, bind_fn, bind_ctx, flags);
+    ::munmap(data, size);
+    return compiled_parser;
+#else
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    std::vector<char> data;
+    char chunk[4096];
+    try {
+        for (std::size_t count; (count = std::fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+            data.insert(data.end(), chunk, chunk + count);
         }
     }
+    catch (const std::bad_alloc&) {
+        std::fclose(file);
+        return NULL;
+    }
+    std::fclose(file);
+    return parsi_compiled_load(data.data(), data.size(), bind_fn, bind_ctx, flags);
+#endif
+}
 
-    // this should be unreachable.
-    return parsi_result_t{ .is_valid = false, .stream = stream };
+size_t parsi_profile_get(const parsi_compiled_parser_t* compiled_parser, parsi_profile_entry_t* entries,
+                         size_t capacity)
+{
+    const auto& program = compiled_parser->program;
+    const std::size_t size = program.profile_nodes.size();
+    for (std::size_t index = 0; index < size && index < capacity; ++index) {
+        const auto& node = program.profile_nodes[index];
+        const auto& counters = program.profile_counters[index];
+        // successes are counted after invocations, so with parses in flight they're read first.
+        const std::uint64_t successes = counters.successes.load(std::memory_order_relaxed);
+        const std::uint64_t invocations = std::max(counters.invocations.load(std::memory_order_relaxed), successes);
+        entries[index] = parsi_profile_entry_t{
+            .node = node.parser,
+            .type = node.type,
+            .invocations = invocations,
+            .successes = successes,
+            .failures = invocations - successes,
+            .consumed = counters.consumed.load(std::memory_order_relaxed),
+            .cycles = counters.cycles.load(std::memory_order_relaxed),
+        };
+    }
+    return size;
 }
 
-parsi_result_t parsi_parse(parsi_compiled_parser_t* compiled_parser, parsi_stream_t stream)
+void parsi_profile_reset(parsi_compiled_parser_t* compiled_parser)
 {
-    return parsi_parse_impl(compiled_parser->parser, stream);
+    auto& program = compiled_parser->program;
+    for (std::size_t index = 0; index < program.profile_nodes.size(); ++index) {
+        auto& counters = program.profile_counters[index];
+        counters.invocations.store(0, std::memory_order_relaxed);
+        counters.successes.store(0, std::memory_order_relaxed);
+        counters.consumed.store(0, std::memory_order_relaxed);
+        counters.cycles.store(0, std::memory_order_relaxed);
+    }
+}
+
+void parsi_set_memo_limit(parsi_compiled_parser_t* compiled_parser, size_t max_bytes)
+{
+    compiled_parser->program.memo_limit = max_bytes;
+}
+
+parsi_memo_stats_t parsi_memo_stats(const parsi_compiled_parser_t* compiled_parser)
+{
+    const auto& stats = compiled_parser->program.memo_stats;
+    return parsi_memo_stats_t{
+        .lookups = stats.lookups.load(std::memory_order_relaxed),
+        .hits = stats.hits.load(std::memory_order_relaxed),
+        .evictions = stats.evictions.load(std::memory_order_relaxed),
+    };
+}
+
+void parsi_memo_stats_reset(parsi_compiled_parser_t* compiled_parser)
+{
+    auto& stats = compiled_parser->program.memo_stats;
+    stats.lookups.store(0, std::memory_order_relaxed);
+    stats.hits.store(0, std::memory_order_relaxed);
+    stats.evictions.store(0, std::memory_order_relaxed);
 }
 
 //-- helpers
@@ -284,6 +515,18 @@ parsi_parser_t parsi_custom_parser(parsi_parser_fn_t func, void* context, parsi_
     };
 }
 
+parsi_parser_t parsi_custom_parser_ctx(parsi_parser_ctx_fn_t func, void* context, parsi_free_fn_t free_context_fn)
+{
+    return parsi_parser_t{
+        .type = parsi_parser_type_custom_ctx,
+        .custom = {
+            .ctx_func = func,
+            .context = context,
+            .free_context_fn = free_context_fn
+        }
+    };
+}
+
 parsi_parser_t parsi_expect_eos()
 {
     return parsi_parser_t{ .type = parsi_parser_type_eos };
@@ -347,6 +590,20 @@ parsi_parser_t parsi_combine_extract(parsi_parser_t* parser, parsi_extract_visit
     };
 }
 
+parsi_parser_t parsi_combine_extract_ctx(parsi_parser_t* parser, parsi_extract_visitor_ctx_fn_t func, void* context, parsi_free_fn_t free_context_fn, parsi_parser_free_fn_t free_parser_fn)
+{
+    return parsi_parser_t{
+        .type = parsi_parser_type_extract_ctx,
+        .extract = {
+            .parser = parser,
+            .ctx_func = func,
+            .context = context,
+            .free_context_fn = free_context_fn,
+            .free_parser_fn = free_parser_fn
+        }
+    };
+}
+
 parsi_parser_t parsi_combine_sequence(parsi_parser_t* parsers, parsi_parser_list_free_fn_t free_list_fn)
 {
     if (!parsers) {
@@ -414,3 +671,11 @@ parsi_parser_t parsi_combine_optional(parsi_parser_t* parser, parsi_parser_free_
         .optional = { .parser = parser, .free_parser_fn = free_parser_fn }
     };
 }
+
+parsi_parser_t parsi_combine_capture(parsi_parser_t* parser, size_t slot, parsi_parser_free_fn_t free_parser_fn)
+{
+    return parsi_parser_t{
+        .type = parsi_parser_type_capture,
+        .capture = { .parser = parser, .slot = slot, .free_parser_fn = free_parser_fn }
+    };
+}
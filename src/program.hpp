@@ -0,0 +1,332 @@
+#ifndef PARSI_SRC_PROGRAM_HPP
+#define PARSI_SRC_PROGRAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "parsi/parsi-c.h"
+
+namespace parsi::internal {
+
+/**
+ * Operation codes of the flat program that `parsi_compile` lowers a parser tree into.
+ *
+ * Every instruction starts with a two word header:
+ * `[opcode | (immediate << 8)] [length in words including children]`,
+ * followed by the opcode specific operands and then its children (if any) inline,
+ * so the next sibling of any instruction is always at `pc + length`.
+ */
+enum class Opcode : std::uint8_t {
+    fail = 0,  // []
+    custom,    // [callback index]
+    eos,       // []
+    byte,      // [] with the expected byte as immediate
+    charset,   // [8 words of bitset]
+    string,    // [size] [bytes padded to words...] [ends of merged literals but the last...] with their count as immediate
+    extract,   // [callback index] child
+    sequence,  // children...
+    anyof,     // children...
+    repeat,    // [min lo] [min hi] [max lo] [max hi] child
+    optional,  // child
+    call,      // [target pc]
+
+    // `repeat` over a single byte parser, scanned in bulk.
+    repeat_byte,      // [min lo] [min hi] [max lo] [max hi] with the repeated byte as immediate
+    repeat_not_byte,  // [min lo] [min hi] [max lo] [max hi] with the excluded byte as immediate
+    repeat_charset,   // [min lo] [min hi] [max lo] [max hi] [8 words of bitset] [8 words of nibble tables]
+
+    memo_call,  // [target pc] with the memo slot as immediate
+
+    // `anyof` trying only the alternatives that can start with the next byte.
+    dispatch,  // [257 words of child offsets by next byte, or 256 at the end, 0 fails] children...
+
+    // counts the runs of its child, emitted around every node when profiling.
+    profile,  // [profile slot] child with 1 as immediate to count cycles as well
+
+    // `anyof` of only literals, matched in one walk down a byte trie (see `make_trie`).
+    trie,  // trie nodes...
+
+    // records the span its child matched, when parsing with captures.
+    capture,  // [slot lo] [slot hi] child
+};
+
+inline constexpr std::size_t k_opcode_count = static_cast<std::size_t>(Opcode::capture) + 1;
+
+using Word = std::uint32_t;
+
+inline constexpr std::size_t k_header_size = 2;
+inline constexpr std::size_t k_charset_words = 256 / (8 * sizeof(Word));
+inline constexpr std::size_t k_dispatch_entries = 256 + 1;
+
+/** number of words before the first child (or the end) of each opcode's instruction. */
+inline constexpr std::size_t k_operands_end[k_opcode_count] = {
+    k_header_size,                    // fail
+    k_header_size + 1,                // custom
+    k_header_size,                    // eos
+    k_header_size,                    // byte
+    k_header_size + k_charset_words,  // charset
+    k_header_size + 1,                // string (without the bytes)
+    k_header_size + 1,                // extract
+    k_header_size,                    // sequence
+    k_header_size,                    // anyof
+    k_header_size + 4,                // repeat
+    k_header_size,                    // optional
+    k_header_size + 1,                // call
+    k_header_size + 4,                // repeat_byte
+    k_header_size + 4,                // repeat_not_byte
+    k_header_size + 4 + 2 * k_charset_words,  // repeat_charset
+    k_header_size + 1,                // memo_call
+    k_header_size + k_dispatch_entries,  // dispatch
+    k_header_size + 1,                // profile
+    k_header_size,                    // trie (without the nodes)
+    k_header_size + 2,                // capture
+};
+
+/** a custom or extract callback, either of the plain or of the call context taking (`_ctx_fn`) kind. */
+struct Callback {
+    parsi_parser_fn_t parse_fn = nullptr;
+    parsi_extract_visitor_fn_t visit_fn = nullptr;
+    parsi_parser_ctx_fn_t parse_ctx_fn = nullptr;
+    parsi_extract_visitor_ctx_fn_t visit_ctx_fn = nullptr;
+    void* context = nullptr;
+};
+
+/** counters of memo table use, accumulated over all parses of a program. */
+struct MemoStats {
+    std::atomic<std::size_t> lookups{0};
+    std::atomic<std::size_t> hits{0};
+    std::atomic<std::size_t> evictions{0};
+};
+
+/** counters of a profiled node, accumulated over all parses of a program. */
+struct ProfileCounters {
+    std::atomic<std::uint64_t> invocations{0};
+    std::atomic<std::uint64_t> successes{0};
+    std::atomic<std::uint64_t> consumed{0};  // bytes, by successful runs
+    std::atomic<std::uint64_t> cycles{0};
+};
+
+/** the parser node that a profile slot counts the runs of. */
+struct ProfileNode {
+    const parsi_parser_t* parser;
+    parsi_parser_type_enum type;
+};
+
+inline constexpr std::size_t k_default_memo_limit = 16 * 1024 * 1024;
+
+/**
+ * A compiled parser laid out contiguously in memory,
+ * with the side table of callbacks that custom and extract instructions refer to.
+ */
+struct Program {
+    std::vector<Word> code;
+    std::vector<Callback> callbacks;
+
+    /** handler addresses parallel to `code` for threaded dispatch, empty for switch dispatch. */
+    std::vector<const void*> threaded_code;
+
+    /** number of distinct `memo_call` targets, zero unless memoized. */
+    std::size_t memo_slots = 0;
+    /** upper bound in bytes of the memo table allocated per parse. */
+    std::size_t memo_limit = k_default_memo_limit;
+    mutable MemoStats memo_stats;
+
+    /** profiled nodes by profile slot and their counters, empty unless profiled. */
+    std::vector<ProfileNode> profile_nodes;
+    std::unique_ptr<ProfileCounters[]> profile_counters;
+
+    /** most combinators pending at once during a parse, zero for no limit. */
+    std::size_t max_depth = 0;
+};
+
+/** whether the instruction has children inline. */
+[[nodiscard]] constexpr auto is_composite(Opcode opcode) noexcept -> bool
+{
+    return opcode == Opcode::extract
+        || opcode == Opcode::sequence
+        || opcode == Opcode::anyof
+        || opcode == Opcode::repeat
+        || opcode == Opcode::optional
+        || opcode == Opcode::dispatch
+        || opcode == Opcode::profile
+        || opcode == Opcode::capture;
+}
+
+[[nodiscard]] constexpr auto opcode_of(const Word* code, std::size_t pc) noexcept -> Opcode
+{
+    return static_cast<Opcode>(code[pc] & 0xFF);
+}
+
+[[nodiscard]] constexpr auto immediate_of(const Word* code, std::size_t pc) noexcept -> Word
+{
+    return code[pc] >> 8;
+}
+
+[[nodiscard]] constexpr auto length_of(const Word* code, std::size_t pc) noexcept -> std::size_t
+{
+    return code[pc + 1];
+}
+
+[[nodiscard]] constexpr auto end_of(const Word* code, std::size_t pc) noexcept -> std::size_t
+{
+    return pc + code[pc + 1];
+}
+
+[[nodiscard]] constexpr auto operands_end_of(Opcode opcode) noexcept -> std::size_t
+{
+    return k_operands_end[static_cast<std::size_t>(opcode)];
+}
+
+/** position of the first child of a composite instruction. */
+[[nodiscard]] constexpr auto first_child_of(const Word* code, std::size_t pc) noexcept -> std::size_t
+{
+    return pc + operands_end_of(opcode_of(code, pc));
+}
+
+[[nodiscard]] constexpr auto size_operand_of(const Word* code, std::size_t pos) noexcept -> std::size_t
+{
+    return static_cast<std::size_t>(code[pos])
+         | static_cast<std::size_t>(static_cast<std::uint64_t>(code[pos + 1]) << 32);
+}
+
+[[nodiscard]] constexpr auto charset_contains(const Word* charset, unsigned char chr) noexcept -> bool
+{
+    return (charset[chr >> 5] >> (chr & 31)) & 1;
+}
+
+/** the bits of a `parsi_charset_t` as the words of a charset operand. */
+constexpr void to_words(const parsi_charset_t& charset, Word (&words)[k_charset_words]) noexcept
+{
+    constexpr std::size_t cell_bits = 8 * sizeof(parsi_charset_t{}.bitset[0]);
+    constexpr std::size_t cell_count = std::size(parsi_charset_t{}.bitset);
+
+    std::fill(std::begin(words), std::end(words), 0);
+    for (std::size_t chr = 0; chr < 256 && chr / cell_bits < cell_count; ++chr) {
+        if ((charset.bitset[chr / cell_bits] >> (chr % cell_bits)) & 1) {
+            words[chr >> 5] |= static_cast<Word>(1) << (chr & 31);
+        }
+    }
+}
+
+[[nodiscard]] inline auto string_bytes_of(const Word* code, std::size_t pc) noexcept -> const char*
+{
+    return reinterpret_cast<const char*>(&code[pc + operands_end_of(Opcode::string)]);
+}
+
+/**
+ * number of bytes a failed string instruction goes past: for literals merged out of a sequence,
+ * the end of the last of them that did match, where the sequence would have failed.
+ */
+[[nodiscard]] inline auto matched_literals_of(const Word* instruction, const char* begin, const char* end) noexcept
+    -> std::size_t
+{
+    const std::size_t size = instruction[k_header_size];
+    const char* bytes = reinterpret_cast<const char*>(instruction + operands_end_of(Opcode::string));
+    const Word* ends = instruction + operands_end_of(Opcode::string) + (size + sizeof(Word) - 1) / sizeof(Word);
+
+    std::size_t matched = 0;
+    while (matched < size && begin + matched != end && begin[matched] == bytes[matched]) {
+        ++matched;
+    }
+    std::size_t skipped = 0;
+    for (Word index = 0; index < immediate_of(instruction, 0) && ends[index] <= matched; ++index) {
+        skipped = ends[index];
+    }
+    return skipped;
+}
+
+/** what to instrument the compiled program with. */
+enum class Profiling : std::uint8_t {
+    none,
+    counts,
+    cycles,  // counts as well
+};
+
+/**
+ * lowers the given parser tree into `program`.
+ * shared and cyclic subparsers (the same node reachable from multiple parents)
+ * are emitted once and referred to by `call` instructions.
+ * returns false if the tree couldn't be represented.
+ */
+[[nodiscard]] auto compile_program(const parsi_parser_t* parser, Program& program,
+                                   Profiling profiling = Profiling::none) -> bool;
+
+/**
+ * turns the calls to shared and recursive subparsers that don't run callbacks or capture
+ * (no custom, extract or capture instructions, directly or through calls) into `memo_call`s,
+ * whose results are cached per position for the duration of a parse.
+ */
+void memoize_program(Program& program);
+
+/**
+ * prepares `program` for threaded dispatch (computed goto).
+ * returns false if the compiler doesn't support it, the program then uses switch dispatch.
+ */
+auto thread_program(Program& program) -> bool;
+
+/**
+ * writes `program` into `buffer` if it has room for it, with the callbacks named by `name_fn`,
+ * returns the size it takes, or 0 if a callback couldn't be named or the program is profiled.
+ */
+[[nodiscard]] auto serialize_program(const Program& program, parsi_callback_name_fn_t name_fn, void* name_context,
+                                     void* buffer, std::size_t size) noexcept -> std::size_t;
+
+/**
+ * reads a program written by `serialize_program` into `program`, with the callbacks bound by `bind_fn`.
+ * returns false if the data is truncated, of another format version, or has unbound callbacks.
+ */
+[[nodiscard]] auto load_program(const void* data, std::size_t size, parsi_callback_bind_fn_t bind_fn,
+                                void* bind_context, Program& program) -> bool;
+
+/** runs the compiled `program` on the given `stream`, handing `call_ctx` to the callbacks taking one. */
+[[nodiscard]] auto run_program(const Program& program, parsi_stream_t stream, void* call_ctx = nullptr) noexcept
+    -> parsi_result_t;
+
+/**
+ * runs the compiled `program` with its pending combinators kept in the `size` bytes of `buffer`,
+ * failing the parse instead of allocating once they don't fit.
+ */
+[[nodiscard]] auto run_program_with_stack(const Program& program, parsi_stream_t stream, void* buffer,
+                                          std::size_t size) noexcept -> parsi_result_t;
+
+/**
+ * runs the compiled `program`, filling the first `count` of `slots` with the spans
+ * of its capture instructions on the successful path, see `parsi_parse_captures`.
+ */
+[[nodiscard]] auto run_program_captures(const Program& program, parsi_stream_t stream, parsi_span_t* slots,
+                                        std::size_t count) noexcept -> parsi_result_t;
+
+/** bytes taken by each pending combinator of a parse. */
+[[nodiscard]] auto frame_size() noexcept -> std::size_t;
+
+/** runs the compiled `program` on each of the `count` inputs into the matching output. */
+void run_program_many(const Program& program, const parsi_stream_t* inputs, parsi_result_t* outputs,
+                      std::size_t count) noexcept;
+
+/** starts a parse of input fed in chunks, see `parsi_stream_begin`, returns null if out of memory. */
+[[nodiscard]] auto begin_stream(const Program& program, void* call_ctx) noexcept -> parsi_stream_state_t*;
+
+/** parses the next chunk of the input, see `parsi_stream_feed`. */
+auto feed_stream(parsi_stream_state_t& state, parsi_stream_t chunk) noexcept -> parsi_stream_status_enum;
+
+/** finishes the parse at the end of the input into `position` and frees the state, see `parsi_stream_end`. */
+auto end_stream(parsi_stream_state_t* state, std::size_t& position) noexcept -> parsi_stream_status_enum;
+
+/** hints the cpu to start loading the memory at `ptr`, such as the next input of a batch. */
+inline void prefetch(const void* ptr) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(ptr);
+#else
+    (void)ptr;
+#endif
+}
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_PROGRAM_HPP
@@ -0,0 +1,72 @@
+#include "scan.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include "parsi/internal/simd.hpp"
+
+namespace parsi::internal {
+
+namespace {
+
+constexpr std::size_t k_scan_operands = k_header_size + 4;
+
+// the kernels are those of the header-only parsers in `parsi/internal/simd.hpp`,
+// which pick the widest the running cpu supports (once), or none with `PARSI_NO_SIMD`.
+
+[[nodiscard]] constexpr auto scanned_byte_of(const Word* instruction) noexcept -> char
+{
+    return static_cast<char>(instruction[0] >> 8);
+}
+
+[[nodiscard]] constexpr auto charset_of(const Word* instruction) noexcept -> const Word*
+{
+    return instruction + k_scan_operands;
+}
+
+[[nodiscard]] auto nibble_tables_of(const Word* instruction) noexcept -> const std::uint8_t*
+{
+    return reinterpret_cast<const std::uint8_t*>(instruction + k_scan_operands + k_charset_words);
+}
+
+auto scan_byte_kernel(const Word* instruction, const char* begin, const char* end) noexcept -> const char*
+{
+    return scan_byte(scanned_byte_of(instruction), begin, end);
+}
+
+auto scan_not_byte_kernel(const Word* instruction, const char* begin, const char* end) noexcept -> const char*
+{
+    return find_byte(scanned_byte_of(instruction), begin, end);
+}
+
+auto scan_charset_kernel(const Word* instruction, const char* begin, const char* end) noexcept -> const char*
+{
+    const Word* charset = charset_of(instruction);
+    const std::uint8_t* tables = nibble_tables_of(instruction);
+    return scan_nibble_rows([charset](std::uint8_t byte) { return charset_contains(charset, byte); }, tables,
+                            tables + 16, begin, end);
+}
+
+}  // namespace
+
+auto scan_kernel_of(Opcode opcode) noexcept -> ScanFn
+{
+    switch (opcode) {
+        case Opcode::repeat_byte:
+            return scan_byte_kernel;
+        case Opcode::repeat_not_byte:
+            return scan_not_byte_kernel;
+        default:
+            return scan_charset_kernel;
+    }
+}
+
+void make_nibble_tables(const Word* charset, Word* tables) noexcept
+{
+    // the low rows (high nibbles 0-7) take the first 4 words, the high rows (8-15) the last 4.
+    std::uint8_t rows[32] = {0};
+    fill_nibble_rows([charset](std::uint8_t byte) { return charset_contains(charset, byte); }, rows, rows + 16);
+    std::memcpy(tables, rows, sizeof(rows));
+}
+
+}  // namespace parsi::internal
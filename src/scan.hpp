@@ -0,0 +1,48 @@
+#ifndef PARSI_SRC_SCAN_HPP
+#define PARSI_SRC_SCAN_HPP
+
+#include <cstddef>
+
+#include "program.hpp"
+
+namespace parsi::internal {
+
+/**
+ * Kernel of a `repeat_byte`, `repeat_not_byte` or `repeat_charset` instruction,
+ * returns the end of the run of matching bytes that starts at `begin`, up to `end`.
+ */
+using ScanFn = auto (*)(const Word* instruction, const char* begin, const char* end) noexcept -> const char*;
+
+/** the fastest kernel of the given scan opcode that the running cpu supports. */
+[[nodiscard]] auto scan_kernel_of(Opcode opcode) noexcept -> ScanFn;
+
+/**
+ * fills the 8 words of `tables` with the nibble lookup tables of `charset`
+ * that the vectorized `repeat_charset` kernels use.
+ */
+void make_nibble_tables(const Word* charset, Word* tables) noexcept;
+
+/**
+ * runs the scan instruction at `pc` with the repeat's min/max semantics,
+ * resuming after the first `scanned` bytes when they're known to match.
+ */
+[[nodiscard]] inline auto run_scan(const Word* code, std::size_t pc, parsi_stream_t stream,
+                                   std::size_t scanned = 0) noexcept -> parsi_result_t
+{
+    const std::size_t min = size_operand_of(code, pc + k_header_size);
+    const std::size_t max = size_operand_of(code, pc + k_header_size + 2);
+
+    // one byte past max is enough to know the repeat failed.
+    const std::size_t limit = max < stream.size ? max + 1 : stream.size;
+    const char* run_end = scan_kernel_of(opcode_of(code, pc))(&code[pc], stream.cursor + scanned, stream.cursor + limit);
+
+    const auto count = static_cast<std::size_t>(run_end - stream.cursor);
+    return parsi_result_t{
+        .is_valid = min <= count && count <= max,
+        .stream = { .cursor = run_end, .size = stream.size - count },
+    };
+}
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_SCAN_HPP
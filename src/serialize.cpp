@@ -0,0 +1,249 @@
+#include "program.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace parsi::internal {
+
+namespace {
+
+// bumped on every change to the layout or to the instruction set.
+constexpr Word k_magic = 0x43495350;  // "PSIC" in little endian
+constexpr Word k_format_version = 4;
+
+enum class CallbackKind : Word {
+    custom = 0,
+    extract = 1,
+    custom_ctx = 2,
+    extract_ctx = 3,
+};
+
+[[nodiscard]] auto kind_of(const Callback& callback) noexcept -> CallbackKind
+{
+    return callback.parse_fn     ? CallbackKind::custom
+         : callback.visit_fn     ? CallbackKind::extract
+         : callback.parse_ctx_fn ? CallbackKind::custom_ctx
+                                 : CallbackKind::extract_ctx;
+}
+
+/** the callback of the given kind out of the bound one, or nothing if it isn't set. */
+[[nodiscard]] auto callback_of(CallbackKind kind, const parsi_callback_t& bound) noexcept -> Callback
+{
+    switch (kind) {
+        case CallbackKind::custom:
+            return Callback{ .parse_fn = bound.parse_fn, .context = bound.context };
+        case CallbackKind::extract:
+            return Callback{ .visit_fn = bound.visit_fn, .context = bound.context };
+        case CallbackKind::custom_ctx:
+            return Callback{ .parse_ctx_fn = bound.parse_ctx_fn, .context = bound.context };
+        case CallbackKind::extract_ctx:
+            return Callback{ .visit_ctx_fn = bound.visit_ctx_fn, .context = bound.context };
+    }
+    return Callback{};
+}
+
+[[nodiscard]] constexpr auto is_set(const Callback& callback) noexcept -> bool
+{
+    return callback.parse_fn || callback.visit_fn || callback.parse_ctx_fn || callback.visit_ctx_fn;
+}
+
+/**
+ * The serialized layout, all in native endian words:
+ * `[magic] [version] [code size] [callback count] [memo slots]`, the code words,
+ * then `[kind] [name size] [name bytes padded to words...]` of each callback.
+ */
+struct Header {
+    Word magic;
+    Word version;
+    Word code_size;
+    Word callback_count;
+    Word memo_slots;
+};
+
+[[nodiscard]] constexpr auto words_of(std::size_t bytes) noexcept -> std::size_t
+{
+    return (bytes + sizeof(Word) - 1) / sizeof(Word);
+}
+
+/** writes words into the buffer while it fits, and counts them either way. */
+class Writer {
+public:
+    Writer(void* buffer, std::size_t size) noexcept
+        : _buffer(static_cast<unsigned char*>(buffer))
+        , _size(buffer ? size : 0)
+    {
+    }
+
+    [[nodiscard]] auto written() const noexcept -> std::size_t
+    {
+        return _offset;
+    }
+
+    void write(const void* data, std::size_t size) noexcept
+    {
+        if (_offset + size <= _size) {
+            std::memcpy(_buffer + _offset, data, size);
+        }
+        _offset += size;
+    }
+
+    void write_word(Word word) noexcept
+    {
+        write(&word, sizeof(word));
+    }
+
+    /** writes the bytes followed by zeros up to the next word. */
+    void write_padded(const char* data, std::size_t size) noexcept
+    {
+        write(data, size);
+        const Word zero = 0;
+        write(&zero, words_of(size) * sizeof(Word) - size);
+    }
+
+private:
+    unsigned char* _buffer;
+    std::size_t _size;
+    std::size_t _offset = 0;
+};
+
+/** reads out of the data, failing on reads past its end. */
+class Reader {
+public:
+    Reader(const void* data, std::size_t size) noexcept
+        : _data(static_cast<const unsigned char*>(data))
+        , _size(data ? size : 0)
+    {
+    }
+
+    [[nodiscard]] auto remaining() const noexcept -> std::size_t
+    {
+        return _size - _offset;
+    }
+
+    auto read(void* data, std::size_t size) noexcept -> bool
+    {
+        if (size > remaining()) {
+            return false;
+        }
+        std::memcpy(data, _data + _offset, size);
+        _offset += size;
+        return true;
+    }
+
+    auto read_word(Word& word) noexcept -> bool
+    {
+        return read(&word, sizeof(word));
+    }
+
+    auto read_padded(std::string& str, std::size_t size) -> bool
+    {
+        if (words_of(size) * sizeof(Word) > remaining()) {
+            return false;
+        }
+        str.assign(reinterpret_cast<const char*>(_data + _offset), size);
+        _offset += words_of(size) * sizeof(Word);
+        return true;
+    }
+
+private:
+    const unsigned char* _data;
+    std::size_t _size;
+    std::size_t _offset = 0;
+};
+
+}  // namespace
+
+auto serialize_program(const Program& program, parsi_callback_name_fn_t name_fn, void* name_context, void* buffer,
+                       std::size_t size) noexcept -> std::size_t
+{
+    if (program.code.size() > std::numeric_limits<Word>::max()
+        || program.callbacks.size() > std::numeric_limits<Word>::max()
+        || program.memo_slots > std::numeric_limits<Word>::max()) [[unlikely]] {
+        return 0;
+    }
+    // the profiled nodes are only known by their address in the process that compiled them.
+    if (!program.profile_nodes.empty()) {
+        return 0;
+    }
+
+    Writer writer(buffer, size);
+    const Header header{
+        .magic = k_magic,
+        .version = k_format_version,
+        .code_size = static_cast<Word>(program.code.size()),
+        .callback_count = static_cast<Word>(program.callbacks.size()),
+        .memo_slots = static_cast<Word>(program.memo_slots),
+    };
+    writer.write(&header, sizeof(header));
+    writer.write(program.code.data(), program.code.size() * sizeof(Word));
+
+    for (const Callback& callback : program.callbacks) {
+        const char* name = name_fn ? name_fn(name_context, parsi_callback_t{
+                                                               .parse_fn = callback.parse_fn,
+                                                               .visit_fn = callback.visit_fn,
+                                                               .context = callback.context,
+                                                               .parse_ctx_fn = callback.parse_ctx_fn,
+                                                               .visit_ctx_fn = callback.visit_ctx_fn,
+                                                           })
+                                   : nullptr;
+        if (!name) {
+            return 0;
+        }
+        const std::size_t name_size = std::strlen(name);
+        if (name_size > std::numeric_limits<Word>::max()) [[unlikely]] {
+            return 0;
+        }
+        writer.write_word(static_cast<Word>(kind_of(callback)));
+        writer.write_word(static_cast<Word>(name_size));
+        writer.write_padded(name, name_size);
+    }
+
+    return writer.written();
+}
+
+auto load_program(const void* data, std::size_t size, parsi_callback_bind_fn_t bind_fn, void* bind_context,
+                  Program& program) -> bool
+{
+    Reader reader(data, size);
+    Header header;
+    if (!reader.read(&header, sizeof(header)) || header.magic != k_magic || header.version != k_format_version
+        || header.code_size == 0 || header.code_size > reader.remaining() / sizeof(Word)) {
+        return false;
+    }
+
+    program.code.resize(header.code_size);
+    if (!reader.read(program.code.data(), program.code.size() * sizeof(Word))) {
+        return false;
+    }
+    program.memo_slots = header.memo_slots;
+
+    if (header.callback_count > reader.remaining() / (2 * sizeof(Word))) {
+        return false;
+    }
+    program.callbacks.reserve(header.callback_count);
+    std::string name;
+    for (Word index = 0; index < header.callback_count; ++index) {
+        Word kind = 0;
+        Word name_size = 0;
+        if (!reader.read_word(kind) || !reader.read_word(name_size) || !reader.read_padded(name, name_size)
+            || kind > static_cast<Word>(CallbackKind::extract_ctx)) {
+            return false;
+        }
+
+        parsi_callback_t bound{};
+        if (!bind_fn || !bind_fn(bind_context, name.c_str(), &bound)) {
+            return false;
+        }
+        const Callback callback = callback_of(static_cast<CallbackKind>(kind), bound);
+        if (!is_set(callback)) {
+            return false;
+        }
+        program.callbacks.push_back(callback);
+    }
+    return true;
+}
+
+}  // namespace parsi::internal
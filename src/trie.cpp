@@ -0,0 +1,95 @@
+#include "trie.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+
+namespace parsi::internal {
+
+namespace {
+
+constexpr std::size_t k_max_offset = (std::size_t{1} << 24) - 1;
+
+struct Node {
+    Word rank = k_trie_no_rank;
+    Word below = k_trie_no_rank;
+    std::map<unsigned char, std::size_t> children;  // node index by byte
+    std::size_t offset = 0;
+};
+
+}  // namespace
+
+auto make_trie(const std::vector<std::string_view>& literals, std::size_t pc, std::vector<Word>& code) -> bool
+{
+    std::vector<Node> nodes(1);
+    for (std::size_t index = 0; index < literals.size(); ++index) {
+        const auto rank = static_cast<Word>(index);
+        std::size_t node = 0;
+        for (const char chr : literals[index]) {
+            nodes[node].below = std::min(nodes[node].below, rank);
+            const auto [iter, inserted] = nodes[node].children.emplace(static_cast<unsigned char>(chr), nodes.size());
+            node = iter->second;
+            if (inserted) {
+                nodes.emplace_back();
+            }
+        }
+        // a literal after an identical one never matches.
+        nodes[node].rank = std::min(nodes[node].rank, rank);
+    }
+
+    // nodes are laid out in the order they were added, which has every parent before its children.
+    std::size_t offset = code.size() - pc;
+    for (Node& node : nodes) {
+        node.offset = offset;
+        offset += k_trie_node_operands + node.children.size();
+    }
+    if (offset > k_max_offset) {
+        return false;
+    }
+
+    code.reserve(pc + offset);
+    for (const Node& node : nodes) {
+        code.push_back(node.rank);
+        code.push_back(node.below);
+        code.push_back(static_cast<Word>(node.children.size()));
+        for (const auto& [chr, child] : node.children) {
+            code.push_back(static_cast<Word>(chr | (nodes[child].offset << 8)));
+        }
+    }
+    return true;
+}
+
+auto match_trie(const Word* instruction, const char* begin, const char* end, bool* incomplete) noexcept -> std::size_t
+{
+    const Word* node = instruction + k_header_size;
+    Word best_rank = k_trie_no_rank;
+    std::size_t best_size = k_trie_mismatch;
+    for (const char* cursor = begin;; ++cursor) {
+        if (node[0] < best_rank) {
+            best_rank = node[0];
+            best_size = static_cast<std::size_t>(cursor - begin);
+        }
+        // the longer literals under the node all come after the one matched already.
+        if (node[1] >= best_rank) {
+            break;
+        }
+        if (cursor == end) {
+            if (incomplete) {
+                *incomplete = true;
+            }
+            break;
+        }
+
+        const Word* edges = node + k_trie_node_operands;
+        const Word* edges_end = edges + node[2];
+        const auto chr = static_cast<Word>(static_cast<unsigned char>(*cursor));
+        const Word* edge = std::lower_bound(edges, edges_end, chr, [](Word edge, Word chr) { return (edge & 0xFF) < chr; });
+        if (edge == edges_end || (*edge & 0xFF) != chr) {
+            break;
+        }
+        node = instruction + (*edge >> 8);
+    }
+    return best_size;
+}
+
+}  // namespace parsi::internal
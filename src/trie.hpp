@@ -0,0 +1,44 @@
+#ifndef PARSI_SRC_TRIE_HPP
+#define PARSI_SRC_TRIE_HPP
+
+#include <cstddef>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "program.hpp"
+
+namespace parsi::internal {
+
+/**
+ * The nodes of a `trie` instruction follow its header, starting with the root,
+ * each `[rank] [best rank below] [edge count]` followed by its edges sorted by byte,
+ * each `byte | (node offset from the instruction << 8)`.
+ * the rank of a node is the index of the (first) literal ending at it, and the best rank below
+ * the least index of those ending under it, `k_trie_no_rank` if none.
+ */
+inline constexpr Word k_trie_no_rank = std::numeric_limits<Word>::max();
+inline constexpr std::size_t k_trie_node_operands = 3;
+
+/**
+ * appends the nodes of a `trie` instruction matching the `literals` to `code`,
+ * laid out from `code.size()` on, with the node offsets relative to `pc`.
+ * returns false (leaving `code` as it was) if the trie is too large for the offsets.
+ */
+[[nodiscard]] auto make_trie(const std::vector<std::string_view>& literals, std::size_t pc, std::vector<Word>& code)
+    -> bool;
+
+inline constexpr std::size_t k_trie_mismatch = std::numeric_limits<std::size_t>::max();
+
+/**
+ * runs the `trie` instruction on the input from `begin` to `end`,
+ * returning the size of the first literal (in the anyof's order) that the input starts with,
+ * or `k_trie_mismatch` if none.
+ * `incomplete` (if given) is set when more input could have made an earlier literal match.
+ */
+[[nodiscard]] auto match_trie(const Word* instruction, const char* begin, const char* end,
+                              bool* incomplete = nullptr) noexcept -> std::size_t;
+
+}  // namespace parsi::internal
+
+#endif  // PARSI_SRC_TRIE_HPP
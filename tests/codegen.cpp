@@ -0,0 +1,91 @@
+#include <catch2/catch_all.hpp>
+
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parsi/parsi-c.h"
+
+// generated out of codegen.peg by parsi-codegen at build time.
+extern "C" parsi_result_t parsi_test_records(parsi_stream_t stream, void* context);
+
+static std::string read_grammar()
+{
+    std::ifstream file(PARSI_TESTS_CODEGEN_GRAMMAR);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+static std::vector<std::string> make_inputs()
+{
+    std::vector<std::string> inputs = {
+        "",
+        "a = 1",
+        "a=1;b=-2.5; c = \"x\\\"y\" ; d=[1, [true,false], none]",
+        "# comment\nkey_1 = 0x00ff12 ; null-ish = null",
+        "a = 1.2345",
+        "a = 0x0",
+        "a = 0x01234567",
+        "a = [0x01234567, 0x012345678]",
+        "a = [1, 2,]",
+        "a = \"unterminated",
+        "a = nul",
+        "a = 1; ; b = 2",
+        "1 = a",
+        "a = [[[[[]]]]] rest",
+        "a = truefalse",
+    };
+
+    // mutations of the valid ones, dropping, doubling or replacing a byte.
+    std::mt19937 rng(7);
+    const std::string alphabet = " \n#;=,[]\"\\-.0123456789abfx_";
+    const std::size_t valid_count = inputs.size();
+    for (int round = 0; round < 500; ++round) {
+        std::string input = inputs[rng() % valid_count];
+        if (input.empty()) {
+            continue;
+        }
+        const std::size_t index = rng() % input.size();
+        switch (rng() % 3) {
+            case 0:
+                input.erase(index, 1);
+                break;
+            case 1:
+                input.insert(index, 1, input[index]);
+                break;
+            default:
+                input[index] = alphabet[rng() % alphabet.size()];
+                break;
+        }
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+TEST_CASE("c generated parser")
+{
+    const std::string grammar = read_grammar();
+    const std::vector<std::string> inputs = make_inputs();
+
+    for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_jit}) {
+        INFO("flags: " << flags);
+        size_t error_offset = 0;
+        auto compiled_parser = parsi_compile_grammar(grammar.c_str(), NULL, NULL, flags, &error_offset);
+        REQUIRE(compiled_parser);
+
+        for (const std::string& input : inputs) {
+            INFO("input: " << input);
+            const parsi_stream_t stream{ .cursor = input.data(), .size = input.size() };
+            const parsi_result_t expected = parsi_parse(compiled_parser, stream);
+            const parsi_result_t result = parsi_test_records(stream, NULL);
+            CHECK(result.is_valid == expected.is_valid);
+            CHECK(result.stream.cursor == expected.stream.cursor);
+            CHECK(result.stream.size == expected.stream.size);
+        }
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
@@ -92,6 +92,41 @@ TEST_CASE("sequence")
     CHECK(not pr::sequence(pr::expect("Hello"), pr::expect("World"))("HelloWord"));
 }
 
+TEST_CASE("sequence fusion")
+{
+    constexpr auto hex = pr::Charset("0123456789abcdefABCDEF");
+    constexpr auto unicode_escape = pr::sequence(pr::expect('\\'), pr::expect('u'), pr::expect(hex), pr::expect(hex),
+                                                 pr::expect(hex), pr::expect(hex));
+    static_assert(std::is_same_v<decltype(pr::sequence(pr::expect('a'), pr::expect("bc"), pr::expect('d'))),
+                                 pr::internal::FusedLiterals<5>>);
+
+    CHECK(unicode_escape("\\u00e9"));
+    CHECK(unicode_escape("\\uABCDx"));
+    CHECK(not unicode_escape("\\u00g9"));
+    CHECK(not unicode_escape("\\x00e9"));
+    CHECK(not unicode_escape("\\u00e"));
+    CHECK(unicode_escape("\\u00e9").cursor()[0] == '\0');
+
+    // literals and charsets fuse across nested sequences, and around the parsers that don't fuse.
+    constexpr auto date = pr::sequence(
+        pr::sequence(pr::expect(pr::CharRange{'0', '9'}), pr::expect(pr::CharRange{'0', '9'})),
+        pr::expect('-'),
+        pr::sequence(pr::expect(pr::CharRange{'0', '9'}), pr::expect_not('x')),
+        pr::sequence(pr::expect("T"), pr::repeat(pr::expect(' ')), pr::expect('Z'), pr::expect(""))
+    );
+    CHECK(date("12-34T  Z"));
+    CHECK(date("12-3aTZ"));
+    CHECK(not date("12-3xTZ"));
+    CHECK(not date("1a-34TZ"));
+    CHECK(not date("12-34T Y"));
+
+    // a null byte within fused characters is matched as is.
+    constexpr auto with_null = pr::sequence(pr::expect('a'), pr::expect('\0'), pr::expect('b'));
+    CHECK(with_null(pr::Stream("a\0b", 3)));
+    CHECK(not with_null(pr::Stream("a\0c", 3)));
+    CHECK(not with_null("a"));
+}
+
 TEST_CASE("anyof")
 {
     CHECK(pr::anyof(pr::expect("test"), pr::expect("best"))("best"));
@@ -100,6 +135,71 @@ TEST_CASE("anyof")
     CHECK(not pr::anyof(pr::expect("test"), pr::expect("best"))("rest"));
 }
 
+TEST_CASE("anyof dispatch")
+{
+    // adjacent single-byte alternatives merge into one charset.
+    constexpr auto sign_or_digit = pr::anyof(pr::expect('+'), pr::expect('-'), pr::expect(pr::CharRange{'0', '9'}));
+    static_assert(std::is_same_v<std::remove_cvref_t<decltype(sign_or_digit)>, pr::fn::ExpectCharset>);
+    CHECK(sign_or_digit("-"));
+    CHECK(sign_or_digit("7"));
+    CHECK(not sign_or_digit("x"));
+
+    // the alternatives keep their order where more than one can match.
+    std::string_view matched;
+    const auto keyword = pr::extract(
+        pr::anyof(pr::expect("nil"), pr::expect("null"), pr::sequence(pr::expect('n'), pr::repeat(pr::expect('u')))),
+        [&](std::string_view str) { matched = str; });
+    CHECK(keyword("null"));
+    CHECK(matched == "null");
+    CHECK(keyword("nuxx"));
+    CHECK(matched == "nu");
+    CHECK(not keyword("xnull"));
+
+    // nullable and opaque alternatives are tried on any byte, and at the end of the stream.
+    const auto opaque = [](pr::Stream stream) { return pr::Result{stream, stream.size() == 0 || stream.front() == '!'}; };
+    const auto value = pr::anyof(pr::expect("true"), opaque, pr::optional(pr::expect('?')), pr::eos());
+    CHECK(value("true"));
+    CHECK(value("!"));
+    CHECK(value("x"));
+    CHECK(value(""));
+    const auto strict = pr::anyof(pr::expect("true"), opaque, pr::sequence(pr::eos(), pr::expect("")));
+    CHECK(strict("!"));
+    CHECK(strict(""));
+    CHECK(not strict("x"));
+
+    // nested anyofs are flattened, and nested sequences are looked through.
+    constexpr auto literal = pr::anyof(
+        pr::anyof(pr::expect("true"), pr::expect("false")),
+        pr::sequence(pr::optional(pr::expect('-')), pr::repeat<1>(pr::expect(pr::Charset("0123456789")))),
+        pr::sequence(pr::expect('"'), pr::skip_until('"'), pr::expect('"'))
+    );
+    static_assert(literal("false"));
+    static_assert(literal("-12"));
+    static_assert(literal("34"));
+    static_assert(literal("\"str\""));
+    static_assert(not literal("-"));
+    static_assert(not literal("nope"));
+    static_assert(not literal(""));
+
+    constexpr auto first_set = pr::internal::first_set_of(literal);
+    static_assert(not first_set.nullable);
+    static_assert(first_set.bytes == pr::Charset("tf-0123456789\""));
+
+    // an alternative starting with a nullable extract still runs its visitor on any byte.
+    int visits = 0;
+    const auto visited = pr::anyof(
+        pr::sequence(pr::extract(pr::optional(pr::expect('a')), [&](std::string_view) { ++visits; }), pr::expect('y')),
+        pr::expect("zz"),
+        pr::expect("ww")
+    );
+    CHECK(visited("zz"));
+    CHECK(visits == 1);
+    CHECK(visited("ay"));
+    CHECK(visits == 2);
+    CHECK(not visited("x"));
+    CHECK(visits == 3);
+}
+
 TEST_CASE("repeat")
 {
     CHECK(pr::repeat(pr::expect(" "))("a b"));
@@ -117,6 +217,186 @@ TEST_CASE("repeat")
     CHECK(not pr::repeat<1, 1>(pr::expect("at least once"))("nope"));
 }
 
+TEST_CASE("repeat charset runs")
+{
+    // the runs are long enough to go through the vectorized scans, ending at every offset within a chunk.
+    const auto run_length_of = [](auto parser, std::string_view str) {
+        const pr::Result result = parser(pr::Stream(str));
+        REQUIRE(result);
+        return static_cast<std::size_t>(result.cursor() - str.data());
+    };
+
+    constexpr auto digits = pr::repeat(pr::expect(pr::Charset("0123456789")));
+    constexpr auto high_bytes = pr::repeat(pr::expect(pr::Charset("\x80\xC3\xFF")));
+    constexpr auto hex_digits = pr::repeat(pr::expect(pr::CharRange{'0', '9'}, pr::CharRange{'a', 'f'}));
+    constexpr auto signed_bytes = pr::repeat(pr::expect(pr::CharRange{'\x80', '\x8F'}, pr::CharRange{'z', 'a'}));
+
+    for (std::size_t length = 0; length < 100; ++length) {
+        std::string str;
+        for (std::size_t index = 0; index < length; ++index) {
+            str += static_cast<char>('0' + index % 10);
+        }
+        CHECK(run_length_of(digits, str + "a0") == length);
+        CHECK(run_length_of(digits, str) == length);
+        CHECK(run_length_of(hex_digits, str + "g0") == length);
+        CHECK(run_length_of(hex_digits, str + "9af\x80") == length + 3);
+
+        const std::string high(length, '\xC3');
+        CHECK(run_length_of(high_bytes, high + "\x7F\xFF") == length);
+        CHECK(run_length_of(high_bytes, high + "\xFF\x80") == length + 2);
+        CHECK(run_length_of(signed_bytes, std::string(length, '\x85') + "\x90") == length);
+        // `z`-`a` is an empty range.
+        CHECK(run_length_of(signed_bytes, std::string(length, '\x8F') + "m") == length);
+    }
+
+    static_assert(digits("0123456789x").cursor()[0] == 'x');
+    static_assert(hex_digits("0123456789abcdefg").cursor()[0] == 'g');
+}
+
+TEST_CASE("repeat bounded")
+{
+    constexpr auto hex = pr::expect(pr::CharRange{'0', '9'}, pr::CharRange{'a', 'f'});
+
+    // at least `min`, and failing past `max` matches.
+    CHECK(pr::repeat<6, 6>(hex)("c3a3bb"));
+    CHECK(pr::repeat<6, 6>(hex)("c3a3bb!"));
+    CHECK(not pr::repeat<6, 6>(hex)("c3a3b"));
+    CHECK(not pr::repeat<6, 6>(hex)("c3a3bbf"));
+    CHECK(not pr::repeat<6, 6>(hex)("c3a3!b"));
+    CHECK(pr::repeat<2, 4>(pr::expect('a'))("aab"));
+    CHECK(pr::repeat<2, 4>(pr::expect('a'))("aaaa"));
+    CHECK(not pr::repeat<2, 4>(pr::expect('a'))("ab"));
+    CHECK(not pr::repeat<2, 4>(pr::expect('a'))("aaaaa"));
+    CHECK(pr::repeat<1, 3>(pr::expect_not('"'))("ab\"c"));
+    CHECK(not pr::repeat<1, 3>(pr::expect_not('"'))("\""));
+    CHECK(pr::repeat<0, 0>(pr::expect('a'))("a"));
+
+    CHECK(pr::repeat(hex, 6)("c3a3bb"));
+    CHECK(not pr::repeat(hex, 6)("c3a3b"));
+    CHECK(not pr::repeat(hex, 6)("c3a3bbf"));
+    CHECK(pr::repeat(pr::expect(pr::Charset("ab")), 1, 3)("ab"));
+    CHECK(not pr::repeat(pr::expect(pr::Charset("ab")), 1, 3)("c"));
+    CHECK(not pr::repeat(pr::expect(pr::Charset("ab")), 1, 3)("abab"));
+    CHECK(not pr::repeat(pr::expect(pr::Charset("ab")), 3, 1)("ab"));
+    CHECK(pr::repeat(pr::expect("ab"), 2)("abab"));
+    CHECK(not pr::repeat(pr::expect("ab"), 2)("ab"));
+    CHECK(not pr::repeat(pr::expect("ab"), 2)("ababab"));
+
+    // long and exact counts, through the vectorized scans.
+    const std::string digits(32, 'f');
+    const std::string longer_digits = digits + "0";
+    const std::string delimited_digits = digits + "-";
+    const std::string_view uuid_digits = digits;
+    CHECK(pr::repeat<32, 32>(hex)(uuid_digits));
+    CHECK(not pr::repeat<32, 32>(hex)(std::string_view(longer_digits)));
+    CHECK(not pr::repeat<33, 100>(hex)(uuid_digits));
+    CHECK(pr::repeat<20, 100>(hex)(uuid_digits).cursor() == uuid_digits.data() + 32);
+    CHECK(pr::repeat(hex, 32)(uuid_digits));
+    CHECK(not pr::repeat(hex, 31)(uuid_digits));
+    CHECK(pr::repeat(hex, 10, 40)(std::string_view(delimited_digits)).cursor() == delimited_digits.data() + 32);
+
+    static_assert(pr::repeat<6, 6>(hex)("c3a3bb"));
+    static_assert(not pr::repeat(hex, 2, 4)("c3a3bb"));
+}
+
+TEST_CASE("failure positions")
+{
+    // the specialized parsers end where the combinators they stand for do, on success or failure.
+    const auto offset_of = [](const auto& parser, std::string_view str) {
+        const pr::Result result = parser(pr::Stream(str));
+        return std::make_pair(static_cast<bool>(result), result.cursor() - str.data());
+    };
+    const auto check_same = [&](const auto& specialized, const auto& combinator,
+                                std::initializer_list<std::string_view> inputs) {
+        for (const std::string_view str : inputs) {
+            INFO("input: " << str);
+            CHECK(offset_of(specialized, str) == offset_of(combinator, str));
+        }
+    };
+
+    constexpr auto hex = pr::expect(pr::Charset("0123456789abcdef"));
+
+    CHECK(offset_of(pr::repeat<3, 5>(pr::expect('a')), "aab") == std::make_pair(false, std::ptrdiff_t{3}));
+    CHECK(offset_of(pr::repeat<3, 5>(pr::expect('a')), "aa") == std::make_pair(false, std::ptrdiff_t{2}));
+    CHECK(offset_of(pr::repeat<3, 5>(pr::expect('a')), "aaaaaaa") == std::make_pair(false, std::ptrdiff_t{6}));
+    check_same(pr::repeat<3, 5>(pr::expect('a')), pr::fn::Repeated<pr::fn::ExpectChar<>, 3, 5>{pr::expect('a')},
+               {"", "b", "aab", "aa", "aaa", "aaab", "aaaaa", "aaaaaa"});
+    check_same(pr::repeat<20, 24>(hex), pr::fn::Repeated<pr::fn::ExpectCharset, 20, 24>{hex},
+               {"0123456789abcdef012", "0123456789abcdef012!", "0123456789abcdef0123!", "0123456789abcdef01234567"});
+    check_same(pr::repeat<0, 2>(pr::expect_not('"')),
+               pr::fn::Repeated<pr::fn::ExpectChar<pr::fn::Negation{.negated = true}>, 0, 2>{pr::expect_not('"')},
+               {"", "\"", "ab", "abc"});
+    check_same(pr::repeat(hex, 2, 4), pr::fn::RepeatedRanged<pr::fn::ExpectCharset>{hex, 2, 4},
+               {"", "a", "a!", "ab", "abcd", "abcde", "!"});
+
+    CHECK(offset_of(pr::sequence(pr::expect('a'), pr::expect('b'), pr::expect('c')), "abx")
+          == std::make_pair(false, std::ptrdiff_t{3}));
+    CHECK(offset_of(pr::sequence(pr::expect('a'), pr::expect('b'), pr::expect('c')), "ab")
+          == std::make_pair(false, std::ptrdiff_t{2}));
+    check_same(pr::sequence(pr::expect('a'), pr::expect("bc"), pr::expect('d'), pr::expect("ef")),
+               pr::fn::Sequence<pr::fn::ExpectChar<>, pr::fn::ExpectFixedString<3>, pr::fn::ExpectChar<>,
+                                pr::fn::ExpectFixedString<3>>(pr::expect('a'), pr::expect("bc"), pr::expect('d'),
+                                                              pr::expect("ef")),
+               {"", "x", "a", "ab", "abx", "abc", "abcx", "abcd", "abcde", "abcdex", "abcdef"});
+    check_same(pr::sequence(hex, pr::expect_not('x'), pr::expect(pr::CharRange{'0', '9'})),
+               pr::fn::Sequence<pr::fn::ExpectCharset, pr::fn::ExpectChar<pr::fn::Negation{.negated = true}>,
+                                pr::fn::ExpectCharRangeSet<1>>(hex, pr::expect_not('x'),
+                                                               pr::expect(pr::CharRange{'0', '9'})),
+               {"", "!", "a", "ax", "ab", "ab!", "ab1"});
+    const auto value = pr::anyof(pr::expect("true"), pr::expect("false"), pr::expect('0'), pr::expect('1'));
+    check_same(value, pr::fn::AnyOf<pr::fn::ExpectFixedString<5>, pr::fn::ExpectFixedString<6>, pr::fn::ExpectChar<>,
+                                    pr::fn::ExpectChar<>>(pr::expect("true"), pr::expect("false"), pr::expect('0'),
+                                                          pr::expect('1')),
+               {"", "t", "tru", "true", "fals", "false", "0", "1", "2"});
+    check_same(pr::anyof(pr::expect('a'), pr::expect("bc")),
+               pr::fn::AnyOf<pr::fn::ExpectChar<>, pr::fn::ExpectFixedString<3>>(pr::expect('a'), pr::expect("bc")),
+               {"", "a", "b", "bc", "x"});
+    check_same(pr::sequence(pr::repeat<2>(pr::expect('a')), pr::expect('b')),
+               pr::fn::Sequence<pr::fn::Repeated<pr::fn::ExpectChar<>, 2>, pr::fn::ExpectChar<>>(
+                   pr::fn::Repeated<pr::fn::ExpectChar<>, 2>{pr::expect('a')}, pr::expect('b')),
+               {"aac", "aab", "ac", "a"});
+}
+
+TEST_CASE("skip_until")
+{
+    const auto skipped_of = [](auto parser, std::string_view str) {
+        const pr::Result result = parser(pr::Stream(str));
+        REQUIRE(result);
+        return static_cast<std::size_t>(result.cursor() - str.data());
+    };
+
+    CHECK(skipped_of(pr::skip_until('"'), "") == 0);
+    CHECK(skipped_of(pr::skip_until('"'), "\"") == 0);
+    CHECK(skipped_of(pr::skip_until('"'), "ab\"c\"") == 2);
+    CHECK(skipped_of(pr::skip_until('"'), "abc") == 3);
+    CHECK(skipped_of(pr::skip_until(pr::Charset(",\n")), "a b\nc,") == 3);
+    CHECK(skipped_of(pr::skip_until(pr::Charset(",\n")), "a b c") == 5);
+    CHECK(skipped_of(pr::skip_until("*/"), "a * b */ c */") == 6);
+    CHECK(skipped_of(pr::skip_until("*/"), "a * b *") == 7);
+    CHECK(skipped_of(pr::skip_until("*/"), "*/") == 0);
+
+    // a run of anything but a character is a skip up to it.
+    CHECK(skipped_of(pr::repeat(pr::expect_not('"')), "ab\"c") == 2);
+    CHECK(skipped_of(pr::repeat(pr::expect_not('"')), "abc") == 3);
+    CHECK(skipped_of(pr::repeat(pr::expect('a')), "aab") == 2);
+    CHECK(pr::sequence(pr::expect('"'), pr::repeat(pr::expect_not('"')), pr::expect('"'))("\"quoted\""));
+
+    // long enough for the vectorized scans, with the delimiter at every offset within a chunk.
+    for (std::size_t length = 0; length < 100; ++length) {
+        const std::string skipped(length, '*');
+        CHECK(skipped_of(pr::skip_until('/'), skipped + "/*/") == length);
+        CHECK(skipped_of(pr::skip_until(pr::Charset("/\xFF")), skipped + "\xFF") == length);
+        CHECK(skipped_of(pr::skip_until("*/"), skipped + "/*/") == (length > 0 ? length - 1 : 1));
+        CHECK(skipped_of(pr::skip_until("<end>"), skipped + "<end<end>") == length + 4);
+        CHECK(skipped_of(pr::skip_until("<end>"), skipped + "<end") == length + 4);
+        CHECK(skipped_of(pr::repeat(pr::expect('*')), skipped + "/*") == length);
+    }
+
+    static_assert(pr::skip_until('"')("ab\"").cursor()[0] == '"');
+    static_assert(pr::skip_until(pr::Charset(",;"))("ab;").cursor()[0] == ';');
+    static_assert(pr::skip_until("*/")("a*b*/").cursor()[0] == '*');
+}
+
 TEST_CASE("extract")
 {
     CHECK(pr::extract(pr::expect("test"),
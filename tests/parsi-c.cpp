@@ -1,5 +1,11 @@
 #include <catch2/catch_all.hpp>
 
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "parsi/parsi-c.h"
 
 static std::string_view to_strview(parsi_stream_t stream)
@@ -660,3 +666,1844 @@ TEST_CASE("c optional")
         CHECK(subparser.expect_char.expected == 'Y');
     }
 }
+
+TEST_CASE("c compile")
+{
+    SECTION("independent of the parser tree")
+    {
+        char str[] = "hello";
+        auto parser = parsi_expect_string(str, 5, NULL);
+        auto compiled_parser = parsi_compile(&parser);
+
+        str[0] = 'j';
+        parser = parsi_expect_char('j');
+
+        CHECK(parsi_parse(compiled_parser, make_stream("hello")) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream("jello")) == TResult{false, "jello"});
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("shared subparser")
+    {
+        auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+        auto digits = parsi_combine_repeat(&digit, 1, 3, NULL);
+        parsi_parser_t subparsers[] = {
+            parsi_combine_optional(&digits, NULL),
+            parsi_expect_char('.'),
+            parsi_combine_optional(&digits, NULL),
+            parsi_none()
+        };
+        auto parser = parsi_combine_sequence(subparsers, NULL);
+        auto compiled_parser = parsi_compile(&parser);
+
+        CHECK(parsi_parse(compiled_parser, make_stream("12.345")) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream(".5x")) == TResult{true, "x"});
+        CHECK(parsi_parse(compiled_parser, make_stream("1.2345")) == TResult{true, "2345"});
+        CHECK(parsi_parse(compiled_parser, make_stream("x.1")) == TResult{false, "x.1"});
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("recursive subparser")
+    {
+        // parens := '(' optional(parens) ')'
+        parsi_parser_t parens;
+        parsi_parser_t subparsers[] = {
+            parsi_expect_char('('),
+            parsi_combine_optional(&parens, NULL),
+            parsi_expect_char(')'),
+            parsi_none()
+        };
+        parens = parsi_combine_sequence(subparsers, NULL);
+        auto compiled_parser = parsi_compile(&parens);
+
+        CHECK(parsi_parse(compiled_parser, make_stream("()")) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream("((()))")) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream("(())))")) == TResult{true, "))"});
+        CHECK(parsi_parse(compiled_parser, make_stream("((()")) == TResult{false, "(()"});
+        CHECK(parsi_parse(compiled_parser, make_stream(")")) == TResult{false, ")"});
+
+        std::string deep = std::string(1000, '(') + std::string(1000, ')');
+        CHECK(parsi_parse(compiled_parser, make_stream(deep)) == TResult{true, ""});
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
+
+TEST_CASE("c threaded dispatch")
+{
+    // item := digits | ident
+    // list := '[' (item (',' item)*)? ']' eos
+    auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+    auto alpha = parsi_expect_charset(parsi_charset("abcdefghijklmnopqrstuvwxyz_"));
+    parsi_parser_t items[] = {
+        parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL),
+        parsi_combine_repeat(&alpha, 1, SIZE_MAX, NULL),
+        parsi_none()
+    };
+    auto item = parsi_combine_anyof(items, NULL);
+    parsi_parser_t rest_subparsers[] = {parsi_expect_char(','), item, parsi_none()};
+    auto rest = parsi_combine_sequence(rest_subparsers, NULL);
+    parsi_parser_t inner_subparsers[] = {item, parsi_combine_repeat(&rest, 0, SIZE_MAX, NULL), parsi_none()};
+    auto inner = parsi_combine_sequence(inner_subparsers, NULL);
+    parsi_parser_t subparsers[] = {
+        parsi_expect_char('['),
+        parsi_combine_optional(&inner, NULL),
+        parsi_expect_static_string("]"),
+        parsi_expect_eos(),
+        parsi_none()
+    };
+    auto parser = parsi_combine_sequence(subparsers, NULL);
+
+    auto switch_parser = parsi_compile_ex(&parser, parsi_compile_flag_none);
+    auto threaded_parser = parsi_compile_ex(&parser, parsi_compile_flag_threaded_dispatch);
+    REQUIRE(switch_parser);
+    REQUIRE(threaded_parser);
+
+    for (std::string_view input : {"[]", "[1]", "[12,ab,3]", "[12,,3]", "[12,ab", "[a1]", "[x]y", "", "]"}) {
+        INFO(input);
+        const auto expected = parsi_parse(switch_parser, make_stream(input));
+        const auto actual = parsi_parse(threaded_parser, make_stream(input));
+        CHECK(actual.is_valid == expected.is_valid);
+        CHECK(to_strview(actual.stream) == to_strview(expected.stream));
+    }
+
+    CHECK(parsi_parse(threaded_parser, make_stream("[12,ab,3]")) == TResult{true, ""});
+    CHECK(parsi_parse(threaded_parser, make_stream("[12,,3]")) == TResult{false, ",,3]"});
+
+    parsi_free_compiled_parser(switch_parser);
+    parsi_free_compiled_parser(threaded_parser);
+}
+
+TEST_CASE("c jit")
+{
+    // the jit falls back to the interpreter where unsupported,
+    // either way it must agree with the interpreter.
+    const auto check_same = [](parsi_parser_t* parser, std::initializer_list<std::string_view> inputs) {
+        auto interpreted_parser = parsi_compile_ex(parser, parsi_compile_flag_none);
+        auto jit_parser = parsi_compile_ex(parser, parsi_compile_flag_jit);
+        REQUIRE(interpreted_parser);
+        REQUIRE(jit_parser);
+
+        for (std::string_view input : inputs) {
+            INFO(input);
+            const auto expected = parsi_parse(interpreted_parser, make_stream(input));
+            const auto actual = parsi_parse(jit_parser, make_stream(input));
+            CHECK(actual.is_valid == expected.is_valid);
+            CHECK(to_strview(actual.stream) == to_strview(expected.stream));
+        }
+
+        parsi_free_compiled_parser(interpreted_parser);
+        parsi_free_compiled_parser(jit_parser);
+    };
+
+    SECTION("leaves")
+    {
+        auto chr = parsi_expect_char('\xff');
+        check_same(&chr, {"", "\xff", "\xfe", "\xff\xff"});
+
+        auto charset = parsi_expect_charset(parsi_charset("a\x80\xff"));
+        check_same(&charset, {"", "a", "\x80", "\xff", "b", "\x7f"});
+
+        auto eos = parsi_expect_eos();
+        check_same(&eos, {"", "x"});
+
+        auto none = parsi_none();
+        check_same(&none, {"", "x"});
+
+        for (std::string_view str : {"", "a", "ab", "abc", "abcd", "abcdefg", "abcdefgh", "abcdefghijklmno", "abcdefghijklmnopq\xff"}) {
+            auto string = parsi_expect_static_string(str.data());
+            string.expect_static_string.size = str.size();
+            const std::string longer = std::string(str) + "z";
+            const std::string mismatch = std::string(str.substr(0, str.size() / 2)) + "?";
+            check_same(&string, {str, longer, mismatch, str.substr(0, str.size() / 2), ""});
+        }
+    }
+
+    SECTION("repeat")
+    {
+        auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+        auto x = parsi_expect_char('x');
+        parsi_parser_t pair_subparsers[] = {parsi_expect_char('a'), parsi_expect_char('b'), parsi_none()};
+        auto pair = parsi_combine_sequence(pair_subparsers, NULL);
+
+        for (parsi_parser_t* subparser : {&digit, &x, &pair}) {
+            for (auto [min, max] : {std::pair<size_t, size_t>{0, SIZE_MAX}, {1, SIZE_MAX}, {2, 3}, {0, 0}, {3, 2}}) {
+                auto repeat = parsi_combine_repeat(subparser, min, max, NULL);
+                check_same(&repeat, {"", "1", "12", "123", "1234", "x", "xxx", "xxxxy", "ab", "abab", "ababa", "ababababx"});
+            }
+        }
+    }
+
+    SECTION("callbacks")
+    {
+        std::string extracted;
+        constexpr auto visit_fn = [](void* context, const char* str, size_t size) -> bool {
+            auto& extracted = *reinterpret_cast<std::string*>(context);
+            extracted.append(str, size).push_back(';');
+            return size != 3;
+        };
+        constexpr auto parser_fn = [](void*, parsi_stream_t stream) -> parsi_result_t {
+            // consumes a single byte, and truncates the rest of the stream after a '!'.
+            if (stream.size == 0 || stream.cursor[0] == '?') {
+                return parsi_result_t{ .is_valid = false, .stream = stream };
+            }
+            const bool truncate = stream.cursor[0] == '!';
+            return parsi_result_t{ .is_valid = true, .stream = { .cursor = stream.cursor + 1, .size = truncate ? 0 : stream.size - 1 } };
+        };
+
+        auto custom = parsi_custom_parser(parser_fn, NULL, NULL);
+        auto custom_repeat = parsi_combine_repeat(&custom, 1, SIZE_MAX, NULL);
+        auto extract = parsi_combine_extract(&custom_repeat, visit_fn, &extracted, NULL, NULL);
+        parsi_parser_t subparsers[] = {extract, parsi_expect_char('?'), parsi_combine_optional(&extract, NULL), parsi_none()};
+        auto parser = parsi_combine_sequence(subparsers, NULL);
+
+        auto interpreted_parser = parsi_compile_ex(&parser, parsi_compile_flag_none);
+        auto jit_parser = parsi_compile_ex(&parser, parsi_compile_flag_jit);
+
+        for (std::string_view input : {"ab?cd", "ab?", "abc?de", "ab?cde", "a!b?cd", "ab?c!d", "?", ""}) {
+            INFO(input);
+            extracted.clear();
+            const auto expected = parsi_parse(interpreted_parser, make_stream(input));
+            const std::string expected_extracted = extracted;
+            extracted.clear();
+            const auto actual = parsi_parse(jit_parser, make_stream(input));
+            CHECK(actual.is_valid == expected.is_valid);
+            CHECK(to_strview(actual.stream) == to_strview(expected.stream));
+            CHECK(extracted == expected_extracted);
+        }
+
+        parsi_free_compiled_parser(interpreted_parser);
+        parsi_free_compiled_parser(jit_parser);
+    }
+
+    SECTION("recursive subparser")
+    {
+        // parens := '(' optional(parens) ')'
+        parsi_parser_t parens;
+        parsi_parser_t subparsers[] = {
+            parsi_expect_char('('),
+            parsi_combine_optional(&parens, NULL),
+            parsi_expect_char(')'),
+            parsi_none()
+        };
+        parens = parsi_combine_sequence(subparsers, NULL);
+
+        const std::string deep = std::string(1000, '(') + std::string(1000, ')');
+        check_same(&parens, {"()", "((()))", "(())))", "((()", ")", deep});
+    }
+
+    SECTION("anyof and optional")
+    {
+        auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+        parsi_parser_t number_subparsers[] = {
+            parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL),
+            parsi_expect_char('.'),
+            parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL),
+            parsi_none()
+        };
+        parsi_parser_t alternatives[] = {
+            parsi_combine_sequence(number_subparsers, NULL),
+            parsi_expect_static_string("null"),
+            parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL),
+            parsi_none()
+        };
+        auto value = parsi_combine_anyof(alternatives, NULL);
+        auto optional_value = parsi_combine_optional(&value, NULL);
+        parsi_parser_t subparsers[] = {optional_value, parsi_expect_eos(), parsi_none()};
+        auto parser = parsi_combine_sequence(subparsers, NULL);
+
+        check_same(&parser, {"", "1.5", "15", "1.", "null", "nul", "x", "12.34x"});
+    }
+}
+
+TEST_CASE("c repeat scan")
+{
+    // long runs go through the vectorized kernels, which must agree with byte by byte matching.
+    const auto check_run = [](parsi_parser_t* subparser, auto&& contains) {
+        for (auto [min, max] : {std::pair<size_t, size_t>{0, SIZE_MAX}, {1, SIZE_MAX}, {0, 40}, {20, 70}}) {
+            auto parser = parsi_combine_repeat(subparser, min, max, NULL);
+
+            for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+                auto compiled_parser = parsi_compile_ex(&parser, flags);
+                REQUIRE(compiled_parser);
+
+                for (unsigned stopper = 0; stopper < 256; ++stopper) {
+                    if (contains(static_cast<unsigned char>(stopper))) {
+                        continue;
+                    }
+
+                    // a run of every member byte in turn, cut by a non member at each length.
+                    std::string run;
+                    for (unsigned chr = 0; run.size() < 100; chr = (chr + 1) % 256) {
+                        if (contains(static_cast<unsigned char>(chr))) {
+                            run.push_back(static_cast<char>(chr));
+                        }
+                    }
+
+                    for (std::size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 40, 41, 64, 71, 100}) {
+                        INFO("flags: " << flags << ", stopper: " << stopper << ", length: " << length);
+                        std::string input = run.substr(0, length) + static_cast<char>(stopper) + run;
+                        const auto result = parsi_parse(compiled_parser, make_stream(input));
+
+                        if (length > max) {
+                            CHECK(result == TResult{false, std::string_view(input).substr(max + 1)});
+                        }
+                        else {
+                            CHECK(result == TResult{length >= min, std::string_view(input).substr(length)});
+                        }
+                    }
+                }
+
+                parsi_free_compiled_parser(compiled_parser);
+            }
+        }
+    };
+
+    SECTION("charset")
+    {
+        // spans all four quarters of the byte range, including utf-8 lead and continuation bytes.
+        const char members[] = "\x01 09AZaz\x7f\x80\x8f\x90\xbf\xc3\xe2\xef\xf0\xfe\xff";
+        auto charset = parsi_charset_n(members, sizeof(members) - 1);
+        auto subparser = parsi_expect_charset(charset);
+        check_run(&subparser, [&](unsigned char chr) {
+            return std::string_view(members, sizeof(members) - 1).find(static_cast<char>(chr)) != std::string_view::npos;
+        });
+    }
+
+    SECTION("char")
+    {
+        auto subparser = parsi_expect_char('\xc3');
+        check_run(&subparser, [](unsigned char chr) { return chr == 0xc3; });
+    }
+
+    SECTION("not char")
+    {
+        std::string members;
+        for (unsigned chr = 0; chr < 256; ++chr) {
+            if (chr != 0x80) {
+                members.push_back(static_cast<char>(chr));
+            }
+        }
+        auto subparser = parsi_expect_charset(parsi_charset_n(members.data(), members.size()));
+        check_run(&subparser, [](unsigned char chr) { return chr != 0x80; });
+    }
+}
+
+TEST_CASE("c parse many")
+{
+    // color := '#' hex{6} eos
+    auto hex = parsi_expect_charset(parsi_charset("0123456789abcdefABCDEF"));
+    parsi_parser_t subparsers[] = {
+        parsi_expect_char('#'),
+        parsi_combine_repeat(&hex, 6, 6, NULL),
+        parsi_expect_eos(),
+        parsi_none()
+    };
+    auto parser = parsi_combine_sequence(subparsers, NULL);
+
+    const std::string_view inputs[] = {"#C3A3BB", "#c3a3bbx", "#C3A3B", "C3A3BB", "", "#000000", "#00000g"};
+    parsi_stream_t streams[std::size(inputs)];
+    for (std::size_t index = 0; index < std::size(inputs); ++index) {
+        streams[index] = make_stream(inputs[index]);
+    }
+
+    for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+        INFO("flags: " << flags);
+        auto compiled_parser = parsi_compile_ex(&parser, flags);
+        REQUIRE(compiled_parser);
+
+        parsi_result_t results[std::size(inputs)];
+        parsi_parse_many(compiled_parser, streams, results, std::size(inputs));
+
+        for (std::size_t index = 0; index < std::size(inputs); ++index) {
+            INFO(inputs[index]);
+            const auto expected = parsi_parse(compiled_parser, streams[index]);
+            CHECK(results[index] == TResult{expected.is_valid, to_strview(expected.stream)});
+        }
+        CHECK(results[0] == TResult{true, ""});
+        CHECK(results[1] == TResult{false, "x"});
+        CHECK(results[6] == TResult{false, "g"});
+
+        parsi_parse_many(compiled_parser, NULL, NULL, 0);
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
+
+TEST_CASE("c arena")
+{
+    SECTION("builder")
+    {
+        auto arena = parsi_arena_create(4096);
+        REQUIRE(arena);
+
+        // number := digit+ ('.' digit+)?
+        auto digit = parsi_arena_parser(arena, parsi_expect_charset(parsi_charset("0123456789")));
+        auto digits = parsi_arena_parser(arena, parsi_combine_repeat(digit, 1, SIZE_MAX, NULL));
+        const parsi_parser_t fraction_subparsers[] = {parsi_expect_char('.'), *digits};
+        auto fraction = parsi_arena_parser(arena, parsi_combine_sequence(parsi_arena_parser_list(arena, fraction_subparsers, 2), NULL));
+        const parsi_parser_t number_subparsers[] = {*digits, parsi_combine_optional(fraction, NULL)};
+        auto number = parsi_combine_sequence(parsi_arena_parser_list(arena, number_subparsers, 2), NULL);
+        REQUIRE(number.sequence.size == 2);
+
+        auto compiled_parser = parsi_compile(&number);
+        CHECK(parsi_parse(compiled_parser, make_stream("12.5x")) == TResult{true, "x"});
+        CHECK(parsi_parse(compiled_parser, make_stream("12.x")) == TResult{true, ".x"});
+        CHECK(parsi_parse(compiled_parser, make_stream("x")) == TResult{false, "x"});
+        parsi_free_compiled_parser(compiled_parser);
+
+        char* str = parsi_arena_string(arena, "hello", 5);
+        REQUIRE(str);
+        CHECK(std::string_view(str, 5) == "hello");
+
+        parsi_arena_free(arena);
+    }
+
+    SECTION("full")
+    {
+        auto arena = parsi_arena_create(sizeof(parsi_parser_t));
+        REQUIRE(arena);
+        CHECK(parsi_arena_parser(arena, parsi_expect_eos()));
+        CHECK(parsi_arena_used(arena) == sizeof(parsi_parser_t));
+        CHECK(!parsi_arena_parser(arena, parsi_expect_eos()));
+        CHECK(!parsi_arena_string(arena, "x", 1));
+        parsi_arena_free(arena);
+    }
+
+    SECTION("copy")
+    {
+        // list := '[' (item (',' item)*)? ']' with a recursive item := word | list
+        static int free_counter = 0;
+        const auto free_string_fn = [](char* str, size_t) { ++free_counter; std::free(str); };
+
+        char* word_str = static_cast<char*>(std::malloc(4));
+        std::memcpy(word_str, "word", 4);
+
+        // a placeholder until it's defined, the anyof counts its alternatives up to a none.
+        parsi_parser_t list = parsi_expect_eos();
+        parsi_parser_t items[] = {parsi_expect_string(word_str, 4, free_string_fn), list, parsi_none()};
+        auto item = parsi_combine_anyof(items, NULL);
+        parsi_parser_t rest_subparsers[] = {parsi_expect_char(','), item, parsi_none()};
+        auto rest = parsi_combine_sequence(rest_subparsers, NULL);
+        parsi_parser_t inner_subparsers[] = {item, parsi_combine_repeat(&rest, 0, SIZE_MAX, NULL), parsi_none()};
+        auto inner = parsi_combine_sequence(inner_subparsers, NULL);
+        parsi_parser_t subparsers[] = {
+            parsi_expect_char('['),
+            parsi_combine_optional(&inner, NULL),
+            parsi_expect_char(']'),
+            parsi_none()
+        };
+        list = parsi_combine_sequence(subparsers, NULL);
+        items[1] = list;
+
+        const std::string_view inputs[] = {"[word,[],[word,word]]", "[word,[word,]]", "[]", "[[[word]]", "word"};
+        auto original_parser = parsi_compile(&list);
+
+        const std::size_t size = parsi_arena_size_of(&list);
+        CHECK(size > 0);
+
+        auto small_arena = parsi_arena_create(size - 1);
+        CHECK(!parsi_arena_copy(small_arena, &list));
+        CHECK(parsi_arena_used(small_arena) == 0);
+        parsi_arena_free(small_arena);
+
+        auto arena = parsi_arena_create(size);
+        auto copy = parsi_arena_copy(arena, &list);
+        REQUIRE(copy);
+        CHECK(parsi_arena_used(arena) == size);
+
+        // the copy doesn't depend on the original tree.
+        items[0].expect_string.free_string_fn(items[0].expect_string.string, 4);
+        std::memset(items, 0, sizeof(items));
+        std::memset(subparsers, 0, sizeof(subparsers));
+        CHECK(free_counter == 1);
+
+        CHECK(copy->sequence.parsers[0].type == parsi_parser_type_char);
+        CHECK(copy->sequence.parsers[1].optional.free_parser_fn == NULL);
+
+        auto compiled_parser = parsi_compile(copy);
+        for (std::string_view input : inputs) {
+            INFO(input);
+            const auto expected = parsi_parse(original_parser, make_stream(input));
+            CHECK(parsi_parse(compiled_parser, make_stream(input)) == TResult{expected.is_valid, to_strview(expected.stream)});
+        }
+        CHECK(parsi_parse(compiled_parser, make_stream("[word,[],[word,word]]")) == TResult{true, ""});
+        parsi_free_compiled_parser(compiled_parser);
+        parsi_free_compiled_parser(original_parser);
+
+        parsi_arena_free(arena);
+        CHECK(free_counter == 1);
+    }
+}
+
+TEST_CASE("c memoize")
+{
+    // expr := '(' expr ')' | '(' expr ']' | 'x', exponential without memoization on "(((x]]]".
+    parsi_parser_t expr;
+    auto expr_ref = parsi_combine_repeat(&expr, 1, 1, NULL);
+    parsi_parser_t paren_subparsers[] = {parsi_expect_char('('), expr_ref, parsi_expect_char(')'), parsi_none()};
+    parsi_parser_t bracket_subparsers[] = {parsi_expect_char('('), expr_ref, parsi_expect_char(']'), parsi_none()};
+    parsi_parser_t alternatives[] = {
+        parsi_combine_sequence(paren_subparsers, NULL),
+        parsi_combine_sequence(bracket_subparsers, NULL),
+        parsi_expect_char('x'),
+        parsi_none()
+    };
+    expr = parsi_combine_anyof(alternatives, NULL);
+
+    const auto nested = [](std::size_t depth, char close) {
+        return std::string(depth, '(') + "x" + std::string(depth, close);
+    };
+
+    SECTION("same results")
+    {
+        auto plain_parser = parsi_compile(&expr);
+        auto compiled_parser = parsi_compile_ex(&expr, parsi_compile_flag_memoize | parsi_compile_flag_threaded_dispatch);
+        REQUIRE(compiled_parser);
+
+        const std::string inputs[] = {"x", "(x)", "(x]", "((x)]", "((x]", "(x)x", ")", "", nested(10, ']'), nested(10, ')')};
+        for (const std::string& input : inputs) {
+            INFO(input);
+            const auto expected = parsi_parse(plain_parser, make_stream(input));
+            CHECK(parsi_parse(compiled_parser, make_stream(input)) == TResult{expected.is_valid, to_strview(expected.stream)});
+        }
+
+        parsi_free_compiled_parser(compiled_parser);
+        parsi_free_compiled_parser(plain_parser);
+    }
+
+    SECTION("linear time")
+    {
+        auto compiled_parser = parsi_compile_ex(&expr, parsi_compile_flag_memoize);
+        REQUIRE(compiled_parser);
+
+        const std::string input = nested(64, ']');
+        CHECK(parsi_parse(compiled_parser, make_stream(input)) == TResult{true, ""});
+
+        const auto stats = parsi_memo_stats(compiled_parser);
+        CHECK(stats.hits > 0);
+        CHECK(stats.lookups < 4 * input.size());
+        CHECK(stats.evictions == 0);
+
+        parsi_memo_stats_reset(compiled_parser);
+        CHECK(parsi_memo_stats(compiled_parser).lookups == 0);
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("memory limit")
+    {
+        auto compiled_parser = parsi_compile_ex(&expr, parsi_compile_flag_memoize);
+        REQUIRE(compiled_parser);
+
+        // a lossy cache of a couple of entries.
+        parsi_set_memo_limit(compiled_parser, 64);
+        CHECK(parsi_parse(compiled_parser, make_stream(nested(12, ']'))) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream(nested(12, ')') + "]")) == TResult{true, "]"});
+        CHECK(parsi_memo_stats(compiled_parser).evictions > 0);
+
+        parsi_set_memo_limit(compiled_parser, 0);
+        parsi_memo_stats_reset(compiled_parser);
+        CHECK(parsi_parse(compiled_parser, make_stream(nested(8, ']'))) == TResult{true, ""});
+        CHECK(parsi_memo_stats(compiled_parser).lookups == 0);
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("callbacks are not skipped")
+    {
+        static int visit_counter = 0;
+        const auto visit_fn = [](void*, const char*, size_t) { ++visit_counter; return true; };
+
+        auto leaf = parsi_expect_char('x');
+        alternatives[2] = parsi_combine_extract(&leaf, visit_fn, NULL, NULL, NULL);
+
+        auto plain_parser = parsi_compile(&expr);
+        CHECK(parsi_parse(plain_parser, make_stream(nested(6, ']'))) == TResult{true, ""});
+        const int expected_visits = visit_counter;
+
+        visit_counter = 0;
+        auto compiled_parser = parsi_compile_ex(&expr, parsi_compile_flag_memoize);
+        CHECK(parsi_parse(compiled_parser, make_stream(nested(6, ']'))) == TResult{true, ""});
+        CHECK(visit_counter == expected_visits);
+        CHECK(parsi_memo_stats(compiled_parser).lookups == 0);
+
+        parsi_free_compiled_parser(compiled_parser);
+        parsi_free_compiled_parser(plain_parser);
+    }
+}
+
+TEST_CASE("c anyof dispatch")
+{
+    const std::initializer_list<uint32_t> all_flags = {
+        parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit,
+        parsi_compile_flag_memoize};
+
+    SECTION("keywords")
+    {
+        // the first alternative that matches wins, even if a later one is longer.
+        parsi_parser_t keywords[] = {
+            parsi_expect_static_string("for"),
+            parsi_expect_static_string("foreach"),
+            parsi_expect_static_string("while"),
+            parsi_expect_static_string("if"),
+            parsi_expect_static_string("int"),
+            parsi_expect_static_string("\xff\xfe"),
+            parsi_expect_charset(parsi_charset("0123456789")),
+            parsi_expect_static_string("return"),
+            parsi_none()
+        };
+        auto parser = parsi_combine_anyof(keywords, NULL);
+
+        for (uint32_t flags : all_flags) {
+            INFO("flags: " << flags);
+            auto compiled_parser = parsi_compile_ex(&parser, flags);
+            REQUIRE(compiled_parser);
+
+            CHECK(parsi_parse(compiled_parser, make_stream("foreach")) == TResult{true, "each"});
+            CHECK(parsi_parse(compiled_parser, make_stream("fo")) == TResult{false, "fo"});
+            CHECK(parsi_parse(compiled_parser, make_stream("int x")) == TResult{true, " x"});
+            CHECK(parsi_parse(compiled_parser, make_stream("if")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("while(")) == TResult{true, "("});
+            CHECK(parsi_parse(compiled_parser, make_stream("returns")) == TResult{true, "s"});
+            CHECK(parsi_parse(compiled_parser, make_stream("42")) == TResult{true, "2"});
+            CHECK(parsi_parse(compiled_parser, make_stream("\xff\xfe")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("\xff")) == TResult{false, "\xff"});
+            CHECK(parsi_parse(compiled_parser, make_stream("x")) == TResult{false, "x"});
+            CHECK(parsi_parse(compiled_parser, make_stream("")) == TResult{false, ""});
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    }
+
+    SECTION("fallback alternatives")
+    {
+        // custom and empty matching alternatives are tried on any byte, in order.
+        const auto parse_fn = [](void*, parsi_stream_t stream) {
+            const bool is_valid = stream.size >= 2 && stream.cursor[0] == stream.cursor[1];
+            return parsi_result_t{ .is_valid = is_valid, .stream = is_valid ? parsi_stream_t{stream.cursor + 2, stream.size - 2} : stream };
+        };
+        auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+        parsi_parser_t number_subparsers[] = {parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL), parsi_expect_char(';'), parsi_none()};
+        parsi_parser_t tail_subparsers[] = {parsi_expect_char('a'), parsi_expect_char('!'), parsi_none()};
+        auto tail = parsi_combine_sequence(tail_subparsers, NULL);
+        parsi_parser_t alternatives[] = {
+            parsi_combine_sequence(number_subparsers, NULL),
+            parsi_custom_parser(parse_fn, NULL, NULL),
+            parsi_expect_static_string("ab"),
+            parsi_expect_char('c'),
+            parsi_expect_eos(),
+            parsi_combine_optional(&tail, NULL),
+            parsi_none()
+        };
+        auto parser = parsi_combine_anyof(alternatives, NULL);
+
+        for (uint32_t flags : all_flags) {
+            INFO("flags: " << flags);
+            auto compiled_parser = parsi_compile_ex(&parser, flags);
+            REQUIRE(compiled_parser);
+
+            CHECK(parsi_parse(compiled_parser, make_stream("12;x")) == TResult{true, "x"});
+            CHECK(parsi_parse(compiled_parser, make_stream("11x")) == TResult{true, "x"});
+            CHECK(parsi_parse(compiled_parser, make_stream("aab")) == TResult{true, "b"});
+            CHECK(parsi_parse(compiled_parser, make_stream("ab")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("a!")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("cc")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("c")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("xy")) == TResult{true, "xy"});
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    }
+
+    SECTION("recursive alternatives")
+    {
+        // value := '[' value? ']' | '{' value? '}' | 'n' 'ull' | 't' 'rue' | digit+
+        parsi_parser_t value;
+        auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+        parsi_parser_t list_subparsers[] = {parsi_expect_char('['), parsi_combine_optional(&value, NULL), parsi_expect_char(']'), parsi_none()};
+        parsi_parser_t object_subparsers[] = {parsi_expect_char('{'), parsi_combine_optional(&value, NULL), parsi_expect_char('}'), parsi_none()};
+        parsi_parser_t null_subparsers[] = {parsi_expect_char('n'), parsi_expect_static_string("ull"), parsi_none()};
+        parsi_parser_t true_subparsers[] = {parsi_expect_char('t'), parsi_expect_static_string("rue"), parsi_none()};
+        parsi_parser_t alternatives[] = {
+            parsi_combine_sequence(list_subparsers, NULL),
+            parsi_combine_sequence(object_subparsers, NULL),
+            parsi_combine_sequence(null_subparsers, NULL),
+            parsi_combine_sequence(true_subparsers, NULL),
+            parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL),
+            parsi_none()
+        };
+        value = parsi_combine_anyof(alternatives, NULL);
+
+        for (uint32_t flags : all_flags) {
+            INFO("flags: " << flags);
+            auto compiled_parser = parsi_compile_ex(&value, flags);
+            REQUIRE(compiled_parser);
+
+            CHECK(parsi_parse(compiled_parser, make_stream("[{[42]}]")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("[{true}]x")) == TResult{true, "x"});
+            CHECK(parsi_parse(compiled_parser, make_stream("[{nul}]")) == TResult{false, "[{nul}]"});
+            CHECK(parsi_parse(compiled_parser, make_stream("[]")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("]")) == TResult{false, "]"});
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    }
+}
+
+TEST_CASE("c parse stack")
+{
+    // parens := '(' optional(parens) ')'
+    parsi_parser_t parens;
+    parsi_parser_t subparsers[] = {
+        parsi_expect_char('('),
+        parsi_combine_optional(&parens, NULL),
+        parsi_expect_char(')'),
+        parsi_none()
+    };
+    parens = parsi_combine_sequence(subparsers, NULL);
+
+    const auto nested = [](std::size_t depth) {
+        return std::string(depth, '(') + std::string(depth, ')');
+    };
+
+    SECTION("deep nesting")
+    {
+        auto compiled_parser = parsi_compile(&parens);
+        const std::string input = nested(100'000);
+        CHECK(parsi_parse(compiled_parser, make_stream(input)) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream(input)) == TResult{true, ""});
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("max depth")
+    {
+        for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+            INFO("flags: " << flags);
+            auto compiled_parser = parsi_compile_ex(&parens, flags);
+            parsi_set_max_depth(compiled_parser, 100);
+
+            CHECK(parsi_parse(compiled_parser, make_stream(nested(10))) == TResult{true, ""});
+            CHECK(!parsi_parse(compiled_parser, make_stream(nested(1000))).is_valid);
+
+            const std::string inputs[] = {nested(10), nested(1000), nested(20)};
+            const parsi_stream_t streams[] = {make_stream(inputs[0]), make_stream(inputs[1]), make_stream(inputs[2])};
+            parsi_result_t results[3];
+            parsi_parse_many(compiled_parser, streams, results, 3);
+            CHECK(results[0] == TResult{true, ""});
+            CHECK(!results[1].is_valid);
+            CHECK(results[2] == TResult{true, ""});
+
+            parsi_set_max_depth(compiled_parser, 0);
+            CHECK(parsi_parse(compiled_parser, make_stream(nested(1000))) == TResult{true, ""});
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    }
+
+    SECTION("caller buffer")
+    {
+        auto compiled_parser = parsi_compile_ex(&parens, parsi_compile_flag_jit);
+        REQUIRE(parsi_stack_frame_size() > 0);
+
+        std::vector<unsigned char> buffer(64 * parsi_stack_frame_size() + 1);
+        CHECK(parsi_parse_with_stack(compiled_parser, make_stream(nested(10)), buffer.data(), buffer.size()) == TResult{true, ""});
+        CHECK(parsi_parse_with_stack(compiled_parser, make_stream("(()"), buffer.data() + 1, buffer.size() - 1) == TResult{false, ""});
+        CHECK(!parsi_parse_with_stack(compiled_parser, make_stream(nested(100)), buffer.data(), buffer.size()).is_valid);
+        CHECK(!parsi_parse_with_stack(compiled_parser, make_stream("()"), NULL, 0).is_valid);
+
+        parsi_set_max_depth(compiled_parser, 4);
+        CHECK(!parsi_parse_with_stack(compiled_parser, make_stream(nested(10)), buffer.data(), buffer.size()).is_valid);
+
+        parsi_free_compiled_parser(compiled_parser);
+
+        auto chr = parsi_expect_char('x');
+        auto leaf_parser = parsi_compile(&chr);
+        CHECK(parsi_parse_with_stack(leaf_parser, make_stream("xy"), NULL, 0) == TResult{true, "y"});
+        parsi_free_compiled_parser(leaf_parser);
+    }
+}
+
+TEST_CASE("c serialize")
+{
+    // pair := extract(word) '=' custom(digits) (',' pair)?
+    static std::vector<std::string> keys;
+    const auto visit_fn = [](void*, const char* str, size_t size) {
+        keys.emplace_back(str, size);
+        return true;
+    };
+    const auto parse_fn = [](void* context, parsi_stream_t stream) {
+        const auto max_digits = *static_cast<const std::size_t*>(context);
+        std::size_t count = 0;
+        while (count < stream.size && count < max_digits && std::isdigit(static_cast<unsigned char>(stream.cursor[count]))) {
+            ++count;
+        }
+        return parsi_result_t{ .is_valid = count > 0, .stream = {stream.cursor + count, stream.size - count} };
+    };
+    std::size_t max_digits = 3;
+
+    auto letter = parsi_expect_charset(parsi_charset("abcdefghijklmnopqrstuvwxyz"));
+    auto word = parsi_combine_repeat(&letter, 1, SIZE_MAX, NULL);
+    parsi_parser_t pair;
+    parsi_parser_t rest_subparsers[] = {parsi_expect_char(','), parsi_combine_optional(&pair, NULL), parsi_none()};
+    auto rest = parsi_combine_sequence(rest_subparsers, NULL);
+    parsi_parser_t subparsers[] = {
+        parsi_combine_extract(&word, visit_fn, NULL, NULL, NULL),
+        parsi_expect_char('='),
+        parsi_custom_parser(parse_fn, &max_digits, NULL),
+        parsi_combine_optional(&rest, NULL),
+        parsi_none()
+    };
+    pair = parsi_combine_sequence(subparsers, NULL);
+
+    struct Names {
+        parsi_parser_fn_t parse_fn;
+        parsi_extract_visitor_fn_t visit_fn;
+        void* context;
+    };
+    Names names{parse_fn, visit_fn, &max_digits};
+    const auto name_fn = [](void* ctx, parsi_callback_t callback) -> const char* {
+        const auto& names = *static_cast<Names*>(ctx);
+        if (callback.parse_fn == names.parse_fn) {
+            return "digits";
+        }
+        return callback.visit_fn == names.visit_fn ? "key" : NULL;
+    };
+    const auto bind_fn = [](void* ctx, const char* name, parsi_callback_t* callback) {
+        const auto& names = *static_cast<Names*>(ctx);
+        if (std::string_view(name) == "digits") {
+            *callback = parsi_callback_t{};
+            callback->parse_fn = names.parse_fn;
+            callback->context = names.context;
+            return true;
+        }
+        if (std::string_view(name) == "key") {
+            *callback = parsi_callback_t{};
+            callback->visit_fn = names.visit_fn;
+            return true;
+        }
+        return false;
+    };
+
+    auto compiled_parser = parsi_compile_ex(&pair, parsi_compile_flag_memoize);
+    REQUIRE(compiled_parser);
+
+    const std::size_t size = parsi_compiled_serialize(compiled_parser, name_fn, &names, NULL, 0);
+    REQUIRE(size > 0);
+    std::vector<unsigned char> data(size);
+    CHECK(parsi_compiled_serialize(compiled_parser, name_fn, &names, data.data(), data.size()) == size);
+
+    const std::string_view inputs[] = {"a=1", "ab=12,cd=3456,", "x=,y=1", "=1", "k=999,z=0x"};
+
+    SECTION("round trip")
+    {
+        for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+            INFO("flags: " << flags);
+            auto loaded_parser = parsi_compiled_load(data.data(), data.size(), bind_fn, &names, flags);
+            REQUIRE(loaded_parser);
+
+            for (std::string_view input : inputs) {
+                INFO(input);
+                keys.clear();
+                const auto expected = parsi_parse(compiled_parser, make_stream(input));
+                const auto expected_keys = keys;
+                keys.clear();
+                CHECK(parsi_parse(loaded_parser, make_stream(input)) == TResult{expected.is_valid, to_strview(expected.stream)});
+                CHECK(keys == expected_keys);
+            }
+
+            parsi_free_compiled_parser(loaded_parser);
+        }
+
+        keys.clear();
+        CHECK(parsi_parse(compiled_parser, make_stream("ab=12,cd=3456,")) == TResult{true, "6,"});
+        CHECK(keys == std::vector<std::string>{"ab", "cd"});
+    }
+
+    SECTION("file")
+    {
+        const std::string path = "parsi-c-serialize-test.bin";
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        REQUIRE(file);
+        REQUIRE(std::fwrite(data.data(), 1, data.size(), file) == data.size());
+        std::fclose(file);
+
+        auto loaded_parser = parsi_compiled_load_file(path.c_str(), bind_fn, &names, parsi_compile_flag_none);
+        REQUIRE(loaded_parser);
+        CHECK(parsi_parse(loaded_parser, make_stream("a=1,b=2")) == TResult{true, ""});
+        parsi_free_compiled_parser(loaded_parser);
+
+        std::remove(path.c_str());
+        CHECK(!parsi_compiled_load_file(path.c_str(), bind_fn, &names, parsi_compile_flag_none));
+    }
+
+    SECTION("invalid data")
+    {
+        CHECK(!parsi_compiled_load(data.data(), data.size() - 1, bind_fn, &names, parsi_compile_flag_none));
+        CHECK(!parsi_compiled_load(data.data(), 8, bind_fn, &names, parsi_compile_flag_none));
+        CHECK(!parsi_compiled_load(NULL, 0, bind_fn, &names, parsi_compile_flag_none));
+        CHECK(!parsi_compiled_load(data.data(), data.size(), NULL, NULL, parsi_compile_flag_none));
+
+        std::vector<unsigned char> corrupted = data;
+        corrupted[0] ^= 0xFF;
+        CHECK(!parsi_compiled_load(corrupted.data(), corrupted.size(), bind_fn, &names, parsi_compile_flag_none));
+
+        const auto unknown_fn = [](void*, const char*, parsi_callback_t*) { return false; };
+        CHECK(!parsi_compiled_load(data.data(), data.size(), unknown_fn, NULL, parsi_compile_flag_none));
+
+        const auto unnamed_fn = [](void*, parsi_callback_t) -> const char* { return NULL; };
+        CHECK(parsi_compiled_serialize(compiled_parser, unnamed_fn, NULL, NULL, 0) == 0);
+    }
+
+    parsi_free_compiled_parser(compiled_parser);
+}
+
+TEST_CASE("c parse ctx")
+{
+    // list := extract(number) (',' list)?
+    // number := custom(digits)
+    struct Output {
+        std::vector<std::string> numbers;
+        std::size_t digit_runs = 0;
+    };
+    const auto visit_fn = [](void* context, void* call_ctx, const char* str, size_t size) {
+        const auto prefix = *static_cast<const char*>(context);
+        static_cast<Output*>(call_ctx)->numbers.emplace_back(prefix + std::string(str, size));
+        return true;
+    };
+    const auto parse_fn = [](void*, void* call_ctx, parsi_stream_t stream) {
+        ++static_cast<Output*>(call_ctx)->digit_runs;
+        std::size_t count = 0;
+        while (count < stream.size && std::isdigit(static_cast<unsigned char>(stream.cursor[count]))) {
+            ++count;
+        }
+        return parsi_result_t{ .is_valid = count > 0, .stream = {stream.cursor + count, stream.size - count} };
+    };
+    char prefix = '#';
+
+    auto number = parsi_custom_parser_ctx(parse_fn, NULL, NULL);
+    parsi_parser_t list;
+    parsi_parser_t rest_subparsers[] = {parsi_expect_char(','), parsi_combine_optional(&list, NULL), parsi_none()};
+    auto rest = parsi_combine_sequence(rest_subparsers, NULL);
+    parsi_parser_t subparsers[] = {
+        parsi_combine_extract_ctx(&number, visit_fn, &prefix, NULL, NULL),
+        parsi_combine_optional(&rest, NULL),
+        parsi_none()
+    };
+    list = parsi_combine_sequence(subparsers, NULL);
+    REQUIRE(number.type == parsi_parser_type_custom_ctx);
+    REQUIRE(subparsers[0].type == parsi_parser_type_extract_ctx);
+
+    for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+        INFO("flags: " << flags);
+        auto compiled_parser = parsi_compile_ex(&list, flags);
+        REQUIRE(compiled_parser);
+
+        {
+            Output first;
+            Output second;
+            CHECK(parsi_parse_ctx(compiled_parser, make_stream("1,22,333"), &first) == TResult{true, ""});
+            CHECK(parsi_parse_ctx(compiled_parser, make_stream("4,x"), &second) == TResult{true, "x"});
+            CHECK(first.numbers == std::vector<std::string>{"#1", "#22", "#333"});
+            CHECK(first.digit_runs == 3);
+            CHECK(second.numbers == std::vector<std::string>{"#4"});
+            CHECK(second.digit_runs == 2);
+        }
+
+        {
+            // one compiled parser, each thread with its own output.
+            constexpr std::size_t thread_count = 8;
+            std::vector<std::string> inputs;
+            std::vector<Output> outputs(thread_count);
+            std::vector<parsi_result_t> results(thread_count);
+            for (std::size_t index = 0; index < thread_count; ++index) {
+                std::string input = "0";
+                for (std::size_t number = 1; number <= 1000 + index; ++number) {
+                    input += "," + std::to_string(number);
+                }
+                inputs.push_back(std::move(input));
+            }
+
+            std::vector<std::thread> threads;
+            for (std::size_t index = 0; index < thread_count; ++index) {
+                threads.emplace_back([&, index] {
+                    results[index] = parsi_parse_ctx(compiled_parser, make_stream(inputs[index]), &outputs[index]);
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            for (std::size_t index = 0; index < thread_count; ++index) {
+                INFO("thread: " << index);
+                CHECK(results[index] == TResult{true, ""});
+                REQUIRE(outputs[index].numbers.size() == 1001 + index);
+                CHECK(outputs[index].numbers.back() == "#" + std::to_string(1000 + index));
+            }
+        }
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("serialized")
+    {
+        auto compiled_parser = parsi_compile(&list);
+        REQUIRE(compiled_parser);
+
+        const auto name_fn = [](void*, parsi_callback_t callback) -> const char* {
+            return callback.parse_ctx_fn ? "number" : callback.visit_ctx_fn ? "visit" : nullptr;
+        };
+        std::vector<char> data(parsi_compiled_serialize(compiled_parser, name_fn, NULL, NULL, 0));
+        REQUIRE(!data.empty());
+        CHECK(parsi_compiled_serialize(compiled_parser, name_fn, NULL, data.data(), data.size()) == data.size());
+        parsi_free_compiled_parser(compiled_parser);
+
+        struct Bindings {
+            parsi_parser_ctx_fn_t parse_fn;
+            parsi_extract_visitor_ctx_fn_t visit_fn;
+            char* prefix;
+        };
+        Bindings bindings{parse_fn, visit_fn, &prefix};
+        const auto bind_fn = [](void* ctx, const char* name, parsi_callback_t* callback) {
+            const auto& bindings = *static_cast<Bindings*>(ctx);
+            if (std::string_view(name) == "number") {
+                callback->parse_ctx_fn = bindings.parse_fn;
+                return true;
+            }
+            // a function of the other kind doesn't bind a visitor.
+            callback->parse_fn = [](void*, parsi_stream_t stream) { return parsi_result_t{ true, stream }; };
+            callback->visit_ctx_fn = std::string_view(name) == "visit" ? bindings.visit_fn : nullptr;
+            callback->context = bindings.prefix;
+            return true;
+        };
+        auto loaded_parser = parsi_compiled_load(data.data(), data.size(), bind_fn, &bindings, parsi_compile_flag_none);
+        REQUIRE(loaded_parser);
+
+        Output output;
+        CHECK(parsi_parse_ctx(loaded_parser, make_stream("5,6"), &output) == TResult{true, ""});
+        CHECK(output.numbers == std::vector<std::string>{"#5", "#6"});
+        parsi_free_compiled_parser(loaded_parser);
+    }
+}
+
+TEST_CASE("c stream")
+{
+    // items := (item (',' item)*)? eos
+    // item := extract("true" | "false" | "null" | number | '"' [^"]* '"')
+    // number := [0-9]+ ('.' [0-9]+)?
+    static std::vector<std::string> extracted;
+    const auto visit_fn = [](void*, const char* str, size_t size) {
+        extracted.emplace_back(str, size);
+        return true;
+    };
+
+    auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+    auto digits = parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL);
+    parsi_parser_t fraction_subparsers[] = {parsi_expect_char('.'), digits, parsi_none()};
+    auto fraction = parsi_combine_sequence(fraction_subparsers, NULL);
+    parsi_parser_t number_subparsers[] = {digits, parsi_combine_optional(&fraction, NULL), parsi_none()};
+    std::string not_quote_chars;
+    for (int chr = 0; chr < 256; ++chr) {
+        if (chr != '"') {
+            not_quote_chars.push_back(static_cast<char>(chr));
+        }
+    }
+    auto not_quote = parsi_expect_charset(parsi_charset_n(not_quote_chars.data(), not_quote_chars.size()));
+    auto quoted_content = parsi_combine_repeat(&not_quote, 0, SIZE_MAX, NULL);
+    parsi_parser_t quoted_subparsers[] = {parsi_expect_char('"'), quoted_content, parsi_expect_char('"'), parsi_none()};
+    parsi_parser_t value_subparsers[] = {
+        parsi_expect_static_string("true"),
+        parsi_expect_static_string("false"),
+        parsi_expect_static_string("null"),
+        parsi_combine_sequence(number_subparsers, NULL),
+        parsi_combine_sequence(quoted_subparsers, NULL),
+        parsi_none()
+    };
+    auto value = parsi_combine_anyof(value_subparsers, NULL);
+    auto item = parsi_combine_extract(&value, visit_fn, NULL, NULL, NULL);
+    parsi_parser_t next_subparsers[] = {parsi_expect_char(','), item, parsi_none()};
+    auto next = parsi_combine_sequence(next_subparsers, NULL);
+    parsi_parser_t list_subparsers[] = {item, parsi_combine_repeat(&next, 0, SIZE_MAX, NULL), parsi_none()};
+    auto list = parsi_combine_sequence(list_subparsers, NULL);
+    parsi_parser_t items_subparsers[] = {parsi_combine_optional(&list, NULL), parsi_expect_eos(), parsi_none()};
+    auto items = parsi_combine_sequence(items_subparsers, NULL);
+
+    const std::string_view inputs[] = {
+        "", "true", "null,false,12.5,\"a,b\",7", "12.", "tru", "true,", "\"abc", "1,2,x", "12.5.3",
+    };
+
+    for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+        INFO("flags: " << flags);
+        auto compiled_parser = parsi_compile_ex(&items, flags);
+        REQUIRE(compiled_parser);
+
+        for (std::string_view input : inputs) {
+            INFO("input: " << input);
+            extracted.clear();
+            const auto expected = parsi_parse(compiled_parser, make_stream(input));
+            const auto expected_extracted = extracted;
+            const auto expected_position = static_cast<std::size_t>(expected.stream.cursor - input.data());
+
+            // every way of splitting the input into two chunks, and one byte at a time.
+            for (std::size_t split = 0; split <= input.size() + 1; ++split) {
+                INFO("split: " << split);
+                extracted.clear();
+                auto state = parsi_stream_begin(compiled_parser, NULL);
+                REQUIRE(state);
+                if (split <= input.size()) {
+                    parsi_stream_feed(state, make_stream(input.substr(0, split)));
+                    parsi_stream_feed(state, make_stream(input.substr(split)));
+                }
+                else {
+                    for (std::size_t index = 0; index < input.size(); ++index) {
+                        parsi_stream_feed(state, make_stream(input.substr(index, 1)));
+                    }
+                }
+                std::size_t position = SIZE_MAX;
+                const auto status = parsi_stream_end(state, &position);
+                CHECK(status == (expected.is_valid ? parsi_stream_status_valid : parsi_stream_status_invalid));
+                CHECK(position == expected_position);
+                CHECK(extracted == expected_extracted);
+            }
+        }
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("need more input")
+    {
+        auto compiled_parser = parsi_compile(&items);
+        REQUIRE(compiled_parser);
+
+        extracted.clear();
+        auto state = parsi_stream_begin(compiled_parser, NULL);
+        REQUIRE(state);
+        CHECK(parsi_stream_feed(state, make_stream("true,12")) == parsi_stream_status_need_more);
+        CHECK(extracted == std::vector<std::string>{"true"});
+        CHECK(parsi_stream_feed(state, make_stream(".5,fa")) == parsi_stream_status_need_more);
+        CHECK(extracted == std::vector<std::string>{"true", "12.5"});
+        // the result is known as soon as the input can't match anymore.
+        CHECK(parsi_stream_feed(state, make_stream("x")) == parsi_stream_status_invalid);
+        CHECK(parsi_stream_feed(state, make_stream("lse")) == parsi_stream_status_invalid);
+        std::size_t position = 0;
+        CHECK(parsi_stream_end(state, &position) == parsi_stream_status_invalid);
+        CHECK(position == 9);  // the eos after "true,12.5"
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("custom parsers")
+    {
+        // word := custom([a-z]+) '!'
+        static std::size_t calls = 0;
+        const auto parse_fn = [](void*, parsi_stream_t stream) {
+            ++calls;
+            std::size_t count = 0;
+            while (count < stream.size && std::islower(static_cast<unsigned char>(stream.cursor[count]))) {
+                ++count;
+            }
+            return parsi_result_t{ .is_valid = count > 0, .stream = {stream.cursor + count, stream.size - count} };
+        };
+        parsi_parser_t word_subparsers[] = {parsi_custom_parser(parse_fn, NULL, NULL), parsi_expect_char('!'), parsi_none()};
+        auto word = parsi_combine_sequence(word_subparsers, NULL);
+        auto compiled_parser = parsi_compile(&word);
+        REQUIRE(compiled_parser);
+
+        auto state = parsi_stream_begin(compiled_parser, NULL);
+        REQUIRE(state);
+        calls = 0;
+        CHECK(parsi_stream_feed(state, make_stream("hel")) == parsi_stream_status_need_more);
+        CHECK(parsi_stream_feed(state, make_stream("lo")) == parsi_stream_status_need_more);
+        CHECK(parsi_stream_feed(state, make_stream("!rest")) == parsi_stream_status_valid);
+        CHECK(calls == 3);
+        std::size_t position = 0;
+        CHECK(parsi_stream_end(state, &position) == parsi_stream_status_valid);
+        CHECK(position == 6);
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
+
+TEST_CASE("c grammar")
+{
+    static std::vector<std::string> keys;
+    static std::vector<std::string> values;
+    struct Bindings {
+        std::size_t max_digits;
+    };
+    const auto bind_fn = [](void* ctx, const char* name, parsi_callback_t* callback) {
+        const std::string_view name_view = name;
+        if (name_view == "key" || name_view == "value") {
+            callback->visit_fn = [](void* context, const char* str, size_t size) {
+                static_cast<std::vector<std::string>*>(context)->emplace_back(str, size);
+                return true;
+            };
+            callback->context = name_view == "key" ? &keys : &values;
+            return true;
+        }
+        if (name_view == "digits") {
+            callback->parse_fn = [](void* context, parsi_stream_t stream) {
+                const auto max_digits = static_cast<const Bindings*>(context)->max_digits;
+                std::size_t count = 0;
+                while (count < stream.size && count < max_digits && std::isdigit(static_cast<unsigned char>(stream.cursor[count]))) {
+                    ++count;
+                }
+                return parsi_result_t{ .is_valid = count > 0, .stream = {stream.cursor + count, stream.size - count} };
+            };
+            callback->context = ctx;
+            return true;
+        }
+        return false;
+    };
+    Bindings bindings{3};
+
+    SECTION("rules and captures")
+    {
+        const char* grammar = R"(
+            # key=value pairs separated by commas, values nested in parentheses
+            pairs  <- pair (',' pair)* !.
+            pair   <- key:name '=' value:value
+            name   <- [a-zA-Z_] [a-zA-Z0-9_]*
+            value  <- number / "'" [^']* "'" / '(' value ')' / 'null'
+            number <- '-'? [0-9]{1,3} ('.' digits)?
+        )";
+        for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+            INFO("flags: " << flags);
+            auto compiled_parser = parsi_compile_grammar(grammar, bind_fn, &bindings, flags, NULL);
+            REQUIRE(compiled_parser);
+
+            keys.clear();
+            values.clear();
+            CHECK(parsi_parse(compiled_parser, make_stream("a=1,b_2=-12.5,c='x,y',d=((null))")) == TResult{true, ""});
+            CHECK(keys == std::vector<std::string>{"a", "b_2", "c", "d"});
+            CHECK(values == std::vector<std::string>{"1", "-12.5", "'x,y'", "((null))"});
+
+            // like parsi's repeat, a bounded repetition fails on more than its max.
+            CHECK(parsi_parse(compiled_parser, make_stream("a=1234")) == TResult{false, "1234"});
+            CHECK(parsi_parse(compiled_parser, make_stream("a=1.2345")) == TResult{false, "5"});
+            CHECK(parsi_parse(compiled_parser, make_stream("a=(1")) == TResult{false, "(1"});
+            CHECK(parsi_parse(compiled_parser, make_stream("1=1")) == TResult{false, "1=1"});
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    }
+
+    SECTION("literals and classes")
+    {
+        const char* grammar = R"(start <- "a\"b" '\x41\n' [\]\-x-z]+ [^\0-\x1F]{2} '' !.)";
+        auto compiled_parser = parsi_compile_grammar(grammar, bind_fn, &bindings, parsi_compile_flag_none, NULL);
+        REQUIRE(compiled_parser);
+        CHECK(parsi_parse(compiled_parser, make_stream("a\"bA\n]-yz~ ")) == TResult{true, ""});
+        CHECK(parsi_parse(compiled_parser, make_stream("a\"bA\nw~ ")) == TResult{false, "w~ "});
+        CHECK(parsi_parse(compiled_parser, make_stream("a\"bA\nx~\t")) == TResult{false, "\t"});
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    SECTION("errors")
+    {
+        const std::pair<std::string_view, std::size_t> cases[] = {
+            {"", 0},
+            {"start <- 'a' / *", 15},
+            {"start <- 'a' )", 13},
+            {"start <- ('a'", 13},
+            {"start <- 'a", 9},
+            {"start <- [a-", 9},
+            {"start <- [z-a]", 9},
+            {"start <- 'a'{3,2}", 12},
+            {"start <- 'a'{x}", 13},
+            {"start <- !'a'", 9},
+            {"start <- a\nstart <- b", 11},
+            {"start <- nothing", 9},
+            {"start <- 'x' unknown:'a'", 13},
+            {"start <- digits:'a'", 9},
+            // left recursion, which would never return from a parse.
+            {"start <- start 'a' / 'b'", 0},
+            {"start <- 'a'? start", 0},
+            {"start <- x\nx <- y\ny <- x", 11},
+            {"start <- 'a' x\nx <- ('b' / '')* x", 15},
+        };
+        for (const auto& [grammar, offset] : cases) {
+            INFO("grammar: " << grammar);
+            std::size_t error_offset = SIZE_MAX;
+            const std::string text(grammar);
+            CHECK_FALSE(parsi_compile_grammar(text.c_str(), bind_fn, &bindings, parsi_compile_flag_none, &error_offset));
+            CHECK(error_offset == offset);
+        }
+
+        // recursion after consuming input is fine.
+        auto compiled_parser = parsi_compile_grammar("start <- 'a' start / 'b'", bind_fn, &bindings,
+                                                     parsi_compile_flag_none, NULL);
+        REQUIRE(compiled_parser);
+        CHECK(parsi_parse(compiled_parser, make_stream("aab")) == TResult{true, ""});
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
+
+TEST_CASE("c compile identical subtrees")
+{
+    // pair := (word | number) ':' (word | number), with the two sides built apart from each other.
+    auto letter = parsi_expect_charset(parsi_charset("abcdefghijklmnopqrstuvwxyz"));
+    auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+    parsi_parser_t left_alternatives[] = {
+        parsi_combine_repeat(&letter, 1, SIZE_MAX, NULL), parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL), parsi_none()
+    };
+    parsi_parser_t right_alternatives[] = {
+        parsi_combine_repeat(&letter, 1, SIZE_MAX, NULL), parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL), parsi_none()
+    };
+    auto left = parsi_combine_anyof(left_alternatives, NULL);
+    auto right = parsi_combine_anyof(right_alternatives, NULL);
+    parsi_parser_t subparsers[] = {left, parsi_expect_char(':'), right, parsi_none()};
+    auto pair = parsi_combine_sequence(subparsers, NULL);
+
+    // the same, with one side referred to twice.
+    parsi_parser_t shared_subparsers[] = {left, parsi_expect_char(':'), left, parsi_none()};
+    auto shared_pair = parsi_combine_sequence(shared_subparsers, NULL);
+
+    SECTION("are compiled once")
+    {
+        auto compiled_parser = parsi_compile(&pair);
+        auto shared_compiled_parser = parsi_compile(&shared_pair);
+        REQUIRE(compiled_parser);
+        REQUIRE(shared_compiled_parser);
+
+        const std::size_t size = parsi_compiled_serialize(compiled_parser, NULL, NULL, NULL, 0);
+        CHECK(size > 0);
+        CHECK(size == parsi_compiled_serialize(shared_compiled_parser, NULL, NULL, NULL, 0));
+
+        parsi_free_compiled_parser(compiled_parser);
+        parsi_free_compiled_parser(shared_compiled_parser);
+    }
+
+    SECTION("parse the same")
+    {
+        for (uint32_t flags : {uint32_t{parsi_compile_flag_none}, uint32_t{parsi_compile_flag_threaded_dispatch},
+                               uint32_t{parsi_compile_flag_jit}, uint32_t{parsi_compile_flag_memoize}}) {
+            INFO("flags: " << flags);
+            auto compiled_parser = parsi_compile_ex(&pair, flags);
+            REQUIRE(compiled_parser);
+
+            CHECK(parsi_parse(compiled_parser, make_stream("abc:12")) == TResult{true, ""});
+            CHECK(parsi_parse(compiled_parser, make_stream("12:xy;")) == TResult{true, ";"});
+            CHECK(parsi_parse(compiled_parser, make_stream("7:7")) == TResult{true, ""});
+            CHECK_FALSE(parsi_parse(compiled_parser, make_stream("ab:")).is_valid);
+            CHECK_FALSE(parsi_parse(compiled_parser, make_stream(":ab")).is_valid);
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    }
+
+    SECTION("are profiled as one node")
+    {
+        auto compiled_parser = parsi_compile_ex(&pair, parsi_compile_flag_profile);
+        REQUIRE(compiled_parser);
+        // the sequence, the side's anyof, its two repeats (scanning their charsets) and the colon.
+        CHECK(parsi_profile_get(compiled_parser, NULL, 0) == 5);
+
+        CHECK(parsi_parse(compiled_parser, make_stream("ab:12")) == TResult{true, ""});
+
+        parsi_profile_entry_t entries[8];
+        const std::size_t size = parsi_profile_get(compiled_parser, entries, std::size(entries));
+        REQUIRE(size == 5);
+        const auto side = std::find_if(entries, entries + size, [&](const auto& entry) { return entry.node == &subparsers[0]; });
+        REQUIRE(side != entries + size);
+        CHECK(side->invocations == 2);
+        CHECK(side->consumed == 4);
+        CHECK(std::none_of(entries, entries + size, [&](const auto& entry) { return entry.node == &subparsers[2]; }));
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
+
+TEST_CASE("c anyof literals")
+{
+    // the first alternative that the input starts with wins, even when a later one is longer.
+    const auto check_literals = [](std::vector<parsi_parser_t> alternatives, const std::vector<std::string_view>& literals,
+                                   const std::vector<std::string>& inputs) {
+        alternatives.push_back(parsi_none());
+        auto parser = parsi_combine_anyof(alternatives.data(), NULL);
+
+        for (uint32_t flags : {parsi_compile_flag_none, parsi_compile_flag_threaded_dispatch, parsi_compile_flag_jit}) {
+            auto compiled_parser = parsi_compile_ex(&parser, flags);
+            REQUIRE(compiled_parser);
+
+            for (const std::string& input : inputs) {
+                INFO("flags: " << flags << ", input: " << input);
+                const auto literal = std::find_if(literals.begin(), literals.end(), [&](std::string_view literal) {
+                    return std::string_view(input).substr(0, literal.size()) == literal;
+                });
+                const auto expected = literal != literals.end() ? TResult{true, std::string_view(input).substr(literal->size())}
+                                                                : TResult{false, input};
+                CHECK(parsi_parse(compiled_parser, make_stream(input)) == expected);
+
+                // one byte at a time, the result waits for the bytes that could make an earlier literal match.
+                auto state = parsi_stream_begin(compiled_parser, NULL);
+                REQUIRE(state);
+                for (std::size_t index = 0; index < input.size(); ++index) {
+                    parsi_stream_feed(state, make_stream(std::string_view(input).substr(index, 1)));
+                }
+                std::size_t position = SIZE_MAX;
+                const auto status = parsi_stream_end(state, &position);
+                CHECK(status == (expected.is_valid ? parsi_stream_status_valid : parsi_stream_status_invalid));
+                CHECK(position == input.size() - expected.strview.size());
+            }
+
+            parsi_free_compiled_parser(compiled_parser);
+        }
+    };
+
+    SECTION("prefixes of each other")
+    {
+        const std::vector<std::string_view> literals = {"get", "getall", "s", "set", "setx", "delete", "del", "d", "x"};
+        std::vector<parsi_parser_t> alternatives;
+        for (std::string_view literal : literals) {
+            alternatives.push_back(literal.size() == 1 ? parsi_expect_char(literal[0])
+                                                       : parsi_expect_static_string(literal.data()));
+        }
+        check_literals(alternatives, literals, {"", "g", "ge", "get", "getal", "getall", "getallx", "s", "se", "set", "setx",
+                                                "setxy", "d", "de", "del", "dele", "delete", "deletes", "x", "xy", "y"});
+    }
+
+    SECTION("empty and duplicate literals")
+    {
+        const std::vector<std::string_view> literals = {"ab", "abc", "ab", "", "abcd"};
+        std::vector<parsi_parser_t> alternatives;
+        for (std::string_view literal : literals) {
+            alternatives.push_back(parsi_expect_static_string(literal.data()));
+        }
+        check_literals(alternatives, literals, {"", "a", "ab", "abc", "abcd", "b"});
+    }
+
+    SECTION("many keywords")
+    {
+        // "k199" down to "k0", so the longer keywords come first.
+        std::vector<std::string> keywords;
+        for (int index = 199; index >= 0; --index) {
+            keywords.push_back("k" + std::to_string(index));
+        }
+        std::vector<std::string_view> literals(keywords.begin(), keywords.end());
+        std::vector<parsi_parser_t> alternatives;
+        for (std::string& keyword : keywords) {
+            alternatives.push_back(parsi_expect_string(keyword.data(), keyword.size(), NULL));
+        }
+        std::vector<std::string> inputs = {"", "k", "k2000", "kx", "x1"};
+        for (const std::string& keyword : keywords) {
+            inputs.push_back(keyword + " ");
+        }
+        check_literals(alternatives, literals, inputs);
+    }
+}
+
+TEST_CASE("c parse captures")
+{
+    // record := field (';' field)*
+    // field := capture0(word) '=' capture1(number) | capture0(word) '=' capture2(word)
+    auto letter = parsi_expect_charset(parsi_charset("abcdefghijklmnopqrstuvwxyz"));
+    auto word = parsi_combine_repeat(&letter, 1, SIZE_MAX, NULL);
+    auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+    auto number = parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL);
+    parsi_parser_t number_field_subparsers[] = {
+        parsi_combine_capture(&word, 0, NULL), parsi_expect_char('='), parsi_combine_capture(&number, 1, NULL), parsi_none()
+    };
+    parsi_parser_t word_field_subparsers[] = {
+        parsi_combine_capture(&word, 0, NULL), parsi_expect_char('='), parsi_combine_capture(&word, 2, NULL), parsi_none()
+    };
+    parsi_parser_t field_alternatives[] = {
+        parsi_combine_sequence(number_field_subparsers, NULL), parsi_combine_sequence(word_field_subparsers, NULL), parsi_none()
+    };
+    auto field = parsi_combine_anyof(field_alternatives, NULL);
+    parsi_parser_t next_subparsers[] = {parsi_expect_char(';'), field, parsi_none()};
+    auto next = parsi_combine_sequence(next_subparsers, NULL);
+    parsi_parser_t record_subparsers[] = {field, parsi_combine_repeat(&next, 0, SIZE_MAX, NULL), parsi_none()};
+    auto record = parsi_combine_sequence(record_subparsers, NULL);
+
+    using Spans = std::vector<std::pair<std::size_t, std::size_t>>;
+    constexpr std::size_t unset = SIZE_MAX;
+    const auto check_captures = [](parsi_compiled_parser_t* compiled_parser, std::string_view input, TResult expected,
+                                   const Spans& expected_spans, std::size_t count = 3) {
+        INFO("input: " << input);
+        std::vector<parsi_span_t> slots(3, parsi_span_t{7, 7});
+        CHECK(parsi_parse_captures(compiled_parser, make_stream(input), slots.data(), count) == expected);
+        Spans spans;
+        for (const parsi_span_t& slot : slots) {
+            spans.emplace_back(slot.offset, slot.length);
+        }
+        CHECK(spans == expected_spans);
+    };
+
+    for (uint32_t flags : {uint32_t{parsi_compile_flag_none}, uint32_t{parsi_compile_flag_threaded_dispatch},
+                           uint32_t{parsi_compile_flag_jit}, uint32_t{parsi_compile_flag_memoize}}) {
+        INFO("flags: " << flags);
+        auto compiled_parser = parsi_compile_ex(&record, flags);
+        REQUIRE(compiled_parser);
+
+        check_captures(compiled_parser, "ab=12", TResult{true, ""}, Spans{{0, 2}, {3, 2}, {unset, 0}});
+
+        // the word captured by the number field before it failed is dropped.
+        check_captures(compiled_parser, "ab=cd", TResult{true, ""}, Spans{{0, 2}, {unset, 0}, {3, 2}});
+
+        // the last capture of a slot is kept.
+        check_captures(compiled_parser, "a=1;bc=x", TResult{true, ""}, Spans{{4, 2}, {2, 1}, {7, 1}});
+
+        // and so is the one before a repeat's iteration that failed.
+        check_captures(compiled_parser, "a=1;b=", TResult{true, ";b="}, Spans{{0, 1}, {2, 1}, {unset, 0}});
+
+        // slots past the count are left alone.
+        check_captures(compiled_parser, "a=1", TResult{true, ""}, Spans{{0, 1}, {7, 7}, {7, 7}}, 1);
+
+        // nothing is captured by a failed parse.
+        check_captures(compiled_parser, "ab=", TResult{false, "ab="}, Spans(3, {unset, 0}));
+
+        // plain parses only match.
+        CHECK(parsi_parse(compiled_parser, make_stream("a=1;bc=x")) == TResult{true, ""});
+        CHECK(parsi_parse_captures(compiled_parser, make_stream("a=1"), NULL, 3) == TResult{true, ""});
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+}
+
+TEST_CASE("c compile passes")
+{
+    // profiled parsers are compiled as built, so they tell what the optimized ones should parse.
+    const auto check_same = [](parsi_parser_t parser, const std::vector<std::string>& inputs) {
+        auto expected_parser = parsi_compile_ex(&parser, parsi_compile_flag_profile);
+        REQUIRE(expected_parser);
+        for (uint32_t flags : {uint32_t{parsi_compile_flag_none}, uint32_t{parsi_compile_flag_threaded_dispatch},
+                               uint32_t{parsi_compile_flag_jit}, uint32_t{parsi_compile_flag_memoize}}) {
+            auto compiled_parser = parsi_compile_ex(&parser, flags);
+            REQUIRE(compiled_parser);
+            for (const std::string& input : inputs) {
+                INFO("flags: " << flags << ", input: " << input);
+                const auto expected = parsi_parse(expected_parser, make_stream(input));
+                CHECK(parsi_parse(compiled_parser, make_stream(input))
+                      == TResult{expected.is_valid, to_strview(expected.stream)});
+            }
+            parsi_free_compiled_parser(compiled_parser);
+        }
+        parsi_free_compiled_parser(expected_parser);
+    };
+    const auto serialized_size = [](parsi_parser_t parser) -> std::size_t {
+        auto compiled_parser = parsi_compile(&parser);
+        REQUIRE(compiled_parser);
+        const std::size_t size = parsi_compiled_serialize(compiled_parser, NULL, NULL, NULL, 0);
+        parsi_free_compiled_parser(compiled_parser);
+        return size;
+    };
+
+    auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+    auto digits = parsi_combine_repeat(&digit, 0, SIZE_MAX, NULL);
+
+    SECTION("nested sequences of literals")
+    {
+        parsi_parser_t head_subparsers[] = {parsi_expect_char('a'), parsi_expect_static_string("bc"), parsi_none()};
+        parsi_parser_t de_subparsers[] = {parsi_expect_static_string("de"), parsi_none()};
+        parsi_parser_t tail_subparsers[] = {parsi_combine_sequence(de_subparsers, NULL), parsi_expect_static_string(""),
+                                            parsi_expect_char('f'), parsi_none()};
+        parsi_parser_t subparsers[] = {parsi_combine_sequence(head_subparsers, NULL),
+                                       parsi_combine_sequence(tail_subparsers, NULL), digits, parsi_none()};
+        auto parser = parsi_combine_sequence(subparsers, NULL);
+
+        check_same(parser, {"abcdef12;", "abcdef", "abcdeg", "abcdx", "abx", "a", "", "xbcdef"});
+        // the literals merged out of the sequences fail where the sequences did.
+        auto compiled_parser = parsi_compile(&parser);
+        REQUIRE(compiled_parser);
+        CHECK(parsi_parse(compiled_parser, make_stream("abcdx")) == TResult{false, "dx"});
+        CHECK(parsi_parse(compiled_parser, make_stream("abcdef")) == TResult{true, ""});
+        parsi_free_compiled_parser(compiled_parser);
+
+        parsi_parser_t flat_subparsers[] = {parsi_expect_char('a'), parsi_expect_static_string("bc"), parsi_expect_static_string("de"),
+                                            parsi_expect_char('f'), digits, parsi_none()};
+        CHECK(serialized_size(parser) == serialized_size(parsi_combine_sequence(flat_subparsers, NULL)));
+    }
+
+    SECTION("nested anyofs of single bytes")
+    {
+        parsi_parser_t inner_alternatives[] = {parsi_expect_static_string("y"), parsi_expect_charset(parsi_charset("z0")),
+                                               parsi_none()};
+        parsi_parser_t alternatives[] = {parsi_expect_char('x'), parsi_combine_anyof(inner_alternatives, NULL), parsi_none()};
+        auto parser = parsi_combine_anyof(alternatives, NULL);
+
+        check_same(parser, {"x", "y", "z", "0", "1", "", "xy"});
+        CHECK(serialized_size(parser) == serialized_size(parsi_expect_charset(parsi_charset("xyz0"))));
+
+        // with longer alternatives around them.
+        parsi_parser_t mixed_alternatives[] = {parsi_expect_static_string("long"), parsi_combine_anyof(inner_alternatives, NULL),
+                                               parsi_expect_char('x'), digits, parsi_none()};
+        check_same(parsi_combine_anyof(mixed_alternatives, NULL), {"long", "lo", "y", "x", "1", "", ";"});
+    }
+
+    SECTION("optional wrappers")
+    {
+        auto optional_digits = parsi_combine_optional(&digits, NULL);
+        auto letter = parsi_expect_char('a');
+        auto optional_letter = parsi_combine_optional(&letter, NULL);
+        auto twice_optional_letter = parsi_combine_optional(&optional_letter, NULL);
+
+        check_same(optional_digits, {"123;", ";", ""});
+        check_same(twice_optional_letter, {"a", "b", ""});
+        CHECK(serialized_size(optional_digits) == serialized_size(digits));
+        CHECK(serialized_size(twice_optional_letter) == serialized_size(optional_letter));
+    }
+
+    SECTION("repeats of single bytes")
+    {
+        parsi_parser_t alternatives[] = {parsi_expect_static_string("a"), parsi_expect_char('b'), parsi_none()};
+        auto either = parsi_combine_anyof(alternatives, NULL);
+        auto parser = parsi_combine_repeat(&either, 1, 3, NULL);
+
+        check_same(parser, {"a", "abb", "abba", "ab;", "", ";"});
+        auto charset = parsi_expect_charset(parsi_charset("ab"));
+        CHECK(serialized_size(parser) == serialized_size(parsi_combine_repeat(&charset, 1, 3, NULL)));
+    }
+
+    SECTION("shared subsequences are kept")
+    {
+        parsi_parser_t pair_subparsers[] = {parsi_expect_char('('), digits, parsi_expect_char(')'), parsi_none()};
+        auto pair = parsi_combine_sequence(pair_subparsers, NULL);
+        parsi_parser_t subparsers[] = {pair, parsi_expect_char(','), pair, parsi_none()};
+        auto parser = parsi_combine_sequence(subparsers, NULL);
+
+        check_same(parser, {"(1),(23)", "(1),(2", "(1)(2)", "()"});
+    }
+}
+
+TEST_CASE("c parse parallel")
+{
+    struct Record {
+        std::size_t index;
+        std::string record;
+        bool is_valid;
+    };
+    struct Records {
+        std::vector<Record> records;
+        std::size_t stop_after = SIZE_MAX;
+    };
+    const auto collect = [](void* context, size_t index, parsi_stream_t record, parsi_result_t result) -> bool {
+        auto& records = *static_cast<Records*>(context);
+        records.records.push_back(Record{index, std::string(to_strview(record)), result.is_valid});
+        return records.records.size() < records.stop_after;
+    };
+
+    auto digit = parsi_expect_charset(parsi_charset("0123456789"));
+    auto number = parsi_combine_repeat(&digit, 1, SIZE_MAX, NULL);
+    parsi_parser_t subparsers[] = {number, parsi_expect_eos(), parsi_none()};
+    auto parser = parsi_combine_sequence(subparsers, NULL);
+    auto compiled_parser = parsi_compile(&parser);
+    REQUIRE(compiled_parser);
+
+    SECTION("reports every record in order")
+    {
+        // spans a few chunks, with every 7th record invalid.
+        std::string input;
+        std::vector<std::string> lines;
+        for (std::size_t index = 0; input.size() < (std::size_t{5} << 20); ++index) {
+            lines.push_back(index % 7 == 0 ? "x" + std::to_string(index) : std::to_string(index * 7919));
+            input += lines.back() + "\n";
+        }
+
+        for (size_t nthreads : {1, 4, 0}) {
+            INFO("threads: " << nthreads);
+            Records records;
+            CHECK(parsi_parse_parallel(compiled_parser, make_stream(input), parsi_charset("\n"), nthreads, collect,
+                                       &records));
+            REQUIRE(records.records.size() == lines.size());
+            for (std::size_t index = 0; index < lines.size(); ++index) {
+                const Record& record = records.records[index];
+                if (record.index != index || record.record != lines[index] || record.is_valid != (index % 7 != 0)) {
+                    FAIL("record " << index << ": " << record.index << ", " << record.record << ", " << record.is_valid);
+                }
+            }
+        }
+    }
+
+    SECTION("splits at any of the delimiters")
+    {
+        Records records;
+        CHECK(parsi_parse_parallel(compiled_parser, make_stream("1\r\n22\nx"), parsi_charset("\r\n"), 2, collect,
+                                   &records));
+        REQUIRE(records.records.size() == 4);
+        CHECK(records.records[0].record == "1");
+        CHECK(records.records[1].record == "");
+        CHECK_FALSE(records.records[1].is_valid);
+        CHECK(records.records[2].record == "22");
+        CHECK(records.records[3].record == "x");
+
+        Records empty_records;
+        CHECK(parsi_parse_parallel(compiled_parser, make_stream(""), parsi_charset("\n"), 2, collect, &empty_records));
+        CHECK(empty_records.records.empty());
+    }
+
+    SECTION("stops when the callback does")
+    {
+        std::string input;
+        for (std::size_t index = 0; index < 100000; ++index) {
+            input += "123456789012345\n";
+        }
+        Records records;
+        records.stop_after = 10;
+        CHECK_FALSE(parsi_parse_parallel(compiled_parser, make_stream(input), parsi_charset("\n"), 4, collect, &records));
+        CHECK(records.records.size() == 10);
+    }
+
+    parsi_free_compiled_parser(compiled_parser);
+}
+
+TEST_CASE("c generate cpp")
+{
+    const auto generate_grammar = [](const char* grammar, const char* symbol) {
+        std::string source(parsi_generate_cpp_grammar(grammar, symbol, NULL, 0, NULL), '\0');
+        if (!source.empty()) {
+            CHECK(parsi_generate_cpp_grammar(grammar, symbol, source.data(), source.size(), NULL) == source.size());
+            CHECK(source.back() == '\0');
+            source.pop_back();
+        }
+        return source;
+    };
+
+    SECTION("grammars")
+    {
+        const char* grammar = R"(
+            list  <- '[' (item (',' item)*)? ']' !.
+            item  <- key:[a-z]+ / list / number
+            number <- digits
+        )";
+        const std::string source = generate_grammar(grammar, "parse_list");
+        REQUIRE_FALSE(source.empty());
+        CHECK(source.find("#include <parsi/parsi.hpp>") != std::string::npos);
+        CHECK(source.find("extern \"C\" parsi_result_t parse_list(parsi_stream_t stream, void* context)")
+              != std::string::npos);
+        CHECK(source.find("extern \"C\" bool key(void* context, const char* str, size_t size);") != std::string::npos);
+        CHECK(source.find("extern \"C\" parsi_result_t digits(void* context, parsi_stream_t stream);")
+              != std::string::npos);
+        // `list` is recursive, through a struct of its own.
+        CHECK(source.find("struct Rule1 {") != std::string::npos);
+
+        // a buffer too small is left as is, with the size needed still returned.
+        char small[8] = "unset";
+        CHECK(parsi_generate_cpp_grammar(grammar, "parse_list", small, sizeof(small), NULL) == source.size() + 1);
+        CHECK(std::string_view(small) == "unset");
+    }
+
+    SECTION("failures")
+    {
+        size_t error_offset = 0;
+        CHECK(parsi_generate_cpp_grammar("a <- ('x'", "parse_a", NULL, 0, &error_offset) == 0);
+        CHECK(error_offset == 9);
+        CHECK(parsi_generate_cpp_grammar("a <- 'x'", "1parse", NULL, 0, NULL) == 0);
+        CHECK(parsi_generate_cpp_grammar("a <- 'x'", "parse a", NULL, 0, NULL) == 0);
+        CHECK(parsi_generate_cpp_grammar("a <- 'x'", NULL, NULL, 0, NULL) == 0);
+        CHECK(parsi_generate_cpp_grammar("a <- parse_a", "parse_a", NULL, 0, NULL) == 0);
+        // one name as both a custom parser and an extract visitor.
+        CHECK(parsi_generate_cpp_grammar("a <- cb cb:'x'", "parse_a", NULL, 0, NULL) == 0);
+    }
+
+    SECTION("parser trees")
+    {
+        static const parsi_parser_fn_t custom_fn = [](void* /* context */, parsi_stream_t stream) {
+            return parsi_result_t{ .is_valid = true, .stream = stream };
+        };
+        const auto name_fn = [](void* ctx, parsi_callback_t callback) -> const char* {
+            return callback.parse_fn == custom_fn ? static_cast<const char*>(ctx) : nullptr;
+        };
+
+        auto letter = parsi_expect_charset(parsi_charset("abc"));
+        auto letters = parsi_combine_repeat(&letter, 0, SIZE_MAX, NULL);
+        parsi_parser_t subparsers[] = {
+            letters,
+            parsi_expect_static_string("\"\\\n\x01"),
+            letters,
+            parsi_custom_parser(custom_fn, NULL, NULL),
+            parsi_expect_eos(),
+            parsi_none(),
+        };
+        auto parser = parsi_combine_sequence(subparsers, NULL);
+
+        char name[] = "my_custom";
+        std::string source(parsi_generate_cpp(&parser, "parse_tree", name_fn, name, NULL, 0), '\0');
+        REQUIRE_FALSE(source.empty());
+        CHECK(parsi_generate_cpp(&parser, "parse_tree", name_fn, name, source.data(), source.size()) == source.size());
+        CHECK(source.find("extern \"C\" parsi_result_t my_custom(void* context, parsi_stream_t stream);")
+              != std::string::npos);
+        CHECK(source.find(R"(\"\\\012\001)") != std::string::npos);
+        // the two copies of `letters` are written out in place, around the one `letter` they share.
+        CHECK(source.find("struct Rule1 {") != std::string::npos);
+        CHECK(source.find("struct Rule2 {") == std::string::npos);
+
+        char unnamed[] = "not a name";
+        CHECK(parsi_generate_cpp(&parser, "parse_tree", name_fn, unnamed, NULL, 0) == 0);
+        CHECK(parsi_generate_cpp(&parser, "my_custom", name_fn, name, NULL, 0) == 0);
+        CHECK(parsi_generate_cpp(&parser, "parse_tree", NULL, NULL, NULL, 0) == 0);
+    }
+}
+
+TEST_CASE("c profile")
+{
+    // items := ('a' | "bc")* eos
+    parsi_parser_t alternatives[] = {parsi_expect_char('a'), parsi_expect_static_string("bc"), parsi_none()};
+    auto item = parsi_combine_anyof(alternatives, NULL);
+    parsi_parser_t subparsers[] = {parsi_combine_repeat(&item, 0, SIZE_MAX, NULL), parsi_expect_eos(), parsi_none()};
+    auto items = parsi_combine_sequence(subparsers, NULL);
+
+    const auto entry_of = [](parsi_compiled_parser_t* compiled_parser, const parsi_parser_t* node) {
+        parsi_profile_entry_t entries[16];
+        const std::size_t size = parsi_profile_get(compiled_parser, entries, std::size(entries));
+        REQUIRE(size <= std::size(entries));
+        for (std::size_t index = 0; index < size; ++index) {
+            if (entries[index].node == node) {
+                return entries[index];
+            }
+        }
+        FAIL("node isn't profiled");
+        return parsi_profile_entry_t{};
+    };
+
+    for (uint32_t flags : {uint32_t{parsi_compile_flag_profile}, uint32_t{parsi_compile_flag_profile_cycles},
+                           uint32_t{parsi_compile_flag_profile | parsi_compile_flag_threaded_dispatch | parsi_compile_flag_jit}}) {
+        INFO("flags: " << flags);
+        auto compiled_parser = parsi_compile_ex(&items, flags);
+        REQUIRE(compiled_parser);
+        CHECK(parsi_profile_get(compiled_parser, NULL, 0) == 6);
+
+        CHECK(parsi_parse(compiled_parser, make_stream("abca")) == TResult{true, ""});
+
+        const auto root = entry_of(compiled_parser, &items);
+        CHECK(root.type == parsi_parser_type_sequence);
+        CHECK(root.invocations == 1);
+        CHECK(root.successes == 1);
+        CHECK(root.consumed == 4);
+        CHECK((root.cycles > 0) == ((flags & parsi_compile_flag_profile_cycles) != 0));
+
+        const auto anyof = entry_of(compiled_parser, &item);
+        CHECK(anyof.invocations == 4);
+        CHECK(anyof.successes == 3);
+        CHECK(anyof.failures == 1);
+        CHECK(anyof.consumed == 4);
+
+        const auto first = entry_of(compiled_parser, &alternatives[0]);
+        CHECK(first.type == parsi_parser_type_char);
+        CHECK(first.invocations == 4);
+        CHECK(first.successes == 2);
+        CHECK(first.consumed == 2);
+
+        const auto second = entry_of(compiled_parser, &alternatives[1]);
+        CHECK(second.invocations == 2);
+        CHECK(second.successes == 1);
+        CHECK(second.consumed == 2);
+
+        CHECK(entry_of(compiled_parser, &subparsers[1]).invocations == 1);
+
+        CHECK(parsi_compiled_serialize(compiled_parser, NULL, NULL, NULL, 0) == 0);
+
+        parsi_profile_reset(compiled_parser);
+        CHECK(entry_of(compiled_parser, &items).invocations == 0);
+        CHECK(entry_of(compiled_parser, &alternatives[0]).cycles == 0);
+
+        parsi_free_compiled_parser(compiled_parser);
+    }
+
+    auto compiled_parser = parsi_compile(&items);
+    CHECK(parsi_profile_get(compiled_parser, NULL, 0) == 0);
+    parsi_free_compiled_parser(compiled_parser);
+}
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include <parsi/parsi-c.h>
+
+namespace {
+
+/** 1-based line and column of the offset in the text. */
+auto position_of(const std::string& text, std::size_t offset) -> std::string
+{
+    const auto begin = text.begin();
+    const auto end = begin + static_cast<std::ptrdiff_t>(std::min(offset, text.size()));
+    const auto line = std::count(begin, end, '\n') + 1;
+    const auto line_begin = std::find(std::make_reverse_iterator(end), text.rend(), '\n').base();
+    return std::to_string(line) + ":" + std::to_string(end - line_begin + 1);
+}
+
+}  // namespace
+
+/**
+ * generates the C++ source of a PEG grammar (see `parsi_compile_grammar`),
+ * exporting `extern "C" parsi_result_t <symbol>(parsi_stream_t stream, void* context)`.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc != 4) {
+        std::cerr << "usage: " << argv[0] << " <grammar.peg> <symbol> <output.cpp>\n";
+        return 2;
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cerr << argv[1] << ": cannot open\n";
+        return 1;
+    }
+    std::stringstream text_stream;
+    text_stream << input.rdbuf();
+    const std::string text = text_stream.str();
+
+    std::size_t error_offset = 0;
+    const std::size_t size = parsi_generate_cpp_grammar(text.c_str(), argv[2], nullptr, 0, &error_offset);
+    if (size == 0) {
+        std::cerr << argv[1] << ":" << position_of(text, error_offset) << ": invalid grammar or symbol\n";
+        return 1;
+    }
+    std::string source(size, '\0');
+    parsi_generate_cpp_grammar(text.c_str(), argv[2], source.data(), source.size(), nullptr);
+    source.pop_back();
+
+    std::ofstream output(argv[3], std::ios::binary);
+    output << source;
+    if (!output.flush()) {
+        std::cerr << argv[3] << ": cannot write\n";
+        return 1;
+    }
+    return 0;
+}